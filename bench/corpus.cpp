@@ -0,0 +1,139 @@
+#include "corpus.h"
+#include <vector>
+
+namespace nust {
+
+namespace {
+
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(const CorpusOptions& options)
+        : options(options), state(options.seed ? options.seed : 1) {}
+
+    std::string generate() {
+        for (size_t func = 0; func < options.functions; ++func) {
+            generate_function(func);
+        }
+        return out;
+    }
+
+private:
+    // xorshift32, so the sequence doesn't depend on the standard library
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    size_t pick(size_t n) { return n == 0 ? 0 : next() % n; }
+
+    void indent(size_t depth) { out.append(4 * depth, ' '); }
+
+    void generate_function(size_t func) {
+        current = func;
+        loops = 0;
+        out += "fn f" + std::to_string(func) + "(mut p0: i32, p1: i32) -> i32 {\n";
+        variables = {"p0", "p1"};
+        for (size_t i = 0; i < options.identifiers; ++i) {
+            std::string name = "v" + std::to_string(i);
+            indent(1);
+            out += "let mut " + name + ": i32 = " + expression(options.expression_size) + ";\n";
+            variables.push_back(name);
+        }
+        block(options.nesting_depth, 1);
+        // The trailing expression is checked outside the body's scope, so
+        // the result is passed out through a parameter
+        if (options.identifiers > 0) {
+            indent(1);
+            out += "p0 = " + expression(options.expression_size) + ";\n";
+        }
+        indent(1);
+        out += "p0\n";
+        out += "}\n\n";
+    }
+
+    void block(size_t depth, size_t indentation) {
+        for (size_t i = 0; i < options.statements_per_block; ++i) {
+            assignment(indentation);
+        }
+        if (depth == 0) {
+            return;
+        }
+        if (pick(2) == 0) {
+            indent(indentation);
+            out += "if " + condition() + " {\n";
+            block(depth - 1, indentation + 1);
+            indent(indentation);
+            out += "} else {\n";
+            assignment(indentation + 1);
+            indent(indentation);
+            out += "}\n";
+        } else {
+            // Loop counters have unique names, as shadowing is an error
+            std::string counter = "i" + std::to_string(loops++);
+            indent(indentation);
+            out += "let mut " + counter + ": i32 = 0;\n";
+            indent(indentation);
+            out += "while " + counter + " < " + std::to_string(2 + pick(8)) + " {\n";
+            block(depth - 1, indentation + 1);
+            indent(indentation + 1);
+            out += counter + " = " + counter + " + 1;\n";
+            indent(indentation);
+            out += "}\n";
+        }
+    }
+
+    void assignment(size_t indentation) {
+        if (options.identifiers == 0) {
+            return;
+        }
+        indent(indentation);
+        out += "v" + std::to_string(pick(options.identifiers)) + " = " + expression(options.expression_size) + ";\n";
+    }
+
+    std::string condition() {
+        std::string left = expression(options.expression_size / 2) + " < " + expression(0);
+        if (pick(2) == 0) {
+            return left;
+        }
+        return left + " && " + expression(0) + " != " + std::to_string(pick(100));
+    }
+
+    // An i32 expression with `size` binary operators
+    std::string expression(size_t size) {
+        if (size == 0) {
+            return leaf();
+        }
+        size_t left = pick(size);
+        static const char* const operators[] = {" + ", " - ", " * "};
+        return "(" + expression(left) + operators[pick(3)] + expression(size - 1 - left) + ")";
+    }
+
+    std::string leaf() {
+        size_t kind = pick(10);
+        if (kind < 6) {
+            return variables[pick(variables.size())];
+        }
+        if (kind < 9 || current == 0) {
+            return std::to_string(pick(1000));
+        }
+        return "f" + std::to_string(pick(current)) + "(" + variables[pick(variables.size())] + ", " +
+               std::to_string(pick(10)) + ")";
+    }
+
+    const CorpusOptions& options;
+    uint32_t state;
+    std::string out;
+    std::vector<std::string> variables;  // Visible in the whole function body
+    size_t current = 0;                  // Function being generated
+    size_t loops = 0;
+};
+
+} // namespace
+
+std::string generate_corpus(const CorpusOptions& options) {
+    return CorpusGenerator(options).generate();
+}
+
+} // namespace nust
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace nust {
+
+// Shape of a generated program
+struct CorpusOptions {
+    size_t functions = 100;
+    size_t nesting_depth = 2;        // Levels of if/while nested in each function body
+    size_t expression_size = 8;      // Binary operators per expression
+    size_t identifiers = 8;          // Mutable locals declared by each function
+    size_t statements_per_block = 3; // Assignments in each block, besides nested statements
+    uint32_t seed = 1;
+};
+
+// Generate a well-typed Nust program. The output depends only on the
+// options, so the same options give the same program on every platform.
+//
+// Every function takes two i32 parameters, the first mutable, and only
+// calls functions defined before it, and every loop runs a fixed number of
+// times, so the programs also terminate when run.
+std::string generate_corpus(const CorpusOptions& options);
+
+} // namespace nust
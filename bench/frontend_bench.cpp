@@ -0,0 +1,125 @@
+// Front end benchmarks: parsing, type checking and compiling generated
+// programs, alone and end to end. Throughput is reported in bytes of source
+// and functions per second. Arguments are the corpus shape:
+// functions/depth/expr/idents (see CorpusOptions).
+
+#include <benchmark/benchmark.h>
+#include "corpus.h"
+#include "parser/parser.h"
+#include "type_checker.h"
+#include "compiler.h"
+
+namespace {
+
+using nust::CorpusOptions;
+
+CorpusOptions corpus_options(const benchmark::State& state) {
+    CorpusOptions options;
+    options.functions = static_cast<size_t>(state.range(0));
+    options.nesting_depth = static_cast<size_t>(state.range(1));
+    options.expression_size = static_cast<size_t>(state.range(2));
+    options.identifiers = static_cast<size_t>(state.range(3));
+    return options;
+}
+
+void report_throughput(benchmark::State& state, const std::string& source, size_t functions) {
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * source.size()));
+    state.counters["functions"] = benchmark::Counter(
+        static_cast<double>(state.iterations() * functions), benchmark::Counter::kIsRate);
+}
+
+std::unique_ptr<nust::Program> parse_checked(const std::string& source, benchmark::State& state) {
+    auto program = nust::Parser(source).parse();
+    nust::TypeChecker type_checker;
+    if (!type_checker.check_program(*program)) {
+        state.SkipWithError("Generated program does not type check");
+    }
+    return program;
+}
+
+void BM_Parse(benchmark::State& state) {
+    CorpusOptions options = corpus_options(state);
+    std::string source = nust::generate_corpus(options);
+    for (auto _ : state) {
+        auto program = nust::Parser(source).parse();
+        benchmark::DoNotOptimize(program.get());
+    }
+    report_throughput(state, source, options.functions);
+}
+
+void BM_TypeCheck(benchmark::State& state) {
+    CorpusOptions options = corpus_options(state);
+    std::string source = nust::generate_corpus(options);
+    auto program = parse_checked(source, state);
+    for (auto _ : state) {
+        nust::TypeChecker type_checker;
+        benchmark::DoNotOptimize(type_checker.check_program(*program));
+    }
+    report_throughput(state, source, options.functions);
+}
+
+void BM_Compile(benchmark::State& state) {
+    CorpusOptions options = corpus_options(state);
+    std::string source = nust::generate_corpus(options);
+    auto program = parse_checked(source, state);
+    for (auto _ : state) {
+        nust::Compiler compiler;
+        auto instructions = compiler.compile(*program);
+        benchmark::DoNotOptimize(instructions.data());
+    }
+    report_throughput(state, source, options.functions);
+}
+
+void BM_CompileOptimized(benchmark::State& state) {
+    CorpusOptions options = corpus_options(state);
+    std::string source = nust::generate_corpus(options);
+    auto program = parse_checked(source, state);
+    for (auto _ : state) {
+        nust::Compiler compiler(nust::CompilerOptions::optimized());
+        auto instructions = compiler.compile(*program);
+        benchmark::DoNotOptimize(instructions.data());
+    }
+    report_throughput(state, source, options.functions);
+}
+
+void BM_EndToEnd(benchmark::State& state) {
+    CorpusOptions options = corpus_options(state);
+    std::string source = nust::generate_corpus(options);
+    for (auto _ : state) {
+        auto program = nust::Parser(source).parse();
+        nust::TypeChecker type_checker;
+        if (!type_checker.check_program(*program)) {
+            state.SkipWithError("Generated program does not type check");
+            break;
+        }
+        nust::Compiler compiler;
+        auto instructions = compiler.compile(*program);
+        benchmark::DoNotOptimize(instructions.data());
+    }
+    report_throughput(state, source, options.functions);
+}
+
+// Scale each dimension of the corpus on its own, from a common baseline
+void corpus_shapes(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgNames({"functions", "depth", "expr", "idents"});
+    for (int64_t functions : {10, 100, 1000}) {
+        benchmark->Args({functions, 2, 8, 8});
+    }
+    for (int64_t depth : {0, 6}) {
+        benchmark->Args({100, depth, 8, 8});
+    }
+    for (int64_t expr : {2, 32}) {
+        benchmark->Args({100, 2, expr, 8});
+    }
+    for (int64_t idents : {2, 64}) {
+        benchmark->Args({100, 2, 8, idents});
+    }
+}
+
+BENCHMARK(BM_Parse)->Apply(corpus_shapes);
+BENCHMARK(BM_TypeCheck)->Apply(corpus_shapes);
+BENCHMARK(BM_Compile)->Apply(corpus_shapes);
+BENCHMARK(BM_CompileOptimized)->Apply(corpus_shapes);
+BENCHMARK(BM_EndToEnd)->Apply(corpus_shapes);
+
+} // namespace
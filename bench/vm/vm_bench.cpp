@@ -0,0 +1,430 @@
+// VM benchmarks: runs each workload in bench/vm under each execution engine
+// and reports the time per call of its `main`, instructions per second and
+// peak memory, optionally compared against a saved baseline.
+//
+// Usage: nust_vmbench [-O] [--dir DIR] [--filter TEXT] [--repetitions N]
+//                     [--min-time MS] [--save FILE] [--baseline FILE]
+//                     [--threshold PCT]
+//
+// Every workload defines `fn main(n: i32, mut result: i32) -> i32` and a
+// `// n: N` comment giving the n to call it with. Instruction counts come
+// from the checked interpreter, the only engine that counts them, so every
+// engine's instructions per second is the same work divided by its time.
+//
+// Each benchmark runs in its own process so its peak RSS isn't hidden by
+// the ones before it. A result is a regression when it is slower than the
+// baseline by more than the threshold (5% by default) or three times the
+// combined noise of both runs, whichever is larger; the exit status is 1 if
+// any result regressed.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "parser/parser.h"
+#include "type_checker.h"
+#include "compiler.h"
+#include "compile_stats.h"
+#include "vm.h"
+#include "register_translator.h"
+#include "register_vm.h"
+
+namespace {
+
+using nust::Value;
+
+enum class Engine { Checked, Unchecked, Jit, Registers };
+
+const Engine engines[] = {Engine::Checked, Engine::Unchecked, Engine::Jit, Engine::Registers};
+
+const char* engine_name(Engine engine) {
+    switch (engine) {
+        case Engine::Checked: return "checked";
+        case Engine::Unchecked: return "unchecked";
+        case Engine::Jit: return "jit";
+        case Engine::Registers: return "register";
+    }
+    return "";
+}
+
+struct Options {
+    bool optimize = false;
+    std::string dir = "bench/vm";
+    std::string filter;
+    size_t repetitions = 5;
+    double min_time_ms = 50;
+    std::string save_file;
+    std::string baseline_file;
+    double threshold = 0.05;
+};
+
+struct Workload {
+    std::string name;
+    std::string source;
+    Value::IntType n = 0;
+    uint64_t instructions = 0;  // Per call, counted by the checked interpreter
+    Value::IntType result = 0;  // What every engine must return
+};
+
+// A workload parsed, checked and compiled. The VMs keep references into the
+// compiler's function table, so this must outlive them.
+struct Build {
+    Build(const std::string& source, bool optimize)
+        : compiler(optimize ? nust::CompilerOptions::optimized() : nust::CompilerOptions()) {
+        program = nust::Parser(source).parse();
+        nust::TypeChecker type_checker;
+        if (!type_checker.check_program(*program)) {
+            throw std::runtime_error("type checking failed");
+        }
+        instructions = compiler.compile(*program);
+    }
+
+    std::unique_ptr<nust::Program> program;
+    nust::Compiler compiler;
+    std::vector<nust::Instruction> instructions;
+};
+
+enum class Status : int32_t { Ok, Unsupported, Failed };
+
+// Sent from the benchmark process to the parent through a pipe
+struct Report {
+    Status status = Status::Failed;
+    double ns_per_call = 0;
+    double noise = 0;  // Median absolute deviation over the median
+    uint64_t peak_rss_kib = 0;
+    Value::IntType result = 0;
+    char message[256] = {};
+};
+
+struct Result {
+    std::string workload;
+    std::string engine;
+    Report report;
+    double instructions_per_second = 0;
+};
+
+Report failure(Status status, const std::string& message) {
+    Report report;
+    report.status = status;
+    std::strncpy(report.message, message.c_str(), sizeof(report.message) - 1);
+    return report;
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+// Call `main` once to warm up, then time repetitions of at least the
+// minimum time each
+template <typename Call>
+Report time_calls(Call call, const Options& options) {
+    Report report;
+    report.result = call().as_int();
+    auto min_time = std::chrono::duration<double, std::milli>(options.min_time_ms);
+    std::vector<double> samples;
+    for (size_t i = 0; i < options.repetitions; ++i) {
+        size_t calls = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration elapsed{};
+        do {
+            call();
+            ++calls;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed < min_time);
+        samples.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / calls);
+    }
+    report.ns_per_call = median(samples);
+    std::vector<double> deviations;
+    for (double sample : samples) {
+        deviations.push_back(std::abs(sample - report.ns_per_call));
+    }
+    report.noise = median(deviations) / report.ns_per_call;
+    report.status = Status::Ok;
+    return report;
+}
+
+Report measure(const Workload& workload, Engine engine, const Options& options) {
+    Build build(workload.source, options.optimize);
+    const auto& table = build.compiler.get_function_table();
+    const auto& strings = build.compiler.get_string_constants();
+    std::vector<Value> args = {Value(workload.n), Value(0)};
+
+    if (engine == Engine::Registers) {
+        nust::RegisterVM vm(nust::RegisterTranslator().translate(build.instructions, table, strings));
+        return time_calls([&] { return vm.call("main", args); }, options);
+    }
+    nust::VMOptions vm_options;
+    vm_options.verify = engine != Engine::Checked;
+    vm_options.jit.enabled = engine == Engine::Jit;
+    if (engine == Engine::Jit && !nust::JitCompiler::supported()) {
+        return failure(Status::Unsupported, "no JIT on this platform");
+    }
+    nust::VM vm(build.instructions, table, strings, vm_options);
+    if (engine != Engine::Checked && !vm.is_verified()) {
+        return failure(Status::Unsupported, "program does not verify");
+    }
+    return time_calls([&] { return vm.call("main", args); }, options);
+}
+
+// Run the benchmark in a child process and read its report back
+Report measure_in_child(const Workload& workload, Engine engine, const Options& options) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return failure(Status::Failed, "pipe failed");
+    }
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return failure(Status::Failed, "fork failed");
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        Report report;
+        try {
+            report = measure(workload, engine, options);
+        } catch (const std::exception& e) {
+            report = failure(Status::Failed, e.what());
+        }
+        report.peak_rss_kib = nust::peak_rss() / 1024;
+        ssize_t written = write(fds[1], &report, sizeof(report));
+        _exit(written == static_cast<ssize_t>(sizeof(report)) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    Report report;
+    size_t received = 0;
+    while (received < sizeof(report)) {
+        ssize_t n = read(fds[0], reinterpret_cast<char*>(&report) + received, sizeof(report) - received);
+        if (n <= 0) {
+            break;
+        }
+        received += static_cast<size_t>(n);
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (received != sizeof(report)) {
+        return failure(Status::Failed, WIFSIGNALED(status)
+                                           ? "killed by signal " + std::to_string(WTERMSIG(status))
+                                           : std::string("no report"));
+    }
+    return report;
+}
+
+std::vector<Workload> load_workloads(const std::string& dir) {
+    std::vector<std::filesystem::path> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.path().extension() == ".nust") {
+            paths.push_back(entry.path());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<Workload> workloads;
+    for (const auto& path : paths) {
+        std::ifstream file(path);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        Workload workload;
+        workload.name = path.stem().string();
+        workload.source = buffer.str();
+        size_t at = workload.source.find("// n: ");
+        if (at == std::string::npos) {
+            throw std::runtime_error(path.string() + ": missing `// n: N` comment");
+        }
+        workload.n = static_cast<Value::IntType>(std::stol(workload.source.substr(at + 6)));
+        workloads.push_back(std::move(workload));
+    }
+    return workloads;
+}
+
+// Count the instructions one call takes and record the expected result
+void run_reference(Workload& workload, const Options& options) {
+    Build build(workload.source, options.optimize);
+    nust::VMOptions vm_options;
+    vm_options.verify = false;
+    nust::VM vm(build.instructions, build.compiler.get_function_table(),
+                build.compiler.get_string_constants(), vm_options);
+    workload.result = vm.call("main", {Value(workload.n), Value(0)}).as_int();
+    workload.instructions = vm.instructions_executed();
+}
+
+// Read a field from one line of a saved results file
+std::string json_field(const std::string& line, const std::string& key) {
+    std::string pattern = "\"" + key + "\": ";
+    size_t at = line.find(pattern);
+    if (at == std::string::npos) {
+        return "";
+    }
+    at += pattern.size();
+    if (line[at] == '"') {
+        return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+    }
+    return line.substr(at, line.find_first_of(",}", at) - at);
+}
+
+void save_results(const std::string& filename, const std::vector<Result>& results) {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open output file: " + filename);
+    }
+    out << std::setprecision(10);
+    for (const auto& result : results) {
+        if (result.report.status != Status::Ok) {
+            continue;
+        }
+        out << "{\"workload\": \"" << result.workload << "\", \"engine\": \"" << result.engine
+            << "\", \"ns_per_call\": " << result.report.ns_per_call
+            << ", \"noise\": " << result.report.noise
+            << ", \"instructions_per_second\": " << result.instructions_per_second
+            << ", \"peak_rss_kib\": " << result.report.peak_rss_kib << "}\n";
+    }
+}
+
+// Saved results by "workload/engine", as {ns_per_call, noise}
+std::map<std::string, std::pair<double, double>> load_baseline(const std::string& filename) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        throw std::runtime_error("Failed to open baseline: " + filename);
+    }
+    std::map<std::string, std::pair<double, double>> baseline;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string ns = json_field(line, "ns_per_call");
+        if (ns.empty()) {
+            continue;
+        }
+        std::string noise = json_field(line, "noise");
+        baseline[json_field(line, "workload") + "/" + json_field(line, "engine")] = {
+            std::stod(ns), noise.empty() ? 0.0 : std::stod(noise)};
+    }
+    return baseline;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-O") {
+            options.optimize = true;
+        } else if (arg == "--dir" && i + 1 < argc) {
+            options.dir = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--repetitions" && i + 1 < argc) {
+            options.repetitions = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            options.min_time_ms = std::stod(argv[++i]);
+        } else if (arg == "--save" && i + 1 < argc) {
+            options.save_file = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            options.baseline_file = argv[++i];
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            options.threshold = std::stod(argv[++i]) / 100;
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [-O] [--dir DIR] [--filter TEXT] [--repetitions N] [--min-time MS]"
+                      << " [--save FILE] [--baseline FILE] [--threshold PCT]\n";
+            return 1;
+        }
+    }
+
+    std::vector<Workload> workloads;
+    std::map<std::string, std::pair<double, double>> baseline;
+    try {
+        workloads = load_workloads(options.dir);
+        if (!options.baseline_file.empty()) {
+            baseline = load_baseline(options.baseline_file);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    std::cout << std::left << std::setw(14) << "workload" << std::setw(11) << "engine" << std::right
+              << std::setw(14) << "ns/call" << std::setw(8) << "noise" << std::setw(12) << "Minstr/s"
+              << std::setw(11) << "peak KiB";
+    if (!baseline.empty()) {
+        std::cout << "  vs baseline";
+    }
+    std::cout << "\n" << std::fixed;
+
+    std::vector<Result> results;
+    bool regressed = false;
+    for (auto& workload : workloads) {
+        try {
+            run_reference(workload, options);
+        } catch (const std::exception& e) {
+            std::cout << std::left << std::setw(14) << workload.name << e.what() << "\n";
+            continue;
+        }
+        for (Engine engine : engines) {
+            Result result{workload.name, engine_name(engine), {}, 0};
+            std::string key = result.workload + "/" + result.engine;
+            if (key.find(options.filter) == std::string::npos) {
+                continue;
+            }
+            result.report = measure_in_child(workload, engine, options);
+            const Report& report = result.report;
+            if (report.status == Status::Ok && report.result != workload.result) {
+                result.report = failure(Status::Failed, "returned " + std::to_string(report.result) +
+                                                            ", expected " + std::to_string(workload.result));
+            }
+            std::cout << std::left << std::setw(14) << result.workload << std::setw(11) << result.engine
+                      << std::right;
+            if (report.status != Status::Ok) {
+                std::cout << (report.status == Status::Unsupported ? "unsupported: " : "failed: ")
+                          << report.message << "\n";
+                results.push_back(result);
+                continue;
+            }
+            result.instructions_per_second = workload.instructions / (report.ns_per_call * 1e-9);
+            std::cout << std::setprecision(0) << std::setw(14) << report.ns_per_call
+                      << std::setprecision(1) << std::setw(7) << 100 * report.noise << "%"
+                      << std::setw(12) << result.instructions_per_second / 1e6
+                      << std::setw(11) << report.peak_rss_kib;
+            if (!baseline.empty()) {
+                auto it = baseline.find(key);
+                if (it == baseline.end()) {
+                    std::cout << "  new";
+                } else {
+                    auto [base_ns, base_noise] = it->second;
+                    double change = report.ns_per_call / base_ns - 1;
+                    double allowed = std::max(options.threshold,
+                                              3 * std::sqrt(report.noise * report.noise + base_noise * base_noise));
+                    const char* verdict = change > allowed ? "slower" : change < -allowed ? "faster" : "same";
+                    regressed |= change > allowed;
+                    std::cout << "  " << std::showpos << std::setw(7) << 100 * change << "% " << std::noshowpos << verdict;
+                }
+            }
+            std::cout << "\n";
+            results.push_back(result);
+        }
+    }
+
+    if (!options.save_file.empty()) {
+        try {
+            save_results(options.save_file, results);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+    return regressed ? 1 : 0;
+}
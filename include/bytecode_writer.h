@@ -0,0 +1,20 @@
+#pragma once
+
+#include "instruction.h"
+#include "debug_info.h"
+#include <ostream>
+#include <vector>
+
+namespace nust {
+
+// Write the program as assembly, one instruction per line, as in a .ns file
+void write_assembly(std::ostream& out, const std::vector<Instruction>& instructions);
+
+// Write the program as bytecode, as in a .no file: each opcode as a byte,
+// its operand as a little-endian size_t and superinstruction arguments as
+// little-endian 32-bit words. The span table follows as a trailing section
+// when one is given.
+void write_bytecode(std::ostream& out, const std::vector<Instruction>& instructions,
+                    const SpanTable* spans = nullptr);
+
+} // namespace nust
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "parser/parser.h"
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace nust {
+
+// Translates a type-checked program into a C99 translation unit, for
+// building native executables with the system C compiler.
+//
+// Every FunctionDecl becomes a C function named fn_<name> and every binding
+// a variable named v_<name>, with i32 as int32_t, bool as bool, str as
+// const char* and references as pointers. Statements map one to one onto C
+// statements. i32 arithmetic goes through small inline helpers that wrap
+// and report division by zero like the VM.
+// C leaves the order of operands and arguments unspecified, so where one
+// has side effects they are evaluated into temporaries ahead of the
+// statement, in the VM's order: left operand first, last argument first.
+// If the program has a `main`, a C main parses its arguments from the
+// command line and prints its result.
+class CEmitter {
+public:
+    std::string emit(const Program& program);
+
+private:
+    void emit_prelude();
+    void emit_function(const FunctionDecl& func);
+    void emit_entry_point(const FunctionDecl& main);
+    void emit_statement(const Stmt* stmt);
+    void emit_block(const BlockStmt* block);
+    std::string emit_expression(const Expr* expr);
+
+    // Evaluate an expression into a temporary declared ahead of the current
+    // statement and return its name; literals are returned as they are
+    std::string hoist(const Expr* expr, const std::string& code);
+    // Write out the temporaries the current statement needs
+    void flush_hoisted();
+
+    static std::string c_type(const Type& type);
+
+    // Declare a binding and return the C name it was given; shadowed names
+    // get a numeric suffix
+    std::string declare(const std::string& name);
+    std::string lookup(const std::string& name) const;
+    void enter_scope() { scopes.emplace_back(); }
+    void exit_scope() { scopes.pop_back(); }
+
+    std::string indentation() const { return std::string(indent * 4, ' '); }
+
+    std::ostringstream out;
+    size_t indent = 0;
+    std::vector<std::unordered_map<std::string, std::string>> scopes;
+    std::unordered_set<std::string> used_names;  // C names taken in the current function
+    std::string hoisted;  // Declarations of temporaries not yet written out
+    size_t temp_count = 0;
+};
+
+} // namespace nust
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "thread_pool.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace nust {
+
+struct CompileRequest {
+    bool optimize = false;    // As the driver's -O
+    bool debug_info = false;  // As the driver's -g
+    std::string source;
+};
+
+struct CompileResponse {
+    bool ok = false;
+    std::string bytecode;     // The .no file
+    std::string assembly;     // The .ns file
+    std::string diagnostics;  // Why compilation failed, when !ok
+};
+
+// Compiles requests sent over a Unix domain socket, keeping the results of
+// recent compiles so that a source seen before is answered without
+// compiling it again.
+//
+// Connections are served on a fixed pool of worker threads, each with its
+// own sessions, so the type checker and compiler are reused from one
+// request to the next. A worker serves one connection until the client
+// closes it.
+//
+// The protocol is a stream of requests, each answered in turn, on one
+// connection. All integers are 32-bit little-endian.
+//   Request:  flags (1 = optimize, 2 = debug info), source size, source
+//   Response: status (0 = ok), then for ok the bytecode size and bytes and
+//             the assembly size and bytes, otherwise the diagnostics size
+//             and text
+class CompileServer {
+public:
+    // Cache up to `cache_bytes` of compiled output, and serve connections
+    // on `threads` workers (zero means one per hardware thread)
+    explicit CompileServer(size_t cache_bytes = 64u << 20, size_t threads = 0);
+    ~CompileServer();
+
+    // Answer a request from the cache, or compile it and cache the result.
+    // Failed compiles are cached too. Thread safe, but callers other than
+    // the workers share one set of sessions and take turns.
+    std::shared_ptr<const CompileResponse> compile(const CompileRequest& request);
+
+    // Create the socket at `path`. A socket file left behind by a server
+    // that is gone is replaced, but anything else at `path` is an error.
+    // Throws std::runtime_error if the socket can't be set up.
+    void listen(const std::string& path);
+
+    // Serve connections on the socket from listen() until stop() is
+    // called, then remove it
+    void serve();
+
+    // listen(path), then serve()
+    void serve(const std::string& path);
+
+    // Make serve() return once the connections already accepted are served
+    void stop();
+
+    size_t cache_hits() const { return hits; }
+    size_t cache_misses() const { return misses; }
+    // Bytes of sources and compiled output in the cache
+    size_t cache_size() const;
+
+private:
+    struct Sessions;
+
+    struct CacheEntry {
+        std::string key;  // The request's flags byte followed by its source
+        std::shared_ptr<const CompileResponse> response;
+        size_t size;  // Bytes of `key` and of output in `response`
+    };
+
+    std::shared_ptr<const CompileResponse> compile_with(const CompileRequest& request, Sessions& sessions);
+    void serve_connections(Sessions& sessions);
+    void handle_connection(int fd, Sessions& sessions);
+
+    size_t capacity;  // In bytes
+    size_t size = 0;
+    mutable std::mutex cache_mutex;
+    std::list<CacheEntry> entries;  // Most recently used first
+    // Keyed by views of the entries' keys, so a hash collision can't answer
+    // a request with another source's output
+    std::unordered_map<std::string_view, std::list<CacheEntry>::iterator> cache;
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+
+    ThreadPool pool;
+    std::vector<std::unique_ptr<Sessions>> worker_sessions;  // Per pool worker
+    std::mutex caller_mutex;
+    std::unique_ptr<Sessions> caller_sessions;  // For compile() from outside the pool
+
+    int listener = -1;
+    std::string socket_path;
+    int wake_fds[2] = {-1, -1};  // Written by stop() to wake serve()
+    std::mutex queue_mutex;
+    std::condition_variable queue_changed;
+    std::deque<int> accepted;  // Connections waiting for a worker
+    bool stopping = false;
+};
+
+// Send one request to the server listening at `path` and wait for the
+// response. Throws std::runtime_error if the server can't be reached or
+// the connection fails.
+CompileResponse request_compile(const std::string& path, const CompileRequest& request);
+
+} // namespace nust
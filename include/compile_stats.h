@@ -0,0 +1,90 @@
+#pragma once
+
+#include "parser/parser.h"
+#include "instruction.h"
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace nust {
+
+struct AllocationCounts {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+// Allocation counting hook. The driver replaces the global operator new with
+// one that calls note_allocation; without it the counts stay at zero.
+void note_allocation(size_t size);
+AllocationCounts allocation_counts();
+
+// Peak resident set size of the process in bytes, or 0 where unknown
+size_t peak_rss();
+
+// Per-phase timings and program statistics, as reported by the driver's
+// --time-passes and --stats
+class CompileStats {
+public:
+    struct Phase {
+        std::string name;
+        double wall_ms;
+        double cpu_ms;
+        AllocationCounts allocations;  // Made during the phase
+    };
+
+    // Run `body` as the named phase and return its result. The phase is
+    // recorded even if `body` throws.
+    template <typename F>
+    auto measure(const std::string& name, F&& body) -> decltype(body()) {
+        PhaseTimer timer(*this, name);
+        return body();
+    }
+
+    // Count AST nodes by kind
+    void count_nodes(const Program& program);
+
+    // Count instructions by opcode
+    void count_instructions(const std::vector<Instruction>& instructions);
+
+    void set_function_count(size_t count) { functions = count; }
+    void set_string_constants(const std::vector<std::string>& constants);
+
+    const std::vector<Phase>& get_phases() const { return phases; }
+    const std::map<std::string, size_t>& get_node_counts() const { return nodes; }
+    const std::map<std::string, size_t>& get_opcode_counts() const { return opcodes; }
+
+    // Write the phase timings (`times`) and/or everything else (`stats`),
+    // either as text or as one JSON object
+    void write_text(std::ostream& out, bool times, bool stats) const;
+    void write_json(std::ostream& out, bool times, bool stats) const;
+
+private:
+    class PhaseTimer {
+    public:
+        PhaseTimer(CompileStats& stats, std::string name);
+        ~PhaseTimer();
+
+    private:
+        CompileStats& stats;
+        std::string name;
+        std::chrono::steady_clock::time_point wall_start;
+        std::clock_t cpu_start;
+        AllocationCounts allocations_start;
+    };
+
+    void count_node(const ASTNode* node);
+
+    std::vector<Phase> phases;
+    std::map<std::string, size_t> nodes;
+    std::map<std::string, size_t> opcodes;
+    size_t instructions = 0;
+    size_t functions = 0;
+    size_t string_constants = 0;
+    size_t string_bytes = 0;
+};
+
+} // namespace nust
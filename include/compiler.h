@@ -2,16 +2,39 @@
 
 #include "parser/parser.h"
 #include "instruction.h"
+#include "debug_info.h"
 #include "function_table.h"
+#include "inliner.h"
+#include "loop_analysis.h"
+#include "superinstructions.h"
 #include <vector>
 #include <unordered_map>
 #include <memory>
 
 namespace nust {
 
+// Optional optimization passes run after code generation
+struct CompilerOptions {
+    bool inline_functions = false;
+    InlinerOptions inliner;
+    bool tail_calls = false;  // Reuse the frame for calls in tail position
+    bool loop_optimizations = false;  // Hoist invariants and strength-reduce induction variables
+    bool superinstructions = false;  // Fuse frequent opcode sequences
+    
+    // All optimizations enabled, as selected by the driver's -O flag
+    static CompilerOptions optimized() {
+        CompilerOptions options;
+        options.inline_functions = true;
+        options.tail_calls = true;
+        options.loop_optimizations = true;
+        options.superinstructions = true;
+        return options;
+    }
+};
+
 class Compiler {
 public:
-    Compiler();
+    explicit Compiler(CompilerOptions options = CompilerOptions());
     
     // Compile a program AST to bytecode
     std::vector<Instruction> compile(const Program& program);
@@ -19,6 +42,18 @@ public:
     // Get the function table after compilation
     const FunctionTable& get_function_table() const { return function_table; }
     
+    // Get the string constant pool after compilation
+    const std::vector<std::string>& get_string_constants() const { return string_constants; }
+    
+    // Get the source span of each instruction after compilation
+    const SpanTable& get_span_table() const { return span_table; }
+    
+    // Move the function table, string constants and span table out after
+    // compilation. The compiler is left ready for the next compile.
+    FunctionTable take_function_table() { return std::move(function_table); }
+    std::vector<std::string> take_string_constants() { return std::move(string_constants); }
+    SpanTable take_span_table() { return std::move(span_table); }
+    
 private:
     // Function compilation
     void compile_function(const FunctionDecl* func);
@@ -29,16 +64,28 @@ private:
     // Control flow
     void compile_if(const IfStmt* stmt);
     void compile_while(const WhileStmt* stmt);
+    
+    // Emit a preheader for the loop that computes its invariant expressions and
+    // the initial values of derived induction variables into fresh slots
+    void compile_loop_preheader(const LoopAnalysis& analysis);
+    void compile_induction_steps(const BinaryExpr* update);
     void compile_block(const BlockStmt* block);
     
+    // Emit a branch taken when `expr` evaluates to `jump_if`, falling through
+    // otherwise. Jump sites are appended to `jumps` for the caller to patch.
+    void compile_condition(const Expr* expr, bool jump_if, std::vector<size_t>& jumps);
+    void patch_jumps(const std::vector<size_t>& jumps, size_t target);
+    
     // Variable management
     void compile_let(const LetStmt* stmt);
     void compile_identifier(const Identifier* ident);
     
     // Expression compilation
     void compile_binary(const BinaryExpr* expr);
+    void compile_logical(const BinaryExpr* expr);
     void compile_unary(const UnaryExpr* expr);
     void compile_call(const CallExpr* expr);
+    void compile_tail_call(const CallExpr* expr, const FunctionDecl* func, size_t func_start);
     void compile_borrow(const BorrowExpr* expr);
     
     // Helper functions
@@ -47,10 +94,40 @@ private:
     size_t add_constant(const std::string& str);
     size_t get_local_index(const std::string& name);
     
+    // Carry instruction spans over a pass, given the instruction each
+    // rewritten instruction came from
+    void remap_spans(const std::vector<size_t>& origins);
+    
+    // Scope management
+    void enter_scope();
+    void exit_scope();
+    size_t declare_local(const std::string& name);
+    size_t declare_temp();
+    
+    // Slot allocation: every binding gets a virtual slot during codegen, then
+    // slots whose live intervals don't overlap are merged into one frame slot
+    size_t allocate_local_slots(size_t func_start, size_t num_params);
+    
     // State
+    CompilerOptions options;
     std::vector<Instruction> instructions;
+    std::vector<Span> instruction_spans;  // Parallel to instructions
+    Span current_span{0, 0};              // Of the node being compiled
+    SpanTable span_table;
     std::vector<std::string> string_constants;
-    std::unordered_map<std::string, size_t> local_vars;
+    std::unordered_map<std::string, size_t> string_constant_indices;
+    std::vector<std::unordered_map<std::string, size_t>> local_scopes;
+    std::vector<bool> borrowed_locals;  // Virtual slots whose address is taken
+    
+    // Loop optimization state: expressions replaced by a load of a slot, and
+    // the running products to bump after each induction variable update
+    struct InductionStep {
+        size_t slot;
+        const Expr* factor;
+    };
+    std::unordered_map<const Expr*, size_t> hoisted_exprs;
+    std::unordered_map<const BinaryExpr*, std::vector<InductionStep>> induction_steps;
+    std::vector<CountedLoop> counted_loops;  // Absolute pcs until the function is done
     size_t next_local_index;
     FunctionTable function_table;
 };
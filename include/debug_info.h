@@ -0,0 +1,84 @@
+#pragma once
+
+#include "parser/parser.h"
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace nust {
+
+struct SourceLocation {
+    size_t line;    // 1-based
+    size_t column;  // 1-based, in bytes
+};
+
+// Offsets at which each line of a source file starts, so that a byte offset
+// resolves to a line and column with a binary search
+class LineIndex {
+public:
+    explicit LineIndex(const std::string& source);
+
+    SourceLocation locate(size_t offset) const;
+    size_t line_count() const { return line_starts.size(); }
+
+private:
+    std::vector<size_t> line_starts;
+};
+
+// The source span each instruction was compiled from. Consecutive
+// instructions with the same span form a run, and each run is encoded as
+// three unsigned LEB128 numbers: the pc distance from the previous run, the
+// distance of its start offset from the previous run's (zigzag-encoded, as
+// it can go backwards), and its length. A final pc distance marks the end of
+// the last run. The runs are only decoded when the first lookup is made.
+class SpanTable {
+public:
+    SpanTable() = default;
+    explicit SpanTable(std::vector<uint8_t> encoded) : bytes(std::move(encoded)) {}
+
+    // Encode a table with one span per instruction
+    static SpanTable build(const std::vector<Span>& spans);
+
+    // The span of the instruction at `pc`, if the table covers it
+    std::optional<Span> find(size_t pc) const;
+
+    bool empty() const { return bytes.empty(); }
+    const std::vector<uint8_t>& encoded() const { return bytes; }
+
+    // The table as an optional section at the end of a .no file: the encoded
+    // runs, their size as a 32-bit little-endian word, then SECTION_MAGIC
+    void write_section(std::ostream& out) const;
+
+    // Read the section from the end of a .no file, leaving the stream
+    // position where it was. Returns an empty table if there is none.
+    static SpanTable read_section(std::istream& in);
+
+    static constexpr char SECTION_MAGIC[4] = {'N', 'S', 'P', 'N'};
+
+private:
+    struct Run {
+        size_t pc;  // First instruction of the run
+        size_t start;
+        size_t end;
+    };
+
+    void decode() const;
+
+    std::vector<uint8_t> bytes;
+    mutable std::vector<Run> runs;  // Decoded on demand
+    mutable size_t end_pc = 0;      // One past the last instruction covered
+    mutable bool decoded = false;
+};
+
+// Resolves instructions to the line and column of the source they came from
+struct SourceMap {
+    SpanTable spans;
+    LineIndex lines;
+
+    std::optional<SourceLocation> locate(size_t pc) const;
+};
+
+} // namespace nust
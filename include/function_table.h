@@ -7,6 +7,16 @@
 
 namespace nust {
 
+// A while loop of the form `while i < bound { ...; i = i + step; }` with a
+// loop-invariant bound, which later passes or the VM may specialize
+struct CountedLoop {
+    size_t header;     // Condition, relative to the entry point
+    size_t exit;       // First instruction after the loop, relative to the entry point
+    size_t counter;    // Local slot of the induction variable
+    int32_t step;      // Amount added to the counter per iteration
+    bool inclusive;    // Whether the bound is compared with <= rather than <
+};
+
 struct FunctionInfo {
     size_t entry_point;      // Instruction pointer where function starts
     size_t num_params;       // Number of parameters
@@ -14,6 +24,7 @@ struct FunctionInfo {
     std::unique_ptr<Type> return_type;  // Function's return type
     std::vector<std::unique_ptr<Type>> param_types;  // Types of parameters
     std::string name;        // Function name for debugging
+    std::vector<CountedLoop> counted_loops;
 };
 
 class FunctionTable {
@@ -25,6 +36,7 @@ public:
     
     // Get function info by index
     const FunctionInfo& get_function(size_t index) const;
+    FunctionInfo& get_function(size_t index);
     
     // Get function index by name
     size_t get_function_index(const std::string& name) const;
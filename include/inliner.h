@@ -0,0 +1,47 @@
+#pragma once
+
+#include "instruction.h"
+#include "function_table.h"
+#include <vector>
+
+namespace nust {
+
+struct InlinerOptions {
+    size_t threshold = 16;  // Maximum estimated cost of a callee to inline it
+    size_t max_depth = 3;   // Maximum nesting of inlined calls within one caller
+};
+
+// Splices the bodies of small callees into their callers at the bytecode
+// level. A callee's cost is its body size minus the return it drops, plus
+// one STORE per parameter that moves the arguments into its (remapped) slots.
+class Inliner {
+public:
+    explicit Inliner(InlinerOptions options = InlinerOptions());
+    
+    // Inline calls across the whole program, updating entry points and frame
+    // sizes in the function table. `origins`, if given, receives the original
+    // index of each instruction; code added around an inlined body maps to
+    // the call or return it replaces.
+    void run(std::vector<Instruction>& instructions, FunctionTable& function_table,
+             std::vector<size_t>* origins = nullptr);
+    
+private:
+    size_t cost(size_t func) const;
+    bool should_inline(size_t callee) const;
+    
+    // Expand a function body, inlining eligible calls. Locals are shifted by
+    // `base`. Inlined bodies drop their final return so that control falls
+    // through to the caller's continuation with the result on the stack.
+    // `origins` receives the original index of each expanded instruction, and
+    // `positions`, if given, the new offset of each original instruction.
+    std::vector<Instruction> expand(size_t func, size_t base, bool inlined, size_t& frame_size,
+                                    std::vector<size_t>& origins, std::vector<size_t>* positions = nullptr);
+    
+    InlinerOptions options;
+    const FunctionTable* table = nullptr;
+    std::vector<std::vector<Instruction>> bodies;  // Jump targets relative to the entry point
+    std::vector<size_t> body_starts;               // Original entry points
+    std::vector<size_t> inline_stack;              // Functions being expanded
+};
+
+} // namespace nust
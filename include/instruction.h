@@ -20,7 +20,7 @@ enum class Opcode : uint8_t {
     LOAD,       // Load local variable onto stack
     STORE,      // Store top of stack into local variable
     LOAD_REF,   // Load reference to local variable
-    STORE_REF,  // Store reference to local variable
+    STORE_REF,  // Store value through reference
     
     // Arithmetic operations
     ADD_I32,    // Add two integers
@@ -47,14 +47,22 @@ enum class Opcode : uint8_t {
     JMP_IF,     // Jump if top of stack is true
     JMP_IF_NOT, // Jump if top of stack is false
     CALL,       // Call function
+    TAIL_CALL,  // Call function, reusing the current frame
     RET,        // Return from function (no value)
     RET_VAL,    // Return from function with value
     
     // Reference operations
-    BORROW,     // Create immutable reference
-    BORROW_MUT, // Create mutable reference
+    BORROW,     // Move top of stack into a local and load an immutable reference to it
+    BORROW_MUT, // Move top of stack into a local and load a mutable reference to it
     DEREF,      // Dereference reference
-    DEREF_MUT   // Dereference mutable reference
+    DEREF_MUT,  // Dereference mutable reference
+    
+    // Superinstructions (fused sequences, see SuperinstructionSelector)
+    ADD_LL,        // Push the sum of two locals
+    ADD_LI,        // Push the sum of a local and a constant
+    INC_LOCAL,     // Add a constant to a local in place
+    LT_LL_JMPNOT,  // Jump unless one local is less than another
+    LT_LI_JMPNOT   // Jump unless a local is less than a constant
 };
 
 // Convert opcode to string representation
@@ -99,6 +107,7 @@ inline std::string opcode_to_string(Opcode opcode) {
         case Opcode::JMP_IF:    return "JMP_IF";
         case Opcode::JMP_IF_NOT: return "JMP_IF_NOT";
         case Opcode::CALL:      return "CALL";
+        case Opcode::TAIL_CALL: return "TAIL_CALL";
         case Opcode::RET:       return "RET";
         case Opcode::RET_VAL:   return "RET_VAL";
         
@@ -108,6 +117,13 @@ inline std::string opcode_to_string(Opcode opcode) {
         case Opcode::DEREF:     return "DEREF";
         case Opcode::DEREF_MUT: return "DEREF_MUT";
         
+        // Superinstructions
+        case Opcode::ADD_LL:    return "ADD_LL";
+        case Opcode::ADD_LI:    return "ADD_LI";
+        case Opcode::INC_LOCAL: return "INC_LOCAL";
+        case Opcode::LT_LL_JMPNOT: return "LT_LL_JMPNOT";
+        case Opcode::LT_LI_JMPNOT: return "LT_LI_JMPNOT";
+        
         default:
             return "UNKNOWN_OPCODE";
     }
@@ -117,9 +133,13 @@ inline std::string opcode_to_string(Opcode opcode) {
 struct Instruction {
     Opcode opcode;
     size_t operand;  // Optional operand (e.g., constant index, local variable index, jump offset)
+    uint32_t arg1;   // Extra operands of superinstructions (local slots and i32 constants)
+    uint32_t arg2;
     
-    Instruction(Opcode opcode) : opcode(opcode), operand(0) {}
-    Instruction(Opcode opcode, size_t operand) : opcode(opcode), operand(operand) {}
+    Instruction(Opcode opcode) : opcode(opcode), operand(0), arg1(0), arg2(0) {}
+    Instruction(Opcode opcode, size_t operand) : opcode(opcode), operand(operand), arg1(0), arg2(0) {}
+    Instruction(Opcode opcode, size_t operand, uint32_t arg1, uint32_t arg2 = 0)
+        : opcode(opcode), operand(operand), arg1(arg1), arg2(arg2) {}
     
     // Helper to determine if this instruction type has an operand
     bool has_operand() const {
@@ -130,15 +150,52 @@ struct Instruction {
             case Opcode::LOAD:
             case Opcode::STORE:
             case Opcode::LOAD_REF:
+            case Opcode::BORROW:
+            case Opcode::BORROW_MUT:
             case Opcode::JMP:
             case Opcode::JMP_IF:
             case Opcode::JMP_IF_NOT:
             case Opcode::CALL:
+            case Opcode::TAIL_CALL:
+            case Opcode::ADD_LL:
+            case Opcode::ADD_LI:
+            case Opcode::INC_LOCAL:
+            case Opcode::LT_LL_JMPNOT:
+            case Opcode::LT_LI_JMPNOT:
                 return true;
             default:
                 return false;
         }
     }
+    
+    // Helper to determine how many of arg1 and arg2 this instruction uses
+    size_t num_args() const {
+        switch (opcode) {
+            case Opcode::ADD_LL:
+            case Opcode::ADD_LI:
+            case Opcode::INC_LOCAL:
+                return 1;
+            case Opcode::LT_LL_JMPNOT:
+            case Opcode::LT_LI_JMPNOT:
+                return 2;
+            default:
+                return 0;
+        }
+    }
+    
+    // Helper to determine if the operand is an absolute jump target
+    bool is_jump() const {
+        return opcode == Opcode::JMP || opcode == Opcode::JMP_IF ||
+               opcode == Opcode::JMP_IF_NOT || opcode == Opcode::LT_LL_JMPNOT ||
+               opcode == Opcode::LT_LI_JMPNOT;
+    }
+    
+    // Helper to determine if the operand is a local variable slot
+    bool is_local_access() const {
+        return opcode == Opcode::LOAD || opcode == Opcode::STORE ||
+               opcode == Opcode::LOAD_REF || opcode == Opcode::BORROW ||
+               opcode == Opcode::BORROW_MUT;
+    }
 };
 
 } // namespace nust 
\ No newline at end of file
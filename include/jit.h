@@ -0,0 +1,95 @@
+#pragma once
+
+#include "instruction.h"
+#include "function_table.h"
+#include "verifier.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define NUST_JIT_SUPPORTED 1
+#else
+#define NUST_JIT_SUPPORTED 0
+#endif
+
+namespace nust {
+
+struct JitOptions {
+    bool enabled = false;
+    size_t threshold = 1000;  // Calls plus loop back edges before a function is compiled
+};
+
+// Type of a value held in a native slot, which is always an int32_t
+enum class NativeType : uint8_t {
+    Int,
+    Bool
+};
+
+// A point where compiled code hands control back to the VM
+struct JitExit {
+    bool returns;  // The function returned, with its result in slot 0
+    size_t pc;     // Instruction the interpreter resumes at
+    std::vector<NativeType> types;  // Types of the locals then the stack values, or of the result
+};
+
+// Machine code for one function. Entry points take the function's frame as
+// an array of native slots (locals, then stack values) and return the index
+// of the exit they left through, after writing the frame back.
+class JitFunction {
+public:
+    using Entry = uint32_t (*)(int32_t* slots);
+
+    JitFunction(const JitFunction&) = delete;
+    JitFunction& operator=(const JitFunction&) = delete;
+    ~JitFunction();
+
+    // Entry point for an interpreter at `pc`, or nullptr if compiled code can't start there
+    Entry entry(size_t pc) const;
+
+    const JitExit& exit(uint32_t index) const { return exits[index]; }
+
+    // Number of native slots the frame needs
+    size_t frame_size() const { return num_slots; }
+
+private:
+    friend class JitCompiler;
+    JitFunction() = default;
+
+    void* code = nullptr;
+    size_t code_size = 0;
+    size_t num_slots = 0;
+    std::unordered_map<size_t, size_t> entries;  // pc to code offset
+    std::vector<JitExit> exits;
+};
+
+// Baseline compiler from stack bytecode to x86-64.
+//
+// Each opcode is a fixed machine code template. BytecodeVerifier gives the
+// stack depth and the type of every value at each instruction, so locals
+// and stack positions are mapped to fixed homes: the most used locals and
+// the lowest stack positions live in registers, the rest in the frame. A comparison followed by a
+// conditional jump becomes a cmp/jcc pair.
+//
+// Only i32 and bool functions are compiled. Calls and division by zero leave
+// compiled code through an exit that writes the frame back so the
+// interpreter can carry on at that instruction; loop headers are entry
+// points for coming back in.
+class JitCompiler {
+public:
+    JitCompiler(const std::vector<Instruction>& instructions, const FunctionTable& function_table);
+
+    // Whether this platform can run compiled code
+    static bool supported() { return NUST_JIT_SUPPORTED; }
+
+    // Compile a function, or return nullptr if it uses values compiled code
+    // can't represent or the platform is unsupported
+    std::unique_ptr<JitFunction> compile(size_t func_index) const;
+
+private:
+    const std::vector<Instruction>& instructions;
+    BytecodeVerifier verifier;
+};
+
+} // namespace nust
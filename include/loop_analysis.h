@@ -0,0 +1,68 @@
+#pragma once
+
+#include "parser/parser.h"
+#include <unordered_set>
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+namespace nust {
+
+// Analyzes a while loop for loop-invariant expressions and induction
+// variables. Variables count as modified in the loop if they are assigned,
+// declared (which may shadow an outer binding) or mutably borrowed anywhere in
+// its condition or body.
+class LoopAnalysis {
+public:
+    // A product `i * k` of a basic induction variable and a loop-invariant
+    // literal or variable. Every occurrence with the same operands shares one
+    // running value that is bumped whenever `i` is.
+    struct DerivedInduction {
+        std::string variable;
+        const Expr* factor;
+        std::vector<const BinaryExpr*> uses;
+    };
+    
+    explicit LoopAnalysis(const WhileStmt& loop);
+    
+    // Maximal non-trivial expressions whose value is the same on every
+    // iteration and that are safe to evaluate before the loop
+    const std::vector<const Expr*>& invariant_exprs() const { return invariants; }
+    
+    // Basic induction variables, which are only ever updated by `i = i + c` or
+    // `i = i - c` for an integer literal c, mapped to those updates
+    const std::unordered_map<std::string, std::vector<const BinaryExpr*>>&
+    induction_variables() const { return induction; }
+    
+    const std::vector<DerivedInduction>& derived_inductions() const { return derived; }
+    
+    // Whether the loop is `while i < bound` or `while i <= bound` with a
+    // loop-invariant bound and a single `i = i + c` update with c > 0
+    bool is_counted() const { return counted; }
+    
+    bool is_invariant(const Expr& expr) const;
+    
+    // The signed amount an induction update adds to its variable
+    static int step_of(const BinaryExpr& update);
+    
+private:
+    void collect(const Stmt& stmt);
+    void collect(const Expr& expr);
+    void find_invariants(const Stmt& stmt);
+    void find_invariants(const Expr& expr);
+    void find_induction(const Stmt& stmt);
+    void find_induction(const Expr& expr);
+    bool is_modified(const std::string& name) const;
+    
+    std::unordered_set<std::string> assigned;
+    std::unordered_set<std::string> declared;
+    std::unordered_set<std::string> borrowed;
+    std::unordered_map<std::string, std::vector<const BinaryExpr*>> assignments;
+    
+    std::vector<const Expr*> invariants;
+    std::unordered_map<std::string, std::vector<const BinaryExpr*>> induction;
+    std::vector<DerivedInduction> derived;
+    bool counted = false;
+};
+
+} // namespace nust
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 #include <optional>
@@ -248,7 +249,9 @@ public:
 
 class Parser {
 public:
-    Parser(std::string source);
+    // The parser reads `source` in place, so it must stay alive until
+    // parse() returns. The AST keeps its own copies of names and literals.
+    Parser(std::string_view source);
     std::unique_ptr<Program> parse();
 
 private:
@@ -264,6 +267,7 @@ private:
     void error(const std::string& message);
     void synchronize();
     Span make_span(size_t start) const { return Span(start, pos); }
+    char current() const { return pos < source.length() ? source[pos] : '\0'; }
     
     // Scope management
     std::shared_ptr<Scope> current_scope;
@@ -291,7 +295,7 @@ private:
     std::unique_ptr<Expr> parse_and();
     std::unique_ptr<Expr> parse_assignment();
     
-    std::string source;
+    std::string_view source;
     size_t pos = 0;
 };
 
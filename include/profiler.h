@@ -0,0 +1,103 @@
+#pragma once
+
+#include "instruction.h"
+#include "function_table.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Builds with NUST_PROFILE set (make PROFILE=1) call the profiler from the
+// interpreter loops; in other builds the hooks compile to nothing
+#ifndef NUST_PROFILE
+#define NUST_PROFILE 0
+#endif
+
+namespace nust {
+
+constexpr size_t NUM_OPCODES = static_cast<size_t>(Opcode::LT_LI_JMPNOT) + 1;
+
+// The CPU timestamp counter, or a steady clock where there isn't one
+inline uint64_t read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Counts the opcodes an interpreter executes, the cycles spent in each, and
+// how often each opcode follows another. An instruction is charged the time
+// from its step() to the next step() or stop(), so that includes dispatch.
+class OpcodeProfiler {
+public:
+    static constexpr size_t NUM_BUCKETS = 32;  // Bucket i holds times in [2^i, 2^(i+1)) cycles
+
+    struct OpcodeStats {
+        uint64_t count = 0;
+        uint64_t cycles = 0;
+        std::array<uint64_t, NUM_BUCKETS> histogram{};
+    };
+
+    OpcodeProfiler();
+
+    // Start an instruction of function `func_index`, ending the one before
+    void step(Opcode opcode, size_t func_index) {
+        uint64_t now = read_cycles();
+        size_t index = static_cast<size_t>(opcode);
+        if (running) {
+            charge(now);
+            ++transitions[previous * NUM_OPCODES + index];
+        }
+        ++opcodes[index].count;
+        if (func_index >= functions.size()) {
+            functions.resize(func_index + 1, 0);
+        }
+        ++functions[func_index];
+        previous = index;
+        started = now;
+        running = true;
+    }
+
+    // End the instruction in progress when the interpreter returns
+    void stop() {
+        if (running) {
+            charge(read_cycles());
+            running = false;
+        }
+    }
+
+    // Drop the instruction in progress without charging it, as after an
+    // exception, so the next run doesn't pick up the time in between
+    void cancel() { running = false; }
+
+    void reset();
+
+    const OpcodeStats& stats(Opcode opcode) const { return opcodes[static_cast<size_t>(opcode)]; }
+    uint64_t transition_count(Opcode from, Opcode to) const {
+        return transitions[static_cast<size_t>(from) * NUM_OPCODES + static_cast<size_t>(to)];
+    }
+    // Instructions executed in each function, by function index
+    const std::vector<uint64_t>& function_counts() const { return functions; }
+
+    // Write everything recorded, naming functions from `function_table`
+    void write_json(std::ostream& out, const FunctionTable& function_table) const;
+    void write_table(std::ostream& out, const FunctionTable& function_table, size_t top = 20) const;
+
+private:
+    void charge(uint64_t now);
+
+    std::array<OpcodeStats, NUM_OPCODES> opcodes;
+    std::vector<uint64_t> transitions;  // NUM_OPCODES x NUM_OPCODES, from-major
+    std::vector<uint64_t> functions;
+    size_t previous = 0;
+    uint64_t started = 0;
+    bool running = false;
+};
+
+} // namespace nust
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "value.h"
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace nust {
+
+// Opcodes of the three-address register machine, an alternative to the stack
+// machine's Opcode set. Operands address frame registers directly, so
+// `x + y` is a single ADD_I32 instead of LOAD, LOAD, ADD_I32.
+enum class RegOpcode : uint8_t {
+    // Data movement
+    MOVE,       // a = rk(b)
+    
+    // Arithmetic operations (a = rk(b) op rk(c))
+    ADD_I32,
+    SUB_I32,
+    MUL_I32,
+    DIV_I32,
+    NEG_I32,    // a = -rk(b)
+    
+    // Comparison operations (a = rk(b) op rk(c))
+    EQ_I32,
+    NE_I32,
+    LT_I32,
+    GT_I32,
+    LE_I32,
+    GE_I32,
+    
+    // Logical operations
+    AND,        // a = rk(b) && rk(c)
+    OR,         // a = rk(b) || rk(c)
+    NOT,        // a = !rk(b)
+    
+    // Control flow
+    JMP,        // Jump to a
+    JMP_IF,     // Jump to a if rk(b) is true
+    JMP_IF_NOT, // Jump to a if rk(b) is false
+    CALL,       // Call function a with arguments in registers b..b+n-1 (last
+                // argument first, as they were pushed); the result goes to b
+    TAIL_CALL,  // Call function a with arguments at b, reusing the current frame
+    RET,        // Return the unit value
+    RET_VAL,    // Return rk(a)
+    
+    // Reference operations
+    LOAD_REF,   // a = reference to register b
+    STORE_REF,  // *rk(a) = rk(b)
+    DEREF       // a = *rk(b)
+};
+
+// Convert register opcode to string representation
+inline std::string reg_opcode_to_string(RegOpcode opcode) {
+    switch (opcode) {
+        case RegOpcode::MOVE:       return "MOVE";
+        case RegOpcode::ADD_I32:    return "ADD_I32";
+        case RegOpcode::SUB_I32:    return "SUB_I32";
+        case RegOpcode::MUL_I32:    return "MUL_I32";
+        case RegOpcode::DIV_I32:    return "DIV_I32";
+        case RegOpcode::NEG_I32:    return "NEG_I32";
+        case RegOpcode::EQ_I32:     return "EQ_I32";
+        case RegOpcode::NE_I32:     return "NE_I32";
+        case RegOpcode::LT_I32:     return "LT_I32";
+        case RegOpcode::GT_I32:     return "GT_I32";
+        case RegOpcode::LE_I32:     return "LE_I32";
+        case RegOpcode::GE_I32:     return "GE_I32";
+        case RegOpcode::AND:        return "AND";
+        case RegOpcode::OR:         return "OR";
+        case RegOpcode::NOT:        return "NOT";
+        case RegOpcode::JMP:        return "JMP";
+        case RegOpcode::JMP_IF:     return "JMP_IF";
+        case RegOpcode::JMP_IF_NOT: return "JMP_IF_NOT";
+        case RegOpcode::CALL:       return "CALL";
+        case RegOpcode::TAIL_CALL:  return "TAIL_CALL";
+        case RegOpcode::RET:        return "RET";
+        case RegOpcode::RET_VAL:    return "RET_VAL";
+        case RegOpcode::LOAD_REF:   return "LOAD_REF";
+        case RegOpcode::STORE_REF:  return "STORE_REF";
+        case RegOpcode::DEREF:      return "DEREF";
+        default:
+            return "UNKNOWN_OPCODE";
+    }
+}
+
+// Source operands marked with this bit name an entry of the constant pool
+// rather than a register
+constexpr uint32_t REG_CONSTANT = 0x80000000u;
+
+// Register machine instruction
+struct RegInstruction {
+    RegOpcode opcode;
+    uint32_t a;  // Destination register, jump target, function index or returned operand
+    uint32_t b;  // First source operand
+    uint32_t c;  // Second source operand
+    
+    RegInstruction(RegOpcode opcode, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0)
+        : opcode(opcode), a(a), b(b), c(c) {}
+    
+    // Helper to determine how many of a, b and c this instruction uses
+    size_t num_operands() const {
+        switch (opcode) {
+            case RegOpcode::RET:
+                return 0;
+            case RegOpcode::JMP:
+            case RegOpcode::RET_VAL:
+                return 1;
+            case RegOpcode::MOVE:
+            case RegOpcode::NEG_I32:
+            case RegOpcode::NOT:
+            case RegOpcode::JMP_IF:
+            case RegOpcode::JMP_IF_NOT:
+            case RegOpcode::CALL:
+            case RegOpcode::TAIL_CALL:
+            case RegOpcode::LOAD_REF:
+            case RegOpcode::STORE_REF:
+            case RegOpcode::DEREF:
+                return 2;
+            default:
+                return 3;
+        }
+    }
+    
+    // Helper to determine if a is a jump target
+    bool is_jump() const {
+        return opcode == RegOpcode::JMP || opcode == RegOpcode::JMP_IF ||
+               opcode == RegOpcode::JMP_IF_NOT;
+    }
+};
+
+struct RegFunction {
+    std::string name;
+    size_t entry_point;
+    size_t num_params;     // Parameters arrive in registers 0..num_params-1
+    size_t num_registers;  // Locals, then temporaries
+};
+
+// A translated program: code for every function, the function table entries
+// it needs and the pool of constants referenced with REG_CONSTANT
+struct RegisterProgram {
+    std::vector<RegInstruction> code;
+    std::vector<RegFunction> functions;
+    std::vector<Value> constants;
+    
+    // Get function index by name
+    size_t get_function_index(const std::string& name) const {
+        for (size_t i = 0; i < functions.size(); ++i) {
+            if (functions[i].name == name) {
+                return i;
+            }
+        }
+        throw std::runtime_error("Function not found: " + name);
+    }
+};
+
+} // namespace nust
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "instruction.h"
+#include "function_table.h"
+#include "register_code.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nust {
+
+// Translates stack bytecode into the register ISA.
+//
+// Each function gets registers for its local slots followed by one register
+// per stack position. The translator tracks what every stack position holds
+// (a register or a constant) and only emits an instruction when a value is
+// actually computed, so loads and pushes disappear into operands:
+//
+//   LOAD 0; LOAD 1; ADD_I32; STORE 2  =>  ADD_I32 2, 0, 1
+//
+// Stack positions are written to their own registers before every jump and
+// jump target, so all paths agree on where values live.
+class RegisterTranslator {
+public:
+    RegisterProgram translate(const std::vector<Instruction>& instructions,
+                              const FunctionTable& function_table,
+                              const std::vector<std::string>& string_constants);
+    
+private:
+    void translate_function(const std::vector<Instruction>& instructions, size_t start, size_t end,
+                            RegFunction& function);
+    
+    // Compute the stack depth before each instruction of [start, end), or -1
+    // where the code is unreachable
+    std::vector<int> stack_depths(const std::vector<Instruction>& instructions,
+                                  size_t start, size_t end) const;
+    
+    // Register of a stack position
+    uint32_t temp(size_t position) const { return static_cast<uint32_t>(temp_base + position); }
+    
+    uint32_t constant(const Value& value);
+    void emit(RegInstruction instr, bool writes_temp = false);
+    
+    // Write every stack position into its own register
+    void flush();
+    // Copy stack positions that still refer to `reg` before it is overwritten
+    void detach(uint32_t reg);
+    // Push the result of an instruction computed into the next stack position
+    void push_result(RegOpcode opcode, uint32_t b, uint32_t c = 0);
+    uint32_t pop();
+    
+    const FunctionTable* table = nullptr;
+    const std::vector<std::string>* strings = nullptr;
+    RegisterProgram program;
+    std::unordered_map<int32_t, uint32_t> int_constants;
+    std::unordered_map<std::string, uint32_t> string_constant_indices;
+    uint32_t bool_constants[2];
+    
+    size_t temp_base = 0;
+    size_t max_temps = 0;
+    std::vector<uint32_t> stack;  // What each stack position currently holds
+    size_t fresh_result = SIZE_MAX;  // Instruction that last computed a value into a temp
+};
+
+// Write the translated program as assembly, as in a .nr file: a comment
+// line per function giving its entry point and register count, then one
+// instruction per line with constants written as #value
+void write_register_code(std::ostream& out, const RegisterProgram& program);
+
+} // namespace nust
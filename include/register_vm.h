@@ -0,0 +1,43 @@
+#pragma once
+
+#include "register_code.h"
+#include "value.h"
+#include <vector>
+#include <string>
+
+namespace nust {
+
+// Interpreter for the register ISA produced by RegisterTranslator
+class RegisterVM {
+public:
+    explicit RegisterVM(RegisterProgram program);
+    
+    // Call a function by name and run it to completion
+    Value call(const std::string& name, const std::vector<Value>& args = {});
+    
+private:
+    struct Frame {
+        size_t return_pc;  // Instruction to resume at in the caller
+        size_t base;       // Index of register 0
+        size_t result;     // Caller register that receives the return value
+    };
+    
+    Value run(size_t pc);
+    
+    // Copy the arguments at `args` (last argument first) into the parameters
+    // of a frame at `base` and size the register file for the callee
+    size_t enter_function(size_t func_index, size_t base, size_t args);
+    
+    // Read a register or constant operand of the current frame
+    const Value& operand(size_t base, uint32_t operand) const {
+        return (operand & REG_CONSTANT) ? program.constants[operand & ~REG_CONSTANT]
+                                        : registers[base + operand];
+    }
+    
+    RegisterProgram program;
+    std::vector<Value> registers;
+    std::vector<Frame> frames;
+    std::vector<Value> scratch;  // Tail call arguments on their way to the parameters
+};
+
+} // namespace nust
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "debug_info.h"
+#include "function_table.h"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <vector>
+
+#if defined(__linux__)
+#define NUST_SAMPLING_SUPPORTED 1
+#else
+#define NUST_SAMPLING_SUPPORTED 0
+#endif
+
+namespace nust {
+
+// Statistical profiler for the VM. A CPU time timer raises SIGPROF at a fixed
+// rate, and the handler does nothing but set a flag. The VM checks the flag
+// at calls and loop back edges and records its call stack there, so the
+// stack is never read while it is being changed. Samples go through a
+// single-producer ring buffer and are folded into counts per distinct stack,
+// written out in the folded format flamegraph tools read.
+//
+// Only one profiler can be running in a process at a time.
+class SamplingProfiler {
+public:
+    static constexpr size_t MAX_DEPTH = 64;  // Deeper stacks keep their innermost frames
+
+    explicit SamplingProfiler(unsigned frequency = 1000);  // Samples per second of CPU time
+    ~SamplingProfiler();
+
+    SamplingProfiler(const SamplingProfiler&) = delete;
+    SamplingProfiler& operator=(const SamplingProfiler&) = delete;
+
+    // Whether this platform has the timer and signal the profiler needs
+    static bool supported() { return NUST_SAMPLING_SUPPORTED; }
+
+    // Arm and disarm the timer. start() throws if another profiler is running.
+    void start();
+    void stop();
+
+    // Whether the timer has fired since the last sample
+    bool sample_pending() const { return pending.load(std::memory_order_relaxed); }
+
+    // Record a call stack of function indices, outermost first, with the
+    // innermost function at instruction `pc`
+    void record(const uint32_t* functions, size_t depth, size_t pc);
+
+    // Number of samples recorded
+    uint64_t sample_count() const;
+
+    // Write one line per distinct stack: function names separated by ';' and
+    // the number of samples. With `pcs` the innermost frame is followed by a
+    // "pc N" frame, splitting each function by instruction, or by a
+    // "line:column" frame when a source map is given.
+    void write_folded(std::ostream& out, const FunctionTable& function_table, bool pcs = false,
+                      const SourceMap* source = nullptr) const;
+
+private:
+    struct Sample {
+        uint32_t depth;
+        uint32_t pc;
+        bool truncated;
+        uint32_t functions[MAX_DEPTH];
+    };
+
+    static void handle_signal(int);
+
+    // Fold buffered samples into the stack counts
+    void drain() const;
+
+    unsigned frequency;
+    std::atomic<bool> pending{false};
+    bool running = false;
+    void* timer = nullptr;
+
+    std::vector<Sample> ring;  // Power of two capacity
+    std::atomic<size_t> head{0};  // Written by the recording thread
+    mutable std::atomic<size_t> tail{0};  // Advanced as samples are folded
+    // Functions outermost first, then the pc, with UINT32_MAX first if truncated
+    mutable std::map<std::vector<uint32_t>, uint64_t> stacks;
+};
+
+} // namespace nust
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "compiler.h"
+#include "type_checker.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nust {
+
+// A compiled program, owned independently of the session that compiled it.
+// VM and RegisterTranslator take its parts directly.
+struct Module {
+    std::vector<Instruction> instructions;
+    FunctionTable function_table;
+    std::vector<std::string> string_constants;
+    SpanTable span_table;
+};
+
+// Compiles sources in memory, for embedding the compiler in a long-running
+// process. A session keeps one type checker and one compiler and reuses
+// them, with their scratch buffers, for every compile instead of creating
+// new ones each time.
+//
+// A session is not thread safe, but sessions share no mutable state, so
+// each thread can use its own.
+class Session {
+public:
+    explicit Session(CompilerOptions options = CompilerOptions());
+
+    // Parse, type check and compile `source`. Throws std::runtime_error on a
+    // parse error, or with every type error, one per line, if the program
+    // does not type check. Nothing is printed.
+    Module compile(std::string_view source);
+
+    // Number of sources compiled successfully
+    size_t compiled() const { return count; }
+
+private:
+    TypeChecker type_checker;
+    Compiler compiler;
+    size_t count = 0;
+};
+
+} // namespace nust
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace nust {
+
+// The contents of a source file. Regular files are mapped into memory
+// read-only, so loading one doesn't copy it; other files, and platforms
+// without mmap, are read into a string instead.
+class SourceFile {
+public:
+    // Throws std::runtime_error if the file can't be opened or read
+    explicit SourceFile(const std::string& path);
+    ~SourceFile();
+
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    // Valid as long as this object is
+    std::string_view text() const {
+        return mapping ? std::string_view(static_cast<const char*>(mapping), size) : std::string_view(buffer);
+    }
+
+    bool is_mapped() const { return mapping != nullptr; }
+
+private:
+    void* mapping = nullptr;
+    size_t size = 0;     // Of the mapping
+    std::string buffer;  // The contents when not mapped
+};
+
+} // namespace nust
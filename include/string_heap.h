@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace nust {
+
+// A string in the heap, with its hash computed once when it was interned
+struct StringEntry {
+    std::string text;
+    size_t hash;
+};
+
+// Handle to an immutable interned string. Equal strings are interned once,
+// so copying a handle is a pointer copy and comparing two is a pointer
+// comparison.
+class InternedString {
+public:
+    // The empty string
+    InternedString();
+
+    const std::string& str() const { return entry->text; }
+    size_t size() const { return entry->text.size(); }
+    size_t hash() const { return entry->hash; }
+
+    bool operator==(const InternedString& other) const { return entry == other.entry; }
+    bool operator!=(const InternedString& other) const { return entry != other.entry; }
+
+private:
+    friend class StringHeap;
+    explicit InternedString(const StringEntry* entry) : entry(entry) {}
+
+    const StringEntry* entry;
+};
+
+// Process-wide pool of interned strings. Entries are never freed, so handles
+// stay valid for the life of the program; interning is thread safe.
+class StringHeap {
+public:
+    static StringHeap& global();
+
+    // The handle for `text`, adding it to the heap the first time it is seen
+    InternedString intern(std::string_view text);
+
+    // Number of distinct strings interned so far
+    size_t size() const;
+
+private:
+    StringHeap() = default;
+
+    mutable std::mutex mutex;
+    std::deque<StringEntry> entries;  // Stable addresses as the heap grows
+    std::unordered_map<std::string_view, const StringEntry*> index;  // Views into `entries`
+};
+
+} // namespace nust
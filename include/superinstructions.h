@@ -0,0 +1,38 @@
+#pragma once
+
+#include "instruction.h"
+#include "function_table.h"
+#include <vector>
+
+namespace nust {
+
+// Rewrites frequent opcode sequences into single superinstructions, so the VM
+// dispatches once where it used to dispatch three or four times:
+//
+//   LOAD a; PUSH_I32 k; ADD_I32|SUB_I32; STORE a  =>  INC_LOCAL a, +-k
+//   LOAD a; PUSH_I32 k; LT_I32; JMP_IF_NOT t      =>  LT_LI_JMPNOT t, a, k
+//   LOAD a; LOAD b; LT_I32; JMP_IF_NOT t          =>  LT_LL_JMPNOT t, a, b
+//   LOAD a; LOAD b; ADD_I32                       =>  ADD_LL a, b
+//   LOAD a; PUSH_I32 k; ADD_I32                   =>  ADD_LI a, k
+//
+// Values that are pushed and immediately popped (as after an assignment
+// statement) are dropped. A sequence is never fused across a jump target.
+// The set was chosen with the nust_ngrams tool; see tools/ngrams.cpp.
+class SuperinstructionSelector {
+public:
+    // Rewrite the program, updating entry points and loop offsets in the
+    // function table. Must run after all other passes. `origins`, if given,
+    // receives the original index of the last instruction each one replaces.
+    void run(std::vector<Instruction>& instructions, FunctionTable& function_table,
+             std::vector<size_t>* origins = nullptr);
+    
+private:
+    // Try to fuse the sequence starting at `pc`, returning how many
+    // instructions were consumed (0 if nothing matched)
+    size_t select(const std::vector<Instruction>& code, size_t pc, std::vector<Instruction>& out) const;
+    bool spans_target(size_t pc, size_t length) const;
+    
+    std::vector<bool> jump_targets;
+};
+
+} // namespace nust
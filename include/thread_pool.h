@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace nust {
+
+// Runs a batch of independent tasks on a fixed number of threads. Tasks are
+// dealt out evenly to per-worker queues up front; each worker takes from
+// the back of its own queue and, when that is empty, steals from the front
+// of another's, so a few slow tasks don't leave the other threads idle.
+class ThreadPool {
+public:
+    // Zero threads means one per hardware thread
+    explicit ThreadPool(size_t threads = 0);
+
+    size_t size() const { return queues.size(); }
+
+    // Call `task(index, worker)` for every index in [0, count) and wait for
+    // all of them. `worker` is in [0, size()) and no two tasks with the same
+    // worker run at once, so it can index per-thread state. The calling
+    // thread is worker 0. If a task throws, the rest of the batch still
+    // runs and the first exception is rethrown here.
+    void run(size_t count, const std::function<void(size_t index, size_t worker)>& task);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    // Pop from the worker's own queue, or steal. False when all are empty.
+    bool next_task(size_t worker, size_t& index);
+
+    std::vector<std::unique_ptr<Queue>> queues;  // Per worker
+};
+
+} // namespace nust
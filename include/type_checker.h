@@ -7,14 +7,18 @@
 #include <stdexcept>
 #include <vector>
 #include <optional>
+#include <iostream>
 
 namespace nust {
 
 class TypeChecker {
 public:
-    TypeChecker() = default;
+    // Errors are also printed to `diagnostics` as they are found, unless it
+    // is null
+    explicit TypeChecker(std::ostream* diagnostics = &std::cerr) : diagnostics_(diagnostics) {}
     
-    // Main entry point for type checking
+    // Main entry point for type checking. Errors from a previous program are
+    // cleared, so a checker can be reused.
     bool check_program(const Program& program);
     
     // Error reporting
@@ -49,6 +53,7 @@ private:
     
     // Error tracking
     std::vector<std::string> errors_;
+    std::ostream* diagnostics_;
     const Program* program_ = nullptr;
 };
 
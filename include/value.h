@@ -1,19 +1,32 @@
 #ifndef NUST_VALUE_H
 #define NUST_VALUE_H
 
+#include "string_heap.h"
+#include <cstddef>
+#include <cstdint>
 #include <variant>
 #include <string>
-#include <memory>
 
 namespace nust {
 
+// A borrow. The borrow checker guarantees a reference never outlives what it
+// refers to, so it is just the index of that slot in the machine's value
+// stack (or register file); an index rather than a pointer because the stack
+// can move when it grows.
+struct Ref {
+    size_t slot;
+
+    bool operator==(const Ref& other) const { return slot == other.slot; }
+    bool operator!=(const Ref& other) const { return slot != other.slot; }
+};
+
 class Value {
 public:
     // Supported value types
     using IntType = int32_t;
     using BoolType = bool;
-    using StringType = std::string;
-    using RefType = std::shared_ptr<Value>;
+    using StringType = InternedString;
+    using RefType = Ref;
 
     // Variant to hold any of our supported types
     using ValueType = std::variant<IntType, BoolType, StringType, RefType>;
@@ -25,6 +38,7 @@ public:
     Value(IntType value) : data_(value) {}
     Value(BoolType value) : data_(value) {}
     Value(StringType value) : data_(value) {}
+    Value(const std::string& value) : data_(StringHeap::global().intern(value)) {}
     Value(RefType value) : data_(value) {}
 
     // Type checking
@@ -36,9 +50,13 @@ public:
     // Value getters with type checking
     IntType as_int() const { return std::get<IntType>(data_); }
     BoolType as_bool() const { return std::get<BoolType>(data_); }
-    StringType as_string() const { return std::get<StringType>(data_); }
+    const std::string& as_string() const { return std::get<StringType>(data_).str(); }
+    StringType as_interned() const { return std::get<StringType>(data_); }
     RefType as_ref() const { return std::get<RefType>(data_); }
 
+    bool operator==(const Value& other) const { return data_ == other.data_; }
+    bool operator!=(const Value& other) const { return data_ != other.data_; }
+
 private:
     ValueType data_;
 };
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "instruction.h"
+#include "function_table.h"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace nust {
+
+// What a local slot or stack value holds at an instruction. Unset locals
+// haven't been written on some path into it, and Conflict ones hold
+// different types on different paths, so reading either is never valid.
+enum class SlotType : uint8_t {
+    Unset,
+    Int,
+    Bool,
+    Conflict
+};
+
+struct SlotState {
+    std::vector<SlotType> locals;
+    std::vector<SlotType> stack;
+};
+
+struct VerifiedFunction {
+    size_t start = 0;       // Entry point
+    size_t end = 0;         // First instruction past the function
+    size_t num_locals = 0;  // Local slots, including parameters
+    size_t max_depth = 0;   // Highest stack depth above the locals
+    std::vector<std::optional<SlotState>> states;  // Before each instruction, empty if unreachable
+
+    // Slots a frame of this function can occupy
+    size_t frame_size() const { return num_locals + max_depth; }
+};
+
+// Proves bytecode safe to run on raw int32_t slots, by abstract
+// interpretation of each function from its FunctionInfo::param_types.
+//
+// A function verifies when every value it touches is an i32 or a bool, each
+// instruction is reached with one stack depth and one type per stack
+// position, no instruction pops more than the frame has, locals are only
+// read while they hold a single type, jumps stay inside the function,
+// calls pass arguments of the callee's parameter types, and every return
+// produces the declared return type.
+class BytecodeVerifier {
+public:
+    BytecodeVerifier(const std::vector<Instruction>& instructions, const FunctionTable& function_table);
+
+    // Verify one function, or return nothing if it can't be run on raw slots
+    std::optional<VerifiedFunction> verify_function(size_t func_index) const;
+
+    // Verify every function, returning them by index, or nothing if any fails
+    std::optional<std::vector<VerifiedFunction>> verify() const;
+
+private:
+    const std::vector<Instruction>& instructions;
+    const FunctionTable& function_table;
+    std::vector<size_t> function_ends;
+};
+
+} // namespace nust
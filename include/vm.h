@@ -0,0 +1,125 @@
+#pragma once
+
+#include "instruction.h"
+#include "function_table.h"
+#include "value.h"
+#include "jit.h"
+#include "profiler.h"
+#include "sampling_profiler.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <string>
+
+namespace nust {
+
+struct VMOptions {
+    bool verify = true;  // Run programs BytecodeVerifier accepts on raw int32_t slots
+    size_t max_call_depth = 100000;  // Nested calls before a stack overflow error
+    SamplingProfiler* sampler = nullptr;  // Takes call stack samples when set
+    JitOptions jit;
+};
+
+// Stack-based interpreter for the bytecode produced by Compiler
+class VM {
+public:
+    VM(std::vector<Instruction> instructions, const FunctionTable& function_table,
+       std::vector<std::string> string_constants, VMOptions options = VMOptions());
+    
+    // Call a function by name and run it to completion
+    Value call(const std::string& name, const std::vector<Value>& args = {});
+    
+    // Whether a function has been compiled to machine code
+    bool is_compiled(const std::string& name) const;
+    
+    // Whether the program passed verification and runs without type checks
+    bool is_verified() const { return verified; }
+    
+#if NUST_PROFILE
+    // Opcode counts and timings, which only NUST_PROFILE builds record.
+    // Time spent in compiled code is charged to the instruction that
+    // entered it.
+    OpcodeProfiler& get_profiler() { return profiler; }
+#endif
+    
+    // Instructions the checked interpreter has executed. Instructions run
+    // by run_unchecked or by compiled code are not counted.
+    uint64_t instructions_executed() const { return executed; }
+    
+private:
+    // What a call needs to know about its callee, resolved when the VM is
+    // created so CALL indexes it directly instead of the function table
+    struct CallTarget {
+        size_t entry_point;
+        size_t num_params;
+        size_t num_slots;       // Local slots, including parameters
+        size_t raw_frame_size;  // Slots a frame takes in run_unchecked
+    };
+    
+    struct Frame {
+        size_t return_pc;  // Instruction to resume at in the caller
+        size_t base;       // Stack index of local slot 0
+        size_t func_index;
+    };
+    
+    Value run(size_t pc);
+    
+    // Turn the arguments on top of the stack into the callee's first local
+    // slots and return its entry point. Both stacks are reserved up front,
+    // so this allocates nothing.
+    size_t enter_frame(size_t func_index, size_t return_pc);
+    size_t reuse_frame(size_t func_index);
+    
+    // Pop the current frame. Returns true if it was the outermost one;
+    // otherwise pushes the result and sets `pc` to the return address.
+    bool leave_frame(Value& result, size_t& pc);
+    
+    // Count a call or loop back edge into the current function at `pc`,
+    // compiling it once it is hot, and run its machine code if it has an
+    // entry there. Returns true if the outermost frame returned `result`.
+    bool run_compiled(size_t& pc, Value& result);
+    
+    Value pop();
+    
+    // Record the call stack, with the current function at `pc`, if the
+    // sampling profiler's timer has fired. Checked at calls and loop back
+    // edges, which every long-running program keeps passing.
+    void poll_sampler(size_t pc) {
+        if (options.sampler && options.sampler->sample_pending()) {
+            take_sample(pc);
+        }
+    }
+    void take_sample(size_t pc);
+    
+    // Throw if another frame would exceed the maximum call depth
+    void check_depth(size_t func_index) const;
+    
+    // Run a verified program from the entry of `func_index` on untagged
+    // slots, with no type tests or stack bounds checks and the top of the
+    // stack kept in a local
+    Value run_unchecked(size_t func_index, const std::vector<Value>& args);
+    
+    std::vector<Instruction> instructions;
+    const FunctionTable& function_table;
+    std::vector<InternedString> string_constants;  // Interned once when the VM is created
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    std::vector<CallTarget> call_targets;  // Per function index
+    
+    VMOptions options;
+    bool verified = false;
+    std::vector<int32_t> raw_stack;
+    
+    JitCompiler jit;
+    std::vector<size_t> hotness;  // Per function index
+    std::vector<std::unique_ptr<JitFunction>> compiled;
+    std::vector<int32_t> native_frame;
+    
+#if NUST_PROFILE
+    OpcodeProfiler profiler;
+#endif
+    std::vector<uint32_t> sample_stack;
+    uint64_t executed = 0;
+};
+
+} // namespace nust
@@ -0,0 +1,45 @@
+#include "bytecode_writer.h"
+
+namespace nust {
+
+void write_assembly(std::ostream& out, const std::vector<Instruction>& instructions) {
+    for (const auto& instr : instructions) {
+        out << opcode_to_string(instr.opcode);
+        if (instr.has_operand()) {
+            out << " " << instr.operand;
+        }
+        if (instr.num_args() > 0) {
+            out << ", " << static_cast<int32_t>(instr.arg1);
+        }
+        if (instr.num_args() > 1) {
+            out << ", " << static_cast<int32_t>(instr.arg2);
+        }
+        out << "\n";
+    }
+}
+
+void write_bytecode(std::ostream& out, const std::vector<Instruction>& instructions, const SpanTable* spans) {
+    for (const auto& instr : instructions) {
+        out << static_cast<uint8_t>(instr.opcode);
+        if (instr.has_operand()) {
+            // Encode operand as little-endian
+            for (size_t i = 0; i < sizeof(size_t); ++i) {
+                out << static_cast<uint8_t>((instr.operand >> (i * 8)) & 0xFF);
+            }
+        }
+        // Superinstruction arguments follow as 32-bit little-endian words
+        const uint32_t args[] = {instr.arg1, instr.arg2};
+        for (size_t a = 0; a < instr.num_args(); ++a) {
+            for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+                out << static_cast<uint8_t>((args[a] >> (i * 8)) & 0xFF);
+            }
+        }
+    }
+
+    // Instruction spans follow the code as an optional trailing section
+    if (spans) {
+        spans->write_section(out);
+    }
+}
+
+} // namespace nust
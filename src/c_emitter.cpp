@@ -0,0 +1,446 @@
+#include "c_emitter.h"
+#include <stdexcept>
+
+namespace nust {
+
+namespace {
+
+// A C string literal holding the same bytes as the VM string. The parser
+// keeps a Nust literal's escapes verbatim and the VM never interprets them,
+// so backslashes are escaped here like quotes, question marks (which could
+// start a trigraph) and control characters
+std::string quote(const std::string& value) {
+    std::string quoted = "\"";
+    for (char c : value) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '\\' || c == '"' || c == '?') {
+            quoted += '\\';
+            quoted += c;
+        } else if (byte < 0x20 || byte == 0x7f) {
+            // Always three octal digits, so a following digit isn't taken
+            // as part of the escape
+            quoted += '\\';
+            quoted += static_cast<char>('0' + (byte >> 6));
+            quoted += static_cast<char>('0' + ((byte >> 3) & 7));
+            quoted += static_cast<char>('0' + (byte & 7));
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+// Whether evaluating the expression can change a variable: assignments do,
+// and calls may write through a mutable reference
+bool has_side_effects(const Expr* expr) {
+    if (auto binary = dynamic_cast<const BinaryExpr*>(expr)) {
+        return binary->op == BinaryExpr::Op::Assignment || has_side_effects(binary->left.get()) ||
+               has_side_effects(binary->right.get());
+    } else if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) {
+        return has_side_effects(unary->expr.get());
+    } else if (auto borrow = dynamic_cast<const BorrowExpr*>(expr)) {
+        return has_side_effects(borrow->expr.get());
+    }
+    return dynamic_cast<const CallExpr*>(expr) != nullptr;
+}
+
+} // namespace
+
+std::string CEmitter::emit(const Program& program) {
+    out.str("");
+    out.clear();
+    indent = 0;
+
+    emit_prelude();
+
+    // Prototypes first, so functions can call each other in any order
+    const FunctionDecl* main = nullptr;
+    for (const auto& item : program.items) {
+        if (auto func = dynamic_cast<const FunctionDecl*>(item.get())) {
+            out << c_type(*func->return_type) << " fn_" << func->name << "(";
+            for (size_t i = 0; i < func->params.size(); ++i) {
+                out << (i > 0 ? ", " : "") << c_type(*func->params[i].type);
+            }
+            out << (func->params.empty() ? "void" : "") << ");\n";
+            if (func->name == "main") {
+                main = func;
+            }
+        }
+    }
+
+    for (const auto& item : program.items) {
+        if (auto func = dynamic_cast<const FunctionDecl*>(item.get())) {
+            out << "\n";
+            emit_function(*func);
+        }
+    }
+
+    if (main) {
+        out << "\n";
+        emit_entry_point(*main);
+    }
+    return out.str();
+}
+
+void CEmitter::emit_prelude() {
+    out << "/* Generated by nust --emit-c */\n"
+        << "#include <stdbool.h>\n"
+        << "#include <stdint.h>\n"
+        << "#include <stdio.h>\n"
+        << "#include <stdlib.h>\n"
+        << "#include <string.h>\n"
+        << "\n"
+        << "/* i32 arithmetic wraps around, as in the VM */\n"
+        << "static inline int32_t nust_add(int32_t a, int32_t b) { return (int32_t)((uint32_t)a + (uint32_t)b); }\n"
+        << "static inline int32_t nust_sub(int32_t a, int32_t b) { return (int32_t)((uint32_t)a - (uint32_t)b); }\n"
+        << "static inline int32_t nust_mul(int32_t a, int32_t b) { return (int32_t)((uint32_t)a * (uint32_t)b); }\n"
+        << "static inline int32_t nust_neg(int32_t a) { return (int32_t)(0u - (uint32_t)a); }\n"
+        << "static inline int32_t nust_div(int32_t a, int32_t b) {\n"
+        << "    if (b == 0) {\n"
+        << "        fprintf(stderr, \"Error: Division by zero\\n\");\n"
+        << "        exit(1);\n"
+        << "    }\n"
+        << "    return b == -1 ? nust_neg(a) : a / b;\n"
+        << "}\n"
+        << "\n";
+}
+
+std::string CEmitter::c_type(const Type& type) {
+    switch (type.kind) {
+        case Type::Kind::I32:
+            return "int32_t";
+        case Type::Kind::Bool:
+            return "bool";
+        case Type::Kind::Str:
+            return "const char*";
+        case Type::Kind::Ref:
+            return c_type(*type.base_type) + " const*";
+        case Type::Kind::MutRef:
+            return c_type(*type.base_type) + "*";
+    }
+    throw std::runtime_error("Unknown type");
+}
+
+std::string CEmitter::declare(const std::string& name) {
+    // The prefix keeps bindings clear of C keywords, the names the headers
+    // define and the generated fn_ and nust_ names
+    std::string base = "v_" + name;
+    std::string c_name = base;
+    for (size_t n = 1; used_names.count(c_name); ++n) {
+        c_name = base + "_" + std::to_string(n);
+    }
+    used_names.insert(c_name);
+    scopes.back()[name] = c_name;
+    return c_name;
+}
+
+std::string CEmitter::lookup(const std::string& name) const {
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+        auto it = scope->find(name);
+        if (it != scope->end()) {
+            return it->second;
+        }
+    }
+    throw std::runtime_error("Undefined variable: " + name);
+}
+
+void CEmitter::emit_function(const FunctionDecl& func) {
+    scopes.clear();
+    used_names.clear();
+    hoisted.clear();
+    temp_count = 0;
+    enter_scope();
+
+    out << c_type(*func.return_type) << " fn_" << func.name << "(";
+    for (size_t i = 0; i < func.params.size(); ++i) {
+        const auto& param = func.params[i];
+        out << (i > 0 ? ", " : "") << c_type(*param.type) << (param.is_mut ? " " : " const ")
+            << declare(param.name);
+    }
+    out << (func.params.empty() ? "void" : "") << ") {\n";
+    ++indent;
+
+    // A trailing expression is the result; unit functions return 0, as
+    // calls to them evaluate to 0 in the VM
+    auto body = dynamic_cast<const BlockStmt*>(func.body.get());
+    const ExprStmt* result = nullptr;
+    if (body && !body->statements.empty()) {
+        result = dynamic_cast<const ExprStmt*>(body->statements.back().get());
+    }
+    if (result) {
+        enter_scope();
+        for (size_t i = 0; i + 1 < body->statements.size(); ++i) {
+            emit_statement(body->statements[i].get());
+        }
+        std::string code = emit_expression(result->expr.get());
+        flush_hoisted();
+        out << indentation() << "return " << code << ";\n";
+        exit_scope();
+    } else {
+        if (body) {
+            enter_scope();
+            for (const auto& stmt : body->statements) {
+                emit_statement(stmt.get());
+            }
+            exit_scope();
+        } else {
+            emit_statement(func.body.get());
+        }
+        out << indentation() << "return 0;\n";
+    }
+
+    --indent;
+    out << "}\n";
+    exit_scope();
+}
+
+void CEmitter::emit_entry_point(const FunctionDecl& main) {
+    for (const auto& param : main.params) {
+        if (param.type->kind == Type::Kind::Ref || param.type->kind == Type::Kind::MutRef) {
+            out << "/* No entry point: main takes a reference */\n";
+            return;
+        }
+    }
+
+    // Arguments come from the command line: integers, `true`/`false` or strings
+    std::string usage = "Usage: %s";
+    std::string args;
+    for (size_t i = 0; i < main.params.size(); ++i) {
+        const auto& param = main.params[i];
+        std::string arg = "argv[" + std::to_string(i + 1) + "]";
+        usage += " <" + param.name + ">";
+        args += i > 0 ? ", " : "";
+        if (param.type->kind == Type::Kind::I32) {
+            args += "(int32_t)strtol(" + arg + ", NULL, 10)";
+        } else if (param.type->kind == Type::Kind::Bool) {
+            args += "strcmp(" + arg + ", \"true\") == 0";
+        } else {
+            args += arg;
+        }
+    }
+
+    out << "int main(int argc, char** argv) {\n"
+        << "    if (argc != " << main.params.size() + 1 << ") {\n"
+        << "        fprintf(stderr, \"" << usage << "\\n\", argv[0]);\n"
+        << "        return 1;\n"
+        << "    }\n"
+        << "    " << c_type(*main.return_type) << " result = fn_main(" << args << ");\n";
+    switch (main.return_type->kind) {
+        case Type::Kind::I32:
+            out << "    printf(\"%d\\n\", (int)result);\n";
+            break;
+        case Type::Kind::Bool:
+            out << "    puts(result ? \"true\" : \"false\");\n";
+            break;
+        case Type::Kind::Str:
+            out << "    puts(result);\n";
+            break;
+        default:
+            out << "    (void)result;\n";
+            break;
+    }
+    out << "    return 0;\n"
+        << "}\n";
+}
+
+void CEmitter::emit_statement(const Stmt* stmt) {
+    if (auto let = dynamic_cast<const LetStmt*>(stmt)) {
+        // The initializer still sees any binding this one shadows
+        std::string init = emit_expression(let->init.get());
+        flush_hoisted();
+        std::string type = c_type(*let->type) + (let->is_mut ? " " : " const ");
+        out << indentation() << type << declare(let->name) << " = " << init << ";\n";
+    } else if (auto if_stmt = dynamic_cast<const IfStmt*>(stmt)) {
+        std::string condition = emit_expression(if_stmt->condition.get());
+        flush_hoisted();
+        out << indentation() << "if (" << condition << ") {\n";
+        ++indent;
+        emit_block(dynamic_cast<const BlockStmt*>(if_stmt->then_branch.get()));
+        --indent;
+        if (if_stmt->else_branch) {
+            out << indentation() << "} else {\n";
+            ++indent;
+            auto else_block = dynamic_cast<const BlockStmt*>(if_stmt->else_branch.get());
+            if (else_block) {
+                emit_block(else_block);
+            } else {
+                emit_statement(if_stmt->else_branch.get());
+            }
+            --indent;
+        }
+        out << indentation() << "}\n";
+    } else if (auto while_stmt = dynamic_cast<const WhileStmt*>(stmt)) {
+        // A condition that needs temporaries is evaluated at the top of the
+        // body, so they are recomputed on every iteration
+        ++indent;
+        std::string condition = emit_expression(while_stmt->condition.get());
+        --indent;
+        if (hoisted.empty()) {
+            out << indentation() << "while (" << condition << ") {\n";
+            ++indent;
+        } else {
+            out << indentation() << "while (true) {\n";
+            ++indent;
+            flush_hoisted();
+            out << indentation() << "if (!" << condition << ") {\n"
+                << indentation() << "    break;\n"
+                << indentation() << "}\n";
+        }
+        emit_block(dynamic_cast<const BlockStmt*>(while_stmt->body.get()));
+        --indent;
+        out << indentation() << "}\n";
+    } else if (auto block = dynamic_cast<const BlockStmt*>(stmt)) {
+        out << indentation() << "{\n";
+        ++indent;
+        emit_block(block);
+        --indent;
+        out << indentation() << "}\n";
+    } else if (auto expr = dynamic_cast<const ExprStmt*>(stmt)) {
+        // Drop the parentheses around a top-level assignment
+        std::string code = emit_expression(expr->expr.get());
+        auto binary = dynamic_cast<const BinaryExpr*>(expr->expr.get());
+        if (binary && binary->op == BinaryExpr::Op::Assignment) {
+            code = code.substr(1, code.size() - 2);
+        }
+        flush_hoisted();
+        out << indentation() << code << ";\n";
+    }
+}
+
+void CEmitter::emit_block(const BlockStmt* block) {
+    if (!block) {
+        throw std::runtime_error("Expected a block");
+    }
+    enter_scope();
+    for (const auto& stmt : block->statements) {
+        emit_statement(stmt.get());
+    }
+    exit_scope();
+}
+
+std::string CEmitter::emit_expression(const Expr* expr) {
+    if (auto binary = dynamic_cast<const BinaryExpr*>(expr)) {
+        if (binary->op == BinaryExpr::Op::Assignment) {
+            auto* target = dynamic_cast<const Identifier*>(binary->left.get());
+            if (!target) {
+                throw std::runtime_error("Assignment target must be an identifier");
+            }
+            return "(" + lookup(target->name) + " = " + emit_expression(binary->right.get()) + ")";
+        }
+
+        std::string left = emit_expression(binary->left.get());
+        bool is_and = binary->op == BinaryExpr::Op::And;
+        if (is_and || binary->op == BinaryExpr::Op::Or) {
+            // The right operand's temporaries may only be computed when the
+            // left one doesn't decide the result
+            size_t start = hoisted.size();
+            ++indent;
+            std::string right = emit_expression(binary->right.get());
+            --indent;
+            if (hoisted.size() == start) {
+                return "(" + left + (is_and ? " && " : " || ") + right + ")";
+            }
+            std::string right_hoisted = hoisted.substr(start);
+            hoisted.resize(start);
+            std::string result = "nust_t" + std::to_string(temp_count++);
+            hoisted += indentation() + "bool " + result + " = " + left + ";\n" +
+                       indentation() + "if (" + (is_and ? "" : "!") + result + ") {\n" +
+                       right_hoisted +
+                       indentation() + "    " + result + " = " + right + ";\n" +
+                       indentation() + "}\n";
+            return result;
+        }
+        if (has_side_effects(binary->left.get()) || has_side_effects(binary->right.get())) {
+            left = hoist(binary->left.get(), left);
+        }
+        std::string right = emit_expression(binary->right.get());
+        const char* op = nullptr;
+        switch (binary->op) {
+            case BinaryExpr::Op::Add:
+                return "nust_add(" + left + ", " + right + ")";
+            case BinaryExpr::Op::Sub:
+                return "nust_sub(" + left + ", " + right + ")";
+            case BinaryExpr::Op::Mul:
+                return "nust_mul(" + left + ", " + right + ")";
+            case BinaryExpr::Op::Div:
+                return "nust_div(" + left + ", " + right + ")";
+            case BinaryExpr::Op::Eq: op = "=="; break;
+            case BinaryExpr::Op::Ne: op = "!="; break;
+            case BinaryExpr::Op::Lt: op = "<"; break;
+            case BinaryExpr::Op::Gt: op = ">"; break;
+            case BinaryExpr::Op::Le: op = "<="; break;
+            case BinaryExpr::Op::Ge: op = ">="; break;
+            default:
+                throw std::runtime_error("Unknown binary operator");
+        }
+        // Strings compare by contents
+        if (binary->left->type && binary->left->type->kind == Type::Kind::Str) {
+            return "(strcmp(" + left + ", " + right + ") " + op + " 0)";
+        }
+        return "(" + left + " " + op + " " + right + ")";
+    } else if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) {
+        std::string operand = emit_expression(unary->expr.get());
+        return unary->op == UnaryExpr::Op::Neg ? "nust_neg(" + operand + ")" : "!" + operand;
+    } else if (auto int_lit = dynamic_cast<const IntLiteral*>(expr)) {
+        return std::to_string(int_lit->value);
+    } else if (auto bool_lit = dynamic_cast<const BoolLiteral*>(expr)) {
+        return bool_lit->value ? "true" : "false";
+    } else if (auto str_lit = dynamic_cast<const StringLiteral*>(expr)) {
+        return quote(str_lit->value);
+    } else if (auto ident = dynamic_cast<const Identifier*>(expr)) {
+        return lookup(ident->name);
+    } else if (auto call = dynamic_cast<const CallExpr*>(expr)) {
+        auto* callee = dynamic_cast<const Identifier*>(call->callee.get());
+        if (!callee) {
+            throw std::runtime_error("Function callee must be an identifier");
+        }
+        // Arguments are evaluated last first; all but the first one go
+        // into temporaries when any of them has side effects
+        bool sequenced = false;
+        for (const auto& arg : call->args) {
+            sequenced = sequenced || has_side_effects(arg.get());
+        }
+        std::vector<std::string> args(call->args.size());
+        for (size_t i = args.size(); i-- > 0;) {
+            args[i] = emit_expression(call->args[i].get());
+            if (sequenced && i > 0) {
+                args[i] = hoist(call->args[i].get(), args[i]);
+            }
+        }
+        std::string code = "fn_" + callee->name + "(";
+        for (size_t i = 0; i < args.size(); ++i) {
+            code += (i > 0 ? ", " : "") + args[i];
+        }
+        return code + ")";
+    } else if (auto borrow = dynamic_cast<const BorrowExpr*>(expr)) {
+        // Variables are borrowed in place; other values through a compound literal
+        if (auto ident = dynamic_cast<const Identifier*>(borrow->expr.get())) {
+            return "&" + lookup(ident->name);
+        }
+        if (!borrow->expr->type) {
+            throw std::runtime_error("Cannot borrow an untyped expression");
+        }
+        return "&(" + c_type(*borrow->expr->type) + "){" + emit_expression(borrow->expr.get()) + "}";
+    }
+    throw std::runtime_error("Unsupported expression");
+}
+
+std::string CEmitter::hoist(const Expr* expr, const std::string& code) {
+    if (dynamic_cast<const IntLiteral*>(expr) || dynamic_cast<const BoolLiteral*>(expr) ||
+        dynamic_cast<const StringLiteral*>(expr)) {
+        return code;
+    }
+    if (!expr->type) {
+        throw std::runtime_error("Cannot evaluate an untyped expression into a temporary");
+    }
+    std::string name = "nust_t" + std::to_string(temp_count++);
+    hoisted += indentation() + c_type(*expr->type) + " const " + name + " = " + code + ";\n";
+    return name;
+}
+
+void CEmitter::flush_hoisted() {
+    out << hoisted;
+    hoisted.clear();
+}
+
+} // namespace nust
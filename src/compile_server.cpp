@@ -0,0 +1,379 @@
+#include "compile_server.h"
+#include "bytecode_writer.h"
+#include "session.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace nust {
+
+namespace {
+
+#ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_NOSIGNAL;  // A client hanging up mustn't kill the server
+#else
+constexpr int send_flags = 0;
+#endif
+
+// Larger messages are treated as a broken connection
+constexpr uint32_t max_message_size = 256u << 20;
+
+constexpr uint32_t flag_optimize = 1;
+constexpr uint32_t flag_debug_info = 2;
+
+int open_socket() {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    if (fd >= 0) {
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+#endif
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Failed to create socket: ") + std::strerror(errno));
+    }
+    return fd;
+}
+
+sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = send(fd, data.data() + written, data.size() - written, send_flags);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool read_all(int fd, char* data, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        ssize_t n = recv(fd, data + received, size - received, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        received += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void put_u32(std::string& out, uint32_t value) {
+    for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+        out.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+}
+
+void put_blob(std::string& out, const std::string& blob) {
+    put_u32(out, static_cast<uint32_t>(blob.size()));
+    out += blob;
+}
+
+bool read_u32(int fd, uint32_t& value) {
+    unsigned char bytes[sizeof(uint32_t)];
+    if (!read_all(fd, reinterpret_cast<char*>(bytes), sizeof(bytes))) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+        value |= static_cast<uint32_t>(bytes[i]) << (i * 8);
+    }
+    return true;
+}
+
+bool read_blob(int fd, std::string& blob) {
+    uint32_t size;
+    if (!read_u32(fd, size) || size > max_message_size) {
+        return false;
+    }
+    blob.resize(size);
+    return read_all(fd, blob.data(), size);
+}
+
+// Remove a socket file whose server is gone, so a new one can bind there.
+// Anything else at the path is left alone and reported.
+void remove_stale_socket(const std::string& path, const sockaddr_un& address) {
+    struct stat info;
+    if (lstat(path.c_str(), &info) != 0) {
+        if (errno == ENOENT) {
+            return;
+        }
+        throw std::runtime_error("Failed to inspect " + path + ": " + std::strerror(errno));
+    }
+    if (!S_ISSOCK(info.st_mode)) {
+        throw std::runtime_error(path + " exists and is not a socket");
+    }
+    int fd = open_socket();
+    bool refused = connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 &&
+                   errno == ECONNREFUSED;
+    close(fd);
+    if (!refused) {
+        throw std::runtime_error(path + " is in use by another server");
+    }
+    unlink(path.c_str());
+}
+
+} // namespace
+
+struct CompileServer::Sessions {
+    Session plain;
+    Session optimized{CompilerOptions::optimized()};
+
+    CompileResponse compile(const CompileRequest& request) {
+        CompileResponse response;
+        try {
+            Module module = (request.optimize ? optimized : plain).compile(request.source);
+            std::ostringstream bytecode;
+            write_bytecode(bytecode, module.instructions, request.debug_info ? &module.span_table : nullptr);
+            std::ostringstream assembly;
+            write_assembly(assembly, module.instructions);
+            response.ok = true;
+            response.bytecode = bytecode.str();
+            response.assembly = assembly.str();
+        } catch (const std::exception& e) {
+            response.diagnostics = e.what();
+        }
+        return response;
+    }
+};
+
+CompileServer::CompileServer(size_t cache_bytes, size_t threads)
+    : capacity(cache_bytes), pool(threads), caller_sessions(std::make_unique<Sessions>()) {
+    for (size_t i = 0; i < pool.size(); ++i) {
+        worker_sessions.push_back(std::make_unique<Sessions>());
+    }
+    if (pipe(wake_fds) != 0) {
+        throw std::runtime_error(std::string("Failed to create pipe: ") + std::strerror(errno));
+    }
+}
+
+CompileServer::~CompileServer() {
+    if (listener >= 0) {
+        close(listener);
+        unlink(socket_path.c_str());
+    }
+    close(wake_fds[0]);
+    close(wake_fds[1]);
+}
+
+size_t CompileServer::cache_size() const {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return size;
+}
+
+std::shared_ptr<const CompileResponse> CompileServer::compile(const CompileRequest& request) {
+    std::lock_guard<std::mutex> lock(caller_mutex);
+    return compile_with(request, *caller_sessions);
+}
+
+std::shared_ptr<const CompileResponse> CompileServer::compile_with(const CompileRequest& request,
+                                                                   Sessions& sessions) {
+    std::string key(1, static_cast<char>((request.optimize ? flag_optimize : 0) |
+                                         (request.debug_info ? flag_debug_info : 0)));
+    key += request.source;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            entries.splice(entries.begin(), entries, it->second);
+            ++hits;
+            return it->second->response;
+        }
+    }
+
+    // Compile without holding the lock, so other workers aren't held up;
+    // two workers missing on the same source both compile it
+    ++misses;
+    auto response = std::make_shared<const CompileResponse>(sessions.compile(request));
+    size_t bytes = key.size() + response->bytecode.size() + response->assembly.size() +
+                   response->diagnostics.size();
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (bytes <= capacity && cache.find(key) == cache.end()) {
+        entries.push_front(CacheEntry{std::move(key), response, bytes});
+        cache.emplace(entries.front().key, entries.begin());
+        size += bytes;
+        while (size > capacity) {
+            size -= entries.back().size;
+            cache.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+    return response;
+}
+
+void CompileServer::listen(const std::string& path) {
+    if (listener >= 0) {
+        throw std::runtime_error("Already listening on " + socket_path);
+    }
+    sockaddr_un address = socket_address(path);
+    remove_stale_socket(path, address);
+    int fd = open_socket();
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0) {
+        std::string message = std::string("Failed to listen on ") + path + ": " + std::strerror(errno);
+        close(fd);
+        throw std::runtime_error(message);
+    }
+    listener = fd;
+    socket_path = path;
+}
+
+void CompileServer::serve(const std::string& path) {
+    listen(path);
+    serve();
+}
+
+void CompileServer::serve() {
+    if (listener < 0) {
+        throw std::runtime_error("serve() called before listen()");
+    }
+
+    // One long-running task per worker, each taking connections as they
+    // are accepted
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = false;
+    }
+    std::thread workers([this] {
+        pool.run(pool.size(), [this](size_t, size_t worker) { serve_connections(*worker_sessions[worker]); });
+    });
+
+    while (true) {
+        pollfd fds[2] = {{listener, POLLIN, 0}, {wake_fds[0], POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            char byte;
+            ssize_t ignored = read(wake_fds[0], &byte, 1);
+            (void)ignored;
+            break;
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            accepted.push_back(fd);
+        }
+        queue_changed.notify_one();
+    }
+    close(listener);
+    listener = -1;
+    unlink(socket_path.c_str());
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_changed.notify_all();
+    workers.join();
+}
+
+void CompileServer::stop() {
+    char byte = 0;
+    ssize_t ignored = write(wake_fds[1], &byte, 1);
+    (void)ignored;
+}
+
+void CompileServer::serve_connections(Sessions& sessions) {
+    while (true) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_changed.wait(lock, [this] { return stopping || !accepted.empty(); });
+            if (accepted.empty()) {
+                return;
+            }
+            fd = accepted.front();
+            accepted.pop_front();
+        }
+        handle_connection(fd, sessions);
+        close(fd);
+    }
+}
+
+void CompileServer::handle_connection(int fd, Sessions& sessions) {
+    while (true) {
+        uint32_t flags;
+        CompileRequest request;
+        if (!read_u32(fd, flags) || !read_blob(fd, request.source)) {
+            return;
+        }
+        request.optimize = flags & flag_optimize;
+        request.debug_info = flags & flag_debug_info;
+
+        auto response = compile_with(request, sessions);
+        std::string message;
+        put_u32(message, response->ok ? 0 : 1);
+        if (response->ok) {
+            put_blob(message, response->bytecode);
+            put_blob(message, response->assembly);
+        } else {
+            put_blob(message, response->diagnostics);
+        }
+        if (!write_all(fd, message)) {
+            return;
+        }
+    }
+}
+
+CompileResponse request_compile(const std::string& path, const CompileRequest& request) {
+    sockaddr_un address = socket_address(path);
+    int fd = open_socket();
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        std::string message = std::string("Failed to connect to ") + path + ": " + std::strerror(errno);
+        close(fd);
+        throw std::runtime_error(message);
+    }
+
+    std::string message;
+    put_u32(message, (request.optimize ? flag_optimize : 0) | (request.debug_info ? flag_debug_info : 0));
+    put_blob(message, request.source);
+    CompileResponse response;
+    uint32_t status = 0;
+    bool received = write_all(fd, message) && read_u32(fd, status) &&
+                    (status == 0 ? read_blob(fd, response.bytecode) && read_blob(fd, response.assembly)
+                                 : read_blob(fd, response.diagnostics));
+    close(fd);
+    if (!received) {
+        throw std::runtime_error("Connection to " + path + " failed");
+    }
+    response.ok = status == 0;
+    return response;
+}
+
+} // namespace nust
@@ -0,0 +1,237 @@
+#include "compile_stats.h"
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace nust {
+
+namespace {
+
+std::atomic<uint64_t> allocation_count{0};
+std::atomic<uint64_t> allocation_bytes{0};
+
+double milliseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Entries with the highest counts first
+std::vector<std::pair<std::string, size_t>> by_count(const std::map<std::string, size_t>& counts) {
+    std::vector<std::pair<std::string, size_t>> sorted(counts.begin(), counts.end());
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const auto& a, const auto& b) { return a.second > b.second; });
+    return sorted;
+}
+
+void write_json_counts(std::ostream& out, const std::map<std::string, size_t>& counts) {
+    out << "{";
+    const char* separator = "";
+    for (const auto& [name, count] : counts) {
+        out << separator << "\"" << name << "\": " << count;
+        separator = ", ";
+    }
+    out << "}";
+}
+
+} // namespace
+
+void note_allocation(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+AllocationCounts allocation_counts() {
+    return AllocationCounts{allocation_count.load(std::memory_order_relaxed),
+                            allocation_bytes.load(std::memory_order_relaxed)};
+}
+
+size_t peak_rss() {
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        return static_cast<size_t>(usage.ru_maxrss);  // Bytes
+#else
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;  // Kilobytes
+#endif
+    }
+#endif
+    return 0;
+}
+
+CompileStats::PhaseTimer::PhaseTimer(CompileStats& stats, std::string name)
+    : stats(stats), name(std::move(name)), wall_start(std::chrono::steady_clock::now()),
+      cpu_start(std::clock()), allocations_start(allocation_counts()) {}
+
+CompileStats::PhaseTimer::~PhaseTimer() {
+    AllocationCounts allocations = allocation_counts();
+    stats.phases.push_back(Phase{
+        std::move(name),
+        milliseconds(std::chrono::steady_clock::now() - wall_start),
+        1000.0 * static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC,
+        AllocationCounts{allocations.count - allocations_start.count,
+                         allocations.bytes - allocations_start.bytes}});
+}
+
+void CompileStats::count_nodes(const Program& program) {
+    count_node(&program);
+}
+
+void CompileStats::count_node(const ASTNode* node) {
+    if (!node) {
+        return;
+    }
+    if (auto program = dynamic_cast<const Program*>(node)) {
+        ++nodes["Program"];
+        for (const auto& item : program->items) {
+            count_node(item.get());
+        }
+    } else if (auto func = dynamic_cast<const FunctionDecl*>(node)) {
+        ++nodes["FunctionDecl"];
+        nodes["Param"] += func->params.size();
+        count_node(func->body.get());
+    } else if (auto let = dynamic_cast<const LetStmt*>(node)) {
+        ++nodes["LetStmt"];
+        count_node(let->init.get());
+    } else if (auto expr_stmt = dynamic_cast<const ExprStmt*>(node)) {
+        ++nodes["ExprStmt"];
+        count_node(expr_stmt->expr.get());
+    } else if (auto if_stmt = dynamic_cast<const IfStmt*>(node)) {
+        ++nodes["IfStmt"];
+        count_node(if_stmt->condition.get());
+        count_node(if_stmt->then_branch.get());
+        count_node(if_stmt->else_branch.get());
+    } else if (auto while_stmt = dynamic_cast<const WhileStmt*>(node)) {
+        ++nodes["WhileStmt"];
+        count_node(while_stmt->condition.get());
+        count_node(while_stmt->body.get());
+    } else if (auto block = dynamic_cast<const BlockStmt*>(node)) {
+        ++nodes["BlockStmt"];
+        for (const auto& stmt : block->statements) {
+            count_node(stmt.get());
+        }
+    } else if (auto binary = dynamic_cast<const BinaryExpr*>(node)) {
+        ++nodes["BinaryExpr"];
+        count_node(binary->left.get());
+        count_node(binary->right.get());
+    } else if (auto unary = dynamic_cast<const UnaryExpr*>(node)) {
+        ++nodes["UnaryExpr"];
+        count_node(unary->expr.get());
+    } else if (auto borrow = dynamic_cast<const BorrowExpr*>(node)) {
+        ++nodes["BorrowExpr"];
+        count_node(borrow->expr.get());
+    } else if (auto call = dynamic_cast<const CallExpr*>(node)) {
+        ++nodes["CallExpr"];
+        count_node(call->callee.get());
+        for (const auto& arg : call->args) {
+            count_node(arg.get());
+        }
+    } else if (dynamic_cast<const IntLiteral*>(node)) {
+        ++nodes["IntLiteral"];
+    } else if (dynamic_cast<const BoolLiteral*>(node)) {
+        ++nodes["BoolLiteral"];
+    } else if (dynamic_cast<const StringLiteral*>(node)) {
+        ++nodes["StringLiteral"];
+    } else if (dynamic_cast<const Identifier*>(node)) {
+        ++nodes["Identifier"];
+    }
+}
+
+void CompileStats::count_instructions(const std::vector<Instruction>& code) {
+    instructions = code.size();
+    opcodes.clear();
+    for (const auto& instr : code) {
+        ++opcodes[opcode_to_string(instr.opcode)];
+    }
+}
+
+void CompileStats::set_string_constants(const std::vector<std::string>& constants) {
+    string_constants = constants.size();
+    string_bytes = 0;
+    for (const auto& constant : constants) {
+        string_bytes += constant.size();
+    }
+}
+
+void CompileStats::write_text(std::ostream& out, bool times, bool stats) const {
+    std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << std::left << std::setw(12) << "phase" << std::right;
+    if (times) {
+        out << std::setw(12) << "wall ms" << std::setw(12) << "cpu ms";
+    }
+    if (stats) {
+        out << std::setw(10) << "allocs" << std::setw(12) << "bytes";
+    }
+    out << "\n";
+    Phase total{"total", 0, 0, {}};
+    auto write_row = [&](const Phase& phase) {
+        out << std::left << std::setw(12) << phase.name << std::right;
+        if (times) {
+            out << std::setw(12) << phase.wall_ms << std::setw(12) << phase.cpu_ms;
+        }
+        if (stats) {
+            out << std::setw(10) << phase.allocations.count << std::setw(12) << phase.allocations.bytes;
+        }
+        out << "\n";
+    };
+    for (const auto& phase : phases) {
+        write_row(phase);
+        total.wall_ms += phase.wall_ms;
+        total.cpu_ms += phase.cpu_ms;
+        total.allocations.count += phase.allocations.count;
+        total.allocations.bytes += phase.allocations.bytes;
+    }
+    write_row(total);
+
+    if (stats) {
+        out << "\nfunctions         " << functions
+            << "\nstring constants  " << string_constants << " (" << string_bytes << " bytes)"
+            << "\ninstructions      " << instructions
+            << "\npeak RSS          " << peak_rss() / 1024 << " KiB\n";
+        out << "\nAST nodes\n";
+        for (const auto& [name, count] : by_count(nodes)) {
+            out << "  " << std::left << std::setw(16) << name << std::right << std::setw(8) << count << "\n";
+        }
+        out << "\nopcodes\n";
+        for (const auto& [name, count] : by_count(opcodes)) {
+            out << "  " << std::left << std::setw(16) << name << std::right << std::setw(8) << count << "\n";
+        }
+    }
+    out.flags(flags);
+}
+
+void CompileStats::write_json(std::ostream& out, bool times, bool stats) const {
+    out << "{\n  \"phases\": [";
+    const char* separator = "\n";
+    for (const auto& phase : phases) {
+        out << separator << "    {\"name\": \"" << phase.name << "\"";
+        if (times) {
+            out << ", \"wall_ms\": " << phase.wall_ms << ", \"cpu_ms\": " << phase.cpu_ms;
+        }
+        if (stats) {
+            out << ", \"allocations\": " << phase.allocations.count
+                << ", \"allocated_bytes\": " << phase.allocations.bytes;
+        }
+        out << "}";
+        separator = ",\n";
+    }
+    out << "\n  ]";
+    if (stats) {
+        out << ",\n  \"functions\": " << functions
+            << ",\n  \"string_constants\": " << string_constants
+            << ",\n  \"string_constant_bytes\": " << string_bytes
+            << ",\n  \"instructions\": " << instructions
+            << ",\n  \"peak_rss_bytes\": " << peak_rss()
+            << ",\n  \"ast_nodes\": ";
+        write_json_counts(out, nodes);
+        out << ",\n  \"opcodes\": ";
+        write_json_counts(out, opcodes);
+    }
+    out << "\n}\n";
+}
+
+} // namespace nust
@@ -2,16 +2,37 @@
 #include "parser/parser.h"
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
+#include <limits>
+#include <optional>
 
 namespace nust {
 
-Compiler::Compiler() : next_local_index(0) {}
+namespace {
+
+// Attributes the instructions emitted while it is alive to a node's span
+class SpanScope {
+public:
+    SpanScope(Span& current, Span span) : current(current), saved(current) { current = span; }
+    ~SpanScope() { current = saved; }
+    
+private:
+    Span& current;
+    Span saved;
+};
+
+} // namespace
+
+Compiler::Compiler(CompilerOptions options) : options(options), next_local_index(0) {}
 
 std::vector<Instruction> Compiler::compile(const Program& program) {
     // Reset state
     instructions.clear();
+    instruction_spans.clear();
     string_constants.clear();
-    local_vars.clear();
+    string_constant_indices.clear();
+    local_scopes.clear();
+    borrowed_locals.clear();
     next_local_index = 0;
     function_table = FunctionTable();
     
@@ -29,40 +50,87 @@ std::vector<Instruction> Compiler::compile(const Program& program) {
             compile_function(func);
             
             // Update function entry point in the table
-            const_cast<FunctionInfo&>(function_table.get_function(
+            function_table.get_function(
                 function_table.get_function_index(func->name)
-            )).entry_point = entry_point;
+            ).entry_point = entry_point;
         }
     }
     
+    std::vector<size_t> origins;
+    if (options.inline_functions) {
+        Inliner(options.inliner).run(instructions, function_table, &origins);
+        remap_spans(origins);
+    }
+    
+    if (options.superinstructions) {
+        SuperinstructionSelector().run(instructions, function_table, &origins);
+        remap_spans(origins);
+    }
+    
+    span_table = SpanTable::build(instruction_spans);
     return instructions;
 }
 
 void Compiler::compile_function(const FunctionDecl* func) {
     // Reset local variables for new function
-    local_vars.clear();
+    local_scopes.clear();
+    borrowed_locals.clear();
+    hoisted_exprs.clear();
+    induction_steps.clear();
+    counted_loops.clear();
     next_local_index = 0;
+    size_t func_start = instructions.size();
+    SpanScope span_scope(current_span, func->span);
     
     // Add parameters to local variables
+    enter_scope();
     for (const auto& param : func->params) {
-        local_vars[param.name] = next_local_index++;
+        declare_local(param.name);
     }
     
-    // Compile function body
-    compile_statement(func->body.get());
-    
-    // If function has no explicit return, add one
-    if (instructions.empty() || instructions.back().opcode != Opcode::RET_VAL) {
+    // Compile function body. A trailing expression is the function's result,
+    // matching how the type checker checks it against the return type.
+    auto body = dynamic_cast<const BlockStmt*>(func->body.get());
+    const ExprStmt* result = nullptr;
+    if (body && !body->statements.empty()) {
+        result = dynamic_cast<const ExprStmt*>(body->statements.back().get());
+    }
+    if (result) {
+        enter_scope();
+        for (size_t i = 0; i + 1 < body->statements.size(); ++i) {
+            compile_statement(body->statements[i].get());
+        }
+        auto call = dynamic_cast<const CallExpr*>(result->expr.get());
+        if (call && options.tail_calls) {
+            compile_tail_call(call, func, func_start);
+        } else {
+            compile_expression(result->expr.get());
+            emit(Instruction{Opcode::RET_VAL});
+        }
+        exit_scope();
+    } else {
+        // The function has no result, so add a plain return
+        compile_statement(func->body.get());
         emit(Instruction{Opcode::RET});
     }
+    exit_scope();
     
     // Update number of locals in function table
-    const_cast<FunctionInfo&>(function_table.get_function(
-        function_table.get_function_index(func->name)
-    )).num_locals = next_local_index;
+    auto& info = function_table.get_function(function_table.get_function_index(func->name));
+    info.num_locals = allocate_local_slots(func_start, func->params.size());
+    
+    // The counter's final slot is known now, from the load the condition starts with
+    info.counted_loops.clear();
+    for (auto loop : counted_loops) {
+        loop.counter = instructions[loop.header].operand;
+        loop.header -= func_start;
+        loop.exit -= func_start;
+        info.counted_loops.push_back(loop);
+    }
 }
 
 void Compiler::compile_statement(const Stmt* stmt) {
+    SpanScope span_scope(current_span, stmt->span);
     if (auto let = dynamic_cast<const LetStmt*>(stmt)) {
         compile_let(let);
     } else if (auto if_stmt = dynamic_cast<const IfStmt*>(stmt)) {
@@ -82,17 +150,19 @@ void Compiler::compile_let(const LetStmt* stmt) {
     // Compile initializer expression
     compile_expression(stmt->init.get());
     
-    // Add variable to local variables if not already present
-    if (local_vars.find(stmt->name) == local_vars.end()) {
-        local_vars[stmt->name] = next_local_index++;
-    }
-    
-    // Store in local variable
-    size_t index = get_local_index(stmt->name);
+    // Each binding gets its own slot, so shadowing never clobbers an outer variable
+    size_t index = declare_local(stmt->name);
     emit(Instruction{Opcode::STORE, index});
 }
 
 void Compiler::compile_expression(const Expr* expr) {
+    SpanScope span_scope(current_span, expr->span);
+    auto hoisted = hoisted_exprs.find(expr);
+    if (hoisted != hoisted_exprs.end()) {
+        emit(Instruction{Opcode::LOAD, hoisted->second});
+        return;
+    }
+    
     if (auto binary = dynamic_cast<const BinaryExpr*>(expr)) {
         
         // Handle assignment
@@ -112,6 +182,14 @@ void Compiler::compile_expression(const Expr* expr) {
             
             // Load the value back for use in expressions
             emit(Instruction{Opcode::LOAD, index});
+            
+            compile_induction_steps(binary);
+            return;
+        }
+        
+        // Logical operators only evaluate their right side when needed
+        if (binary->op == BinaryExpr::Op::And || binary->op == BinaryExpr::Op::Or) {
+            compile_logical(binary);
             return;
         }
         
@@ -149,12 +227,6 @@ void Compiler::compile_expression(const Expr* expr) {
             case BinaryExpr::Op::Ge:
                 emit(Instruction{Opcode::GE_I32});
                 break;
-            case BinaryExpr::Op::And:
-                emit(Instruction{Opcode::AND});
-                break;
-            case BinaryExpr::Op::Or:
-                emit(Instruction{Opcode::OR});
-                break;
             default:
                 throw std::runtime_error("Unknown binary operator");
         }
@@ -173,9 +245,7 @@ void Compiler::compile_expression(const Expr* expr) {
     } else if (auto bool_lit = dynamic_cast<const BoolLiteral*>(expr)) {
         emit(Instruction{Opcode::PUSH_BOOL, static_cast<size_t>(bool_lit->value)});
     } else if (auto str_lit = dynamic_cast<const StringLiteral*>(expr)) {
-        size_t index = string_constants.size();
-        string_constants.push_back(str_lit->value);
-        emit(Instruction{Opcode::PUSH_STR, index});
+        emit(Instruction{Opcode::PUSH_STR, add_constant(str_lit->value)});
     } else if (auto ident = dynamic_cast<const Identifier*>(expr)) {
         compile_identifier(ident);
     } else if (auto call = dynamic_cast<const CallExpr*>(expr)) {
@@ -185,6 +255,60 @@ void Compiler::compile_expression(const Expr* expr) {
     }
 }
 
+void Compiler::compile_logical(const BinaryExpr* expr) {
+    // The left operand is the result unless it fails to decide the outcome:
+    //   a && b  =>  a; DUP; JMP_IF_NOT end; POP; b; end:
+    //   a || b  =>  a; DUP; JMP_IF end; POP; b; end:
+    compile_expression(expr->left.get());
+    emit(Instruction{Opcode::DUP});
+    size_t end_jump = emit_instruction(
+        expr->op == BinaryExpr::Op::And ? Opcode::JMP_IF_NOT : Opcode::JMP_IF, 0);
+    emit(Instruction{Opcode::POP});
+    compile_expression(expr->right.get());
+    instructions[end_jump].operand = instructions.size();
+}
+
+void Compiler::compile_condition(const Expr* expr, bool jump_if, std::vector<size_t>& jumps) {
+    SpanScope span_scope(current_span, expr->span);
+    if (auto binary = dynamic_cast<const BinaryExpr*>(expr)) {
+        bool is_and = binary->op == BinaryExpr::Op::And;
+        if (is_and || binary->op == BinaryExpr::Op::Or) {
+            // When the left side alone decides the outcome in the direction we
+            // branch on (false for &&, true for ||), it jumps straight to the
+            // target; otherwise it skips to the fall-through past the right side
+            if (is_and != jump_if) {
+                compile_condition(binary->left.get(), jump_if, jumps);
+                compile_condition(binary->right.get(), jump_if, jumps);
+            } else {
+                std::vector<size_t> skip;
+                compile_condition(binary->left.get(), !jump_if, skip);
+                compile_condition(binary->right.get(), jump_if, jumps);
+                patch_jumps(skip, instructions.size());
+            }
+            return;
+        }
+    } else if (auto unary = dynamic_cast<const UnaryExpr*>(expr)) {
+        if (unary->op == UnaryExpr::Op::Not) {
+            compile_condition(unary->expr.get(), !jump_if, jumps);
+            return;
+        }
+    } else if (auto bool_lit = dynamic_cast<const BoolLiteral*>(expr)) {
+        if (bool_lit->value == jump_if) {
+            jumps.push_back(emit_instruction(Opcode::JMP, 0));
+        }
+        return;
+    }
+    
+    compile_expression(expr);
+    jumps.push_back(emit_instruction(jump_if ? Opcode::JMP_IF : Opcode::JMP_IF_NOT, 0));
+}
+
+void Compiler::patch_jumps(const std::vector<size_t>& jumps, size_t target) {
+    for (size_t jump : jumps) {
+        instructions[jump].operand = target;
+    }
+}
+
 void Compiler::compile_identifier(const Identifier* ident) {
     size_t index = get_local_index(ident->name);
     emit(Instruction{Opcode::LOAD, index});
@@ -207,22 +331,50 @@ void Compiler::compile_call(const CallExpr* expr) {
     emit(Instruction{Opcode::CALL, func_index});
 }
 
-void Compiler::compile_borrow(const BorrowExpr* expr) {
-    compile_expression(expr->expr.get());
+void Compiler::compile_tail_call(const CallExpr* expr, const FunctionDecl* func, size_t func_start) {
+    for (auto it = expr->args.rbegin(); it != expr->args.rend(); ++it) {
+        compile_expression((*it).get());
+    }
     
-    if (expr->is_mut) {
-        emit(Instruction{Opcode::BORROW_MUT});
+    auto* callee = dynamic_cast<const Identifier*>(expr->callee.get());
+    if (!callee) {
+        throw std::runtime_error("Function callee must be an identifier");
+    }
+    
+    if (callee->name == func->name) {
+        // Direct self-recursion becomes a loop: the first argument is on top,
+        // and parameter i lives in slot i
+        for (size_t i = 0; i < func->params.size(); ++i) {
+            emit(Instruction{Opcode::STORE, i});
+        }
+        emit(Instruction{Opcode::JMP, func_start});
     } else {
-        emit(Instruction{Opcode::BORROW});
+        // The callee's RET_VAL returns straight to our caller
+        emit(Instruction{Opcode::TAIL_CALL, function_table.get_function_index(callee->name)});
     }
 }
 
-void Compiler::compile_if(const IfStmt* if_stmt) {
-    // Compile condition
-    compile_expression(if_stmt->condition.get());
+void Compiler::compile_borrow(const BorrowExpr* expr) {
+    // A reference is the address of a slot, which must outlive any reference
+    // to it, so a borrowed slot is never shared
+    if (auto ident = dynamic_cast<const Identifier*>(expr->expr.get())) {
+        size_t index = get_local_index(ident->name);
+        borrowed_locals[index] = true;
+        emit(Instruction{Opcode::LOAD_REF, index});
+        return;
+    }
     
-    // Emit conditional jump
-    size_t else_jump = emit_instruction(Opcode::JMP_IF_NOT, 0);
+    // Anything else is a temporary that gets a slot of its own
+    size_t temp = declare_temp();
+    borrowed_locals[temp] = true;
+    compile_expression(expr->expr.get());
+    emit(Instruction{expr->is_mut ? Opcode::BORROW_MUT : Opcode::BORROW, temp});
+}
+
+void Compiler::compile_if(const IfStmt* if_stmt) {
+    // Compile condition, branching to the else branch when it is false
+    std::vector<size_t> else_jumps;
+    compile_condition(if_stmt->condition.get(), false, else_jumps);
     
     // Compile then branch
     compile_statement(if_stmt->then_branch.get());
@@ -233,8 +385,8 @@ void Compiler::compile_if(const IfStmt* if_stmt) {
         end_jump = emit_instruction(Opcode::JMP, 0);
     }
     
-    // Update else jump offset
-    instructions[else_jump].operand = instructions.size();
+    // Update else jump offsets
+    patch_jumps(else_jumps, instructions.size());
     
     // Compile else branch if present
     if (if_stmt->else_branch) {
@@ -245,15 +397,18 @@ void Compiler::compile_if(const IfStmt* if_stmt) {
 }
 
 void Compiler::compile_while(const WhileStmt* while_stmt) {
+    std::optional<LoopAnalysis> analysis;
+    if (options.loop_optimizations) {
+        analysis.emplace(*while_stmt);
+        compile_loop_preheader(*analysis);
+    }
+    
     // Save loop start position
     size_t loop_start = instructions.size();
     
-    // Compile condition
-    compile_expression(while_stmt->condition.get());
-    
-    // Emit conditional jump
-    size_t exit_jump = emit_instruction(Opcode::JMP_IF_NOT, 0);
-    
+    // Compile condition, branching out of the loop when it is false
+    std::vector<size_t> exit_jumps;
+    compile_condition(while_stmt->condition.get(), false, exit_jumps);
     
     // Compile body
     compile_statement(while_stmt->body.get());
@@ -261,37 +416,234 @@ void Compiler::compile_while(const WhileStmt* while_stmt) {
     // Emit jump back to condition
     emit_instruction(Opcode::JMP, loop_start);
     
-    // Update exit jump offset
-    instructions[exit_jump].operand = instructions.size();
+    // Update exit jump offsets
+    patch_jumps(exit_jumps, instructions.size());
+    
+    if (analysis && analysis->is_counted()) {
+        auto cond = static_cast<const BinaryExpr*>(while_stmt->condition.get());
+        auto counter = static_cast<const Identifier*>(cond->left.get());
+        const auto* update = analysis->induction_variables().at(counter->name).front();
+        counted_loops.push_back(CountedLoop{
+            loop_start,
+            instructions.size(),
+            0,  // Filled in once slots are allocated
+            LoopAnalysis::step_of(*update),
+            cond->op == BinaryExpr::Op::Le
+        });
+    }
+}
+
+void Compiler::compile_loop_preheader(const LoopAnalysis& analysis) {
+    // An enclosing loop may already have hoisted some of these
+    for (const Expr* expr : analysis.invariant_exprs()) {
+        if (hoisted_exprs.count(expr)) {
+            continue;
+        }
+        compile_expression(expr);
+        size_t slot = declare_temp();
+        emit(Instruction{Opcode::STORE, slot});
+        hoisted_exprs[expr] = slot;
+    }
+    
+    // Strength reduction: each i * k becomes a running value that starts at
+    // i * k and is bumped by c * k whenever i is bumped by c
+    for (const auto& derived : analysis.derived_inductions()) {
+        if (hoisted_exprs.count(derived.uses.front())) {
+            continue;
+        }
+        compile_expression(derived.uses.front());
+        size_t slot = declare_temp();
+        emit(Instruction{Opcode::STORE, slot});
+        for (const BinaryExpr* use : derived.uses) {
+            hoisted_exprs[use] = slot;
+        }
+        for (const BinaryExpr* update : analysis.induction_variables().at(derived.variable)) {
+            induction_steps[update].push_back(InductionStep{slot, derived.factor});
+        }
+    }
+}
+
+void Compiler::compile_induction_steps(const BinaryExpr* update) {
+    auto steps = induction_steps.find(update);
+    if (steps == induction_steps.end()) {
+        return;
+    }
+    
+    int step = LoopAnalysis::step_of(*update);
+    for (const auto& derived : steps->second) {
+        emit(Instruction{Opcode::LOAD, derived.slot});
+        
+        // Push |c * k| and add or subtract it, wrapping like the VM does
+        int64_t delta;
+        if (auto lit = dynamic_cast<const IntLiteral*>(derived.factor)) {
+            delta = static_cast<int32_t>(static_cast<uint32_t>(step) * static_cast<uint32_t>(lit->value));
+            emit(Instruction{Opcode::PUSH_I32, static_cast<size_t>(delta < 0 ? -delta : delta)});
+        } else {
+            delta = step;
+            compile_expression(derived.factor);
+            if (step != 1 && step != -1) {
+                emit(Instruction{Opcode::PUSH_I32, static_cast<size_t>(delta < 0 ? -delta : delta)});
+                emit(Instruction{Opcode::MUL_I32});
+            }
+        }
+        
+        emit(Instruction{delta < 0 ? Opcode::SUB_I32 : Opcode::ADD_I32});
+        emit(Instruction{Opcode::STORE, derived.slot});
+    }
 }
 
 void Compiler::compile_block(const BlockStmt* block) {
+    enter_scope();
     for (const auto& stmt : block->statements) {
         compile_statement(stmt.get());
     }
+    exit_scope();
 }
 
 void Compiler::emit(Instruction instr) {
     instructions.push_back(instr);
+    instruction_spans.push_back(current_span);
 }
 
 size_t Compiler::emit_instruction(Opcode opcode, size_t operand) {
     size_t index = instructions.size();
-    instructions.push_back(Instruction{opcode, operand});
+    emit(Instruction{opcode, operand});
     return index;
 }
 
+void Compiler::remap_spans(const std::vector<size_t>& origins) {
+    std::vector<Span> spans;
+    spans.reserve(origins.size());
+    for (size_t origin : origins) {
+        spans.push_back(instruction_spans[origin]);
+    }
+    instruction_spans = std::move(spans);
+}
+
 size_t Compiler::add_constant(const std::string& str) {
+    // Identical literals share one entry
+    auto it = string_constant_indices.find(str);
+    if (it != string_constant_indices.end()) {
+        return it->second;
+    }
     string_constants.push_back(str);
-    return string_constants.size() - 1;
+    return string_constant_indices[str] = string_constants.size() - 1;
 }
 
 size_t Compiler::get_local_index(const std::string& name) {
-    auto it = local_vars.find(name);
-    if (it == local_vars.end()) {
-        throw std::runtime_error("Undefined variable: " + name);
+    for (auto scope = local_scopes.rbegin(); scope != local_scopes.rend(); ++scope) {
+        auto it = scope->find(name);
+        if (it != scope->end()) {
+            return it->second;
+        }
     }
-    return it->second;
+    throw std::runtime_error("Undefined variable: " + name);
+}
+
+void Compiler::enter_scope() {
+    local_scopes.emplace_back();
+}
+
+void Compiler::exit_scope() {
+    local_scopes.pop_back();
+}
+
+size_t Compiler::declare_local(const std::string& name) {
+    size_t index = declare_temp();
+    local_scopes.back()[name] = index;
+    return index;
+}
+
+size_t Compiler::declare_temp() {
+    borrowed_locals.push_back(false);
+    return next_local_index++;
+}
+
+size_t Compiler::allocate_local_slots(size_t func_start, size_t num_params) {
+    const size_t func_end = instructions.size();
+    const size_t num_virtual = next_local_index;
+    std::vector<size_t> start(num_virtual, std::numeric_limits<size_t>::max());
+    std::vector<size_t> end(num_virtual, func_start);
+    
+    // Parameters are live from the entry point, since the caller fills them in
+    for (size_t i = 0; i < num_params; ++i) {
+        start[i] = func_start;
+    }
+    
+    // Initial intervals span from the first to the last access of each slot
+    for (size_t pc = func_start; pc < func_end; ++pc) {
+        const auto& instr = instructions[pc];
+        if (instr.is_local_access()) {
+            start[instr.operand] = std::min(start[instr.operand], pc);
+            end[instr.operand] = std::max(end[instr.operand], pc);
+        }
+    }
+    
+    // A value defined before a loop and used inside it must survive the whole
+    // loop, because the back edge reaches its uses again. Parameters count as
+    // defined before the first instruction, which may itself be a loop header.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t pc = func_start; pc < func_end; ++pc) {
+            const auto& instr = instructions[pc];
+            if (instr.opcode != Opcode::JMP || instr.operand >= pc) {
+                continue;
+            }
+            size_t loop_start = instr.operand;
+            for (size_t v = 0; v < num_virtual; ++v) {
+                bool defined_before = start[v] < loop_start || v < num_params;
+                if (defined_before && end[v] >= loop_start && end[v] < pc) {
+                    end[v] = pc;
+                    changed = true;
+                }
+            }
+        }
+    }
+    
+    for (size_t v = 0; v < num_virtual; ++v) {
+        if (borrowed_locals[v]) {
+            end[v] = func_end;
+        }
+    }
+    
+    // Greedy coloring in order of interval start is optimal for interval graphs:
+    // each binding takes the lowest slot whose current occupant is already dead
+    std::vector<size_t> order;
+    for (size_t v = num_params; v < num_virtual; ++v) {
+        order.push_back(v);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return start[a] < start[b];
+    });
+    
+    std::vector<size_t> slot_of(num_virtual);
+    std::vector<size_t> slot_end;
+    for (size_t i = 0; i < num_params; ++i) {
+        slot_of[i] = i;
+        slot_end.push_back(end[i]);
+    }
+    for (size_t v : order) {
+        size_t slot = 0;
+        while (slot < slot_end.size() && slot_end[slot] >= start[v]) {
+            ++slot;
+        }
+        if (slot == slot_end.size()) {
+            slot_end.push_back(end[v]);
+        } else {
+            slot_end[slot] = end[v];
+        }
+        slot_of[v] = slot;
+    }
+    
+    for (size_t pc = func_start; pc < func_end; ++pc) {
+        auto& instr = instructions[pc];
+        if (instr.is_local_access()) {
+            instr.operand = slot_of[instr.operand];
+        }
+    }
+    
+    return slot_end.size();
 }
 
 } // namespace nust 
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include "debug_info.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace nust {
+
+namespace {
+
+void write_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint64_t read_varint(const std::vector<uint8_t>& in, size_t& pos) {
+    uint64_t value = 0;
+    for (unsigned shift = 0; pos < in.size() && shift < 64; shift += 7) {
+        uint8_t byte = in[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Truncated span table");
+}
+
+} // namespace
+
+LineIndex::LineIndex(const std::string& source) : line_starts{0} {
+    for (size_t i = 0; i < source.size(); ++i) {
+        if (source[i] == '\n') {
+            line_starts.push_back(i + 1);
+        }
+    }
+}
+
+SourceLocation LineIndex::locate(size_t offset) const {
+    auto next = std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+    size_t line = static_cast<size_t>(next - line_starts.begin());
+    return SourceLocation{line, offset - line_starts[line - 1] + 1};
+}
+
+SpanTable SpanTable::build(const std::vector<Span>& spans) {
+    std::vector<uint8_t> bytes;
+    size_t last_pc = 0;
+    size_t last_start = 0;
+    for (size_t pc = 0; pc < spans.size(); ++pc) {
+        const Span& span = spans[pc];
+        if (pc > 0 && span.start == spans[pc - 1].start && span.end == spans[pc - 1].end) {
+            continue;
+        }
+        int64_t delta = static_cast<int64_t>(span.start) - static_cast<int64_t>(last_start);
+        write_varint(bytes, pc - last_pc);
+        write_varint(bytes, (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+        write_varint(bytes, span.end - span.start);
+        last_pc = pc;
+        last_start = span.start;
+    }
+    // The number of instructions closes the last run
+    if (!spans.empty()) {
+        write_varint(bytes, spans.size() - last_pc);
+    }
+    return SpanTable(std::move(bytes));
+}
+
+void SpanTable::decode() const {
+    size_t pos = 0;
+    size_t pc = 0;
+    size_t start = 0;
+    runs.clear();
+    while (pos < bytes.size()) {
+        pc += read_varint(bytes, pos);
+        if (pos == bytes.size()) {
+            break;  // Past the last instruction
+        }
+        uint64_t zigzag = read_varint(bytes, pos);
+        start += static_cast<size_t>((zigzag >> 1) ^ (0 - (zigzag & 1)));
+        size_t length = read_varint(bytes, pos);
+        runs.push_back(Run{pc, start, start + length});
+    }
+    end_pc = pc;
+    decoded = true;
+}
+
+std::optional<Span> SpanTable::find(size_t pc) const {
+    if (!decoded) {
+        decode();
+    }
+    if (pc >= end_pc) {
+        return std::nullopt;
+    }
+    auto next = std::upper_bound(runs.begin(), runs.end(), pc,
+                                 [](size_t pc, const Run& run) { return pc < run.pc; });
+    if (next == runs.begin()) {
+        return std::nullopt;
+    }
+    const Run& run = *(next - 1);
+    return Span(run.start, run.end);
+}
+
+void SpanTable::write_section(std::ostream& out) const {
+    out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    uint32_t size = static_cast<uint32_t>(bytes.size());
+    for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+        out << static_cast<uint8_t>((size >> (i * 8)) & 0xFF);
+    }
+    out.write(SECTION_MAGIC, sizeof(SECTION_MAGIC));
+}
+
+SpanTable SpanTable::read_section(std::istream& in) {
+    std::streampos saved = in.tellg();
+    constexpr std::streamoff trailer = sizeof(uint32_t) + sizeof(SECTION_MAGIC);
+    in.seekg(0, std::ios::end);
+    std::streamoff file_size = in.tellg();
+    SpanTable table;
+    if (file_size >= trailer) {
+        uint8_t tail[trailer];
+        in.seekg(file_size - trailer);
+        in.read(reinterpret_cast<char*>(tail), trailer);
+        uint32_t size = 0;
+        for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+            size |= static_cast<uint32_t>(tail[i]) << (i * 8);
+        }
+        if (in && std::equal(SECTION_MAGIC, SECTION_MAGIC + sizeof(SECTION_MAGIC),
+                             reinterpret_cast<const char*>(tail) + sizeof(uint32_t)) &&
+            size <= file_size - trailer) {
+            table.bytes.resize(size);
+            in.seekg(file_size - trailer - size);
+            in.read(reinterpret_cast<char*>(table.bytes.data()), size);
+        }
+    }
+    in.clear();
+    in.seekg(saved);
+    return table;
+}
+
+std::optional<SourceLocation> SourceMap::locate(size_t pc) const {
+    if (auto span = spans.find(pc)) {
+        return lines.locate(span->start);
+    }
+    return std::nullopt;
+}
+
+} // namespace nust
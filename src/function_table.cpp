@@ -31,6 +31,13 @@ const FunctionInfo& FunctionTable::get_function(size_t index) const {
     return functions[index];
 }
 
+FunctionInfo& FunctionTable::get_function(size_t index) {
+    if (index >= functions.size()) {
+        throw std::runtime_error("Invalid function index");
+    }
+    return functions[index];
+}
+
 size_t FunctionTable::get_function_index(const std::string& name) const {
     auto it = name_to_index.find(name);
     if (it == name_to_index.end()) {
@@ -0,0 +1,176 @@
+#include "inliner.h"
+#include <algorithm>
+#include <numeric>
+
+namespace nust {
+
+Inliner::Inliner(InlinerOptions options) : options(options) {}
+
+void Inliner::run(std::vector<Instruction>& instructions, FunctionTable& function_table,
+                  std::vector<size_t>* origins) {
+    table = &function_table;
+    bodies.assign(function_table.size(), {});
+    body_starts.assign(function_table.size(), 0);
+    inline_stack.clear();
+    
+    // Functions are laid out back to back, so each body ends where the next begins
+    std::vector<size_t> order(function_table.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return function_table.get_function(a).entry_point < function_table.get_function(b).entry_point;
+    });
+    for (size_t i = 0; i < order.size(); ++i) {
+        size_t start = function_table.get_function(order[i]).entry_point;
+        size_t end = i + 1 < order.size()
+            ? function_table.get_function(order[i + 1]).entry_point
+            : instructions.size();
+        auto& body = bodies[order[i]];
+        body_starts[order[i]] = start;
+        body.assign(instructions.begin() + start, instructions.begin() + end);
+        for (auto& instr : body) {
+            if (instr.is_jump()) {
+                instr.operand -= start;
+            }
+        }
+    }
+    
+    // Expand every function against the original bodies and frame sizes, then
+    // lay them out again
+    std::vector<Instruction> result;
+    std::vector<size_t> result_origins;
+    std::vector<size_t> entry_points(function_table.size());
+    std::vector<size_t> frame_sizes(function_table.size());
+    for (size_t func : order) {
+        frame_sizes[func] = function_table.get_function(func).num_locals;
+        std::vector<size_t> positions;
+        std::vector<size_t> code_origins;
+        inline_stack.push_back(func);
+        auto code = expand(func, 0, false, frame_sizes[func], code_origins, &positions);
+        inline_stack.pop_back();
+        
+        // Only the function's own loops are kept; those of inlined callees are
+        // no longer described by their metadata
+        for (auto& loop : function_table.get_function(func).counted_loops) {
+            loop.header = positions[loop.header];
+            loop.exit = positions[loop.exit];
+        }
+        
+        entry_points[func] = result.size();
+        for (auto& instr : code) {
+            if (instr.is_jump()) {
+                instr.operand += entry_points[func];
+            }
+            result.push_back(instr);
+        }
+        result_origins.insert(result_origins.end(), code_origins.begin(), code_origins.end());
+    }
+    
+    for (size_t func = 0; func < function_table.size(); ++func) {
+        function_table.get_function(func).entry_point = entry_points[func];
+        function_table.get_function(func).num_locals = frame_sizes[func];
+    }
+    instructions = std::move(result);
+    if (origins) {
+        *origins = std::move(result_origins);
+    }
+    table = nullptr;
+}
+
+size_t Inliner::cost(size_t func) const {
+    return bodies[func].size() - 1 + table->get_function(func).num_params;
+}
+
+bool Inliner::should_inline(size_t callee) const {
+    // The stack holds the root caller too, so this also stops recursion
+    if (inline_stack.size() > options.max_depth) {
+        return false;
+    }
+    if (std::find(inline_stack.begin(), inline_stack.end(), callee) != inline_stack.end()) {
+        return false;
+    }
+    return cost(callee) <= options.threshold;
+}
+
+std::vector<Instruction> Inliner::expand(size_t func, size_t base, bool inlined, size_t& frame_size,
+                                         std::vector<size_t>& origins, std::vector<size_t>* positions) {
+    const auto& body = bodies[func];
+    const auto& info = table->get_function(func);
+    frame_size = std::max(frame_size, base + info.num_locals);
+    
+    std::vector<Instruction> code;
+    std::vector<size_t> new_pos(body.size());
+    std::vector<size_t> jump_sites;
+    
+    for (size_t i = 0; i < body.size(); ++i) {
+        new_pos[i] = code.size();
+        Instruction instr = body[i];
+        size_t origin = body_starts[func] + i;
+        
+        // Every function ends in its only return; an inlined body leaves its
+        // result on the stack instead, with RET yielding the unit value
+        if (inlined && i + 1 == body.size() &&
+            (instr.opcode == Opcode::RET || instr.opcode == Opcode::RET_VAL)) {
+            if (instr.opcode == Opcode::RET) {
+                code.push_back(Instruction{Opcode::PUSH_I32, 0});
+                origins.push_back(origin);
+            }
+            break;
+        }
+        
+        // A tail call can't replace the frame of the function it was inlined
+        // into, so it becomes a plain call whose result falls through
+        bool tail_call = instr.opcode == Opcode::TAIL_CALL;
+        if (tail_call && inlined) {
+            instr.opcode = Opcode::CALL;
+            tail_call = false;
+        }
+        
+        if ((instr.opcode == Opcode::CALL || tail_call) && should_inline(instr.operand)) {
+            size_t callee = instr.operand;
+            size_t callee_base = base + info.num_locals;
+            
+            // Arguments are pushed right to left, so the first one is on top
+            size_t num_params = table->get_function(callee).num_params;
+            for (size_t param = 0; param < num_params; ++param) {
+                code.push_back(Instruction{Opcode::STORE, callee_base + param});
+                origins.push_back(origin);
+            }
+            
+            inline_stack.push_back(callee);
+            auto inlined_code = expand(callee, callee_base, true, frame_size, origins);
+            inline_stack.pop_back();
+            
+            size_t offset = code.size();
+            for (auto inner : inlined_code) {
+                if (inner.is_jump()) {
+                    inner.operand += offset;
+                }
+                code.push_back(inner);
+            }
+            if (tail_call) {
+                code.push_back(Instruction{Opcode::RET_VAL});
+                origins.push_back(origin);
+            }
+            continue;
+        }
+        
+        if (instr.is_local_access()) {
+            instr.operand += base;
+        } else if (instr.is_jump()) {
+            jump_sites.push_back(code.size());
+        }
+        code.push_back(instr);
+        origins.push_back(origin);
+    }
+    
+    // Jumps to the dropped return land on whatever replaced it
+    for (size_t site : jump_sites) {
+        code[site].operand = new_pos[code[site].operand];
+    }
+    if (positions) {
+        *positions = std::move(new_pos);
+    }
+    return code;
+}
+
+} // namespace nust
@@ -0,0 +1,497 @@
+#include "jit.h"
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <numeric>
+
+#if NUST_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+namespace nust {
+
+namespace {
+
+// x86-64 general purpose registers, numbered as in their encoding
+enum Reg { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// Condition codes of jcc/setcc; flipping the low bit negates one
+enum Cond : uint8_t { CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+// Group 1 ALU operations, numbered as their /digit in the immediate forms
+enum Alu : uint8_t { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+
+// Callee-saved registers hold the most used locals, caller-saved ones the
+// lowest stack positions. RAX and RDX are scratch (and used by idiv); RDI
+// points at the frame.
+const int LOCAL_REGS[] = {RBX, R12, R13, R14, R15};
+const int STACK_REGS[] = {RCX, RSI, R8, R9, R10, R11};
+const size_t NUM_LOCAL_REGS = sizeof(LOCAL_REGS) / sizeof(LOCAL_REGS[0]);
+const size_t NUM_STACK_REGS = sizeof(STACK_REGS) / sizeof(STACK_REGS[0]);
+
+// A 32-bit operand: a register or the dword at [rdi + disp]
+struct Loc {
+    bool is_reg;
+    int reg;
+    int32_t disp;
+
+    static Loc in_reg(int reg) { return Loc{true, reg, 0}; }
+    static Loc in_frame(size_t slot) { return Loc{false, 0, static_cast<int32_t>(slot * sizeof(int32_t))}; }
+
+    bool operator==(const Loc& other) const {
+        return is_reg == other.is_reg && (is_reg ? reg == other.reg : disp == other.disp);
+    }
+};
+
+class Assembler {
+public:
+    std::vector<uint8_t> code;
+
+    size_t new_label() {
+        labels.push_back(SIZE_MAX);
+        return labels.size() - 1;
+    }
+    void bind(size_t label) { labels[label] = code.size(); }
+
+    void jump(size_t label) {
+        byte(0xE9);
+        fixup(label);
+    }
+    void jump_if(Cond cc, size_t label) {
+        byte(0x0F);
+        byte(0x80 | cc);
+        fixup(label);
+    }
+
+    // Resolve the rel32 of every jump
+    void link() {
+        for (const auto& [pos, label] : fixups) {
+            int32_t rel = static_cast<int32_t>(labels[label] - (pos + 4));
+            std::memcpy(&code[pos], &rel, sizeof(rel));
+        }
+    }
+
+    void mov(Loc dst, Loc src) {
+        if (dst == src) {
+            return;
+        }
+        if (src.is_reg) {
+            modrm({0x89}, src.reg, dst);
+        } else if (dst.is_reg) {
+            modrm({0x8B}, dst.reg, src);
+        } else {
+            modrm({0x8B}, RDX, src);
+            modrm({0x89}, RDX, dst);
+        }
+    }
+    void mov(Loc dst, int32_t imm) {
+        modrm({0xC7}, 0, dst);
+        dword(imm);
+    }
+
+    // dst = dst op src, or just the flags of dst - src for ALU_CMP
+    void alu(Alu op, Loc dst, Loc src) {
+        if (src.is_reg) {
+            modrm({static_cast<uint8_t>(op * 8 + 1)}, src.reg, dst);
+        } else if (dst.is_reg) {
+            modrm({static_cast<uint8_t>(op * 8 + 3)}, dst.reg, src);
+        } else {
+            modrm({0x8B}, RAX, src);
+            modrm({static_cast<uint8_t>(op * 8 + 1)}, RAX, dst);
+        }
+    }
+    void alu(Alu op, Loc dst, int32_t imm) {
+        modrm({0x81}, op, dst);
+        dword(imm);
+    }
+
+    void imul(Loc dst, Loc src) {
+        if (dst.is_reg) {
+            modrm({0x0F, 0xAF}, dst.reg, src);
+        } else {
+            mov(Loc::in_reg(RAX), dst);
+            modrm({0x0F, 0xAF}, RAX, src);
+            mov(dst, Loc::in_reg(RAX));
+        }
+    }
+    void neg(Loc dst) { modrm({0xF7}, 3, dst); }
+
+    // eax = eax / src, with the dividend sign-extended into edx
+    void idiv(Loc src) {
+        byte(0x99);
+        modrm({0xF7}, 7, src);
+    }
+
+    // dst = 1 if the flags satisfy cc, else 0
+    void setcc(Cond cc, Loc dst) {
+        byte(0x0F);
+        byte(0x90 | cc);
+        byte(0xC0);  // al
+        byte(0x0F);
+        byte(0xB6);
+        byte(0xC0);  // movzx eax, al
+        mov(dst, Loc::in_reg(RAX));
+    }
+
+    void push(int reg) {
+        if (reg & 8) byte(0x41);
+        byte(0x50 | (reg & 7));
+    }
+    void pop(int reg) {
+        if (reg & 8) byte(0x41);
+        byte(0x58 | (reg & 7));
+    }
+    void ret() { byte(0xC3); }
+
+private:
+    void byte(uint8_t value) { code.push_back(value); }
+    void dword(int32_t value) {
+        for (size_t i = 0; i < sizeof(value); ++i) {
+            byte(static_cast<uint8_t>(static_cast<uint32_t>(value) >> (i * 8)));
+        }
+    }
+    void fixup(size_t label) {
+        fixups.emplace_back(code.size(), label);
+        dword(0);
+    }
+
+    // An instruction with a ModRM byte, `reg` being its register or /digit field
+    void modrm(std::initializer_list<uint8_t> opcode, int reg, Loc rm) {
+        uint8_t rex = 0x40 | ((reg & 8) ? 0x4 : 0) | ((rm.is_reg && (rm.reg & 8)) ? 0x1 : 0);
+        if (rex != 0x40) {
+            byte(rex);
+        }
+        for (uint8_t b : opcode) {
+            byte(b);
+        }
+        if (rm.is_reg) {
+            byte(0xC0 | ((reg & 7) << 3) | (rm.reg & 7));
+        } else {
+            byte(0x80 | ((reg & 7) << 3) | RDI);
+            dword(rm.disp);
+        }
+    }
+
+    std::vector<size_t> labels;
+    std::vector<std::pair<size_t, size_t>> fixups;  // rel32 position and label
+};
+
+NativeType native_type(SlotType type) {
+    return type == SlotType::Bool ? NativeType::Bool : NativeType::Int;
+}
+
+} // namespace
+
+JitFunction::~JitFunction() {
+#if NUST_JIT_SUPPORTED
+    if (code) {
+        munmap(code, code_size);
+    }
+#endif
+}
+
+JitFunction::Entry JitFunction::entry(size_t pc) const {
+    auto it = entries.find(pc);
+    if (it == entries.end()) {
+        return nullptr;
+    }
+    return reinterpret_cast<Entry>(static_cast<uint8_t*>(code) + it->second);
+}
+
+JitCompiler::JitCompiler(const std::vector<Instruction>& instructions, const FunctionTable& function_table)
+    : instructions(instructions), verifier(instructions, function_table) {}
+
+std::unique_ptr<JitFunction> JitCompiler::compile(size_t func_index) const {
+    if (!supported()) {
+        return nullptr;
+    }
+    auto analysis = verifier.verify_function(func_index);
+    if (!analysis) {
+        return nullptr;
+    }
+    const size_t start = analysis->start;
+    const size_t end = analysis->end;
+    const size_t num_locals = analysis->num_locals;
+    auto state_at = [&](size_t pc) -> const std::optional<SlotState>& { return analysis->states[pc - start]; };
+
+    std::unique_ptr<JitFunction> function(new JitFunction());
+    function->num_slots = std::max<size_t>(analysis->frame_size(), 1);
+
+    // Give registers to the locals referenced most often
+    std::vector<size_t> uses(num_locals, 0);
+    std::vector<bool> is_target(end - start, false);
+    for (size_t pc = start; pc < end; ++pc) {
+        const Instruction& instr = instructions[pc];
+        if (!state_at(pc)) {
+            continue;
+        }
+        if (instr.is_local_access() || instr.opcode == Opcode::ADD_LL || instr.opcode == Opcode::ADD_LI ||
+            instr.opcode == Opcode::INC_LOCAL) {
+            uses[instr.operand]++;
+        }
+        if (instr.opcode == Opcode::ADD_LL || instr.opcode == Opcode::LT_LL_JMPNOT ||
+            instr.opcode == Opcode::LT_LI_JMPNOT) {
+            uses[instr.arg1]++;
+        }
+        if (instr.opcode == Opcode::LT_LL_JMPNOT) {
+            uses[instr.arg2]++;
+        }
+        if (instr.is_jump()) {
+            is_target[instr.operand - start] = true;
+        }
+    }
+    std::vector<size_t> by_uses(num_locals);
+    std::iota(by_uses.begin(), by_uses.end(), 0);
+    std::stable_sort(by_uses.begin(), by_uses.end(), [&](size_t a, size_t b) { return uses[a] > uses[b]; });
+    std::vector<Loc> local_homes(num_locals);
+    std::vector<std::pair<size_t, int>> local_regs;  // Locals kept in registers
+    for (size_t i = 0; i < num_locals; ++i) {
+        local_homes[i] = Loc::in_frame(i);
+    }
+    for (size_t i = 0; i < std::min(num_locals, NUM_LOCAL_REGS) && uses[by_uses[i]] > 0; ++i) {
+        local_homes[by_uses[i]] = Loc::in_reg(LOCAL_REGS[i]);
+        local_regs.emplace_back(by_uses[i], LOCAL_REGS[i]);
+    }
+    auto local = [&](size_t slot) { return local_homes[slot]; };
+    auto stack = [&](size_t position) {
+        return position < NUM_STACK_REGS ? Loc::in_reg(STACK_REGS[position])
+                                         : Loc::in_frame(num_locals + position);
+    };
+
+    Assembler a;
+    std::vector<size_t> labels(end - start);
+    for (auto& label : labels) {
+        label = a.new_label();
+    }
+    auto label = [&](size_t pc) { return labels[pc - start]; };
+    const size_t epilogue = a.new_label();
+
+    // Entry points: the function itself and its loop headers. Each loads the
+    // register homes from the frame and jumps into the body.
+    std::vector<size_t> entry_pcs{start};
+    for (size_t pc = start; pc < end; ++pc) {
+        const Instruction& instr = instructions[pc];
+        if (instr.is_jump() && instr.operand <= pc && state_at(pc)) {
+            entry_pcs.push_back(instr.operand);
+        }
+    }
+    for (size_t target : entry_pcs) {
+        if (function->entries.count(target)) {
+            continue;
+        }
+        function->entries[target] = a.code.size();
+        for (int reg : LOCAL_REGS) {
+            a.push(reg);
+        }
+        for (const auto& [slot, reg] : local_regs) {
+            a.mov(Loc::in_reg(reg), Loc::in_frame(slot));
+        }
+        for (size_t d = 0; d < std::min(state_at(target)->stack.size(), NUM_STACK_REGS); ++d) {
+            a.mov(stack(d), Loc::in_frame(num_locals + d));
+        }
+        a.jump(label(target));
+    }
+    a.bind(epilogue);
+    for (size_t i = NUM_LOCAL_REGS; i-- > 0;) {
+        a.pop(LOCAL_REGS[i]);
+    }
+    a.ret();
+
+    // Exits back to the interpreter are emitted out of line after the body
+    struct PendingExit {
+        size_t label;
+        uint32_t index;
+        size_t depth;
+    };
+    std::vector<PendingExit> pending;
+    auto exit_to_interpreter = [&](size_t pc, const SlotState& state) {
+        JitExit exit{false, pc, {}};
+        for (SlotType type : state.locals) {
+            exit.types.push_back(native_type(type));
+        }
+        for (SlotType type : state.stack) {
+            exit.types.push_back(native_type(type));
+        }
+        function->exits.push_back(std::move(exit));
+        pending.push_back({a.new_label(), static_cast<uint32_t>(function->exits.size() - 1), state.stack.size()});
+        return pending.back().label;
+    };
+    auto return_from = [&](size_t pc, NativeType type) {
+        function->exits.push_back(JitExit{true, pc, {type}});
+        a.mov(Loc::in_reg(RAX), static_cast<int32_t>(function->exits.size() - 1));
+        a.jump(epilogue);
+    };
+
+    for (size_t pc = start; pc < end; ++pc) {
+        a.bind(label(pc));
+        if (!state_at(pc)) {
+            continue;
+        }
+        const SlotState& state = *state_at(pc);
+        const Instruction& instr = instructions[pc];
+        const size_t d = state.stack.size();
+
+        switch (instr.opcode) {
+            case Opcode::PUSH_I32:
+                a.mov(stack(d), static_cast<int32_t>(instr.operand));
+                break;
+            case Opcode::PUSH_BOOL:
+                a.mov(stack(d), instr.operand != 0 ? 1 : 0);
+                break;
+            case Opcode::POP:
+                break;
+            case Opcode::DUP:
+                a.mov(stack(d), stack(d - 1));
+                break;
+            case Opcode::SWAP:
+                a.mov(Loc::in_reg(RAX), stack(d - 2));
+                a.mov(stack(d - 2), stack(d - 1));
+                a.mov(stack(d - 1), Loc::in_reg(RAX));
+                break;
+            case Opcode::LOAD:
+                a.mov(stack(d), local(instr.operand));
+                break;
+            case Opcode::STORE:
+                a.mov(local(instr.operand), stack(d - 1));
+                break;
+            case Opcode::ADD_I32:
+                a.alu(ALU_ADD, stack(d - 2), stack(d - 1));
+                break;
+            case Opcode::SUB_I32:
+                a.alu(ALU_SUB, stack(d - 2), stack(d - 1));
+                break;
+            case Opcode::MUL_I32:
+                a.imul(stack(d - 2), stack(d - 1));
+                break;
+            case Opcode::DIV_I32: {
+                // The interpreter reports division by zero; -1 negates, as
+                // INT_MIN / -1 would trap in idiv
+                a.alu(ALU_CMP, stack(d - 1), 0);
+                a.jump_if(CC_E, exit_to_interpreter(pc, state));
+                size_t negate = a.new_label();
+                size_t done = a.new_label();
+                a.alu(ALU_CMP, stack(d - 1), -1);
+                a.jump_if(CC_E, negate);
+                a.mov(Loc::in_reg(RAX), stack(d - 2));
+                a.idiv(stack(d - 1));
+                a.mov(stack(d - 2), Loc::in_reg(RAX));
+                a.jump(done);
+                a.bind(negate);
+                a.neg(stack(d - 2));
+                a.bind(done);
+                break;
+            }
+            case Opcode::NEG_I32:
+                a.neg(stack(d - 1));
+                break;
+            case Opcode::EQ_I32:
+            case Opcode::NE_I32:
+            case Opcode::LT_I32:
+            case Opcode::GT_I32:
+            case Opcode::LE_I32:
+            case Opcode::GE_I32: {
+                Cond cc = instr.opcode == Opcode::EQ_I32 ? CC_E
+                        : instr.opcode == Opcode::NE_I32 ? CC_NE
+                        : instr.opcode == Opcode::LT_I32 ? CC_L
+                        : instr.opcode == Opcode::GT_I32 ? CC_G
+                        : instr.opcode == Opcode::LE_I32 ? CC_LE
+                        : CC_GE;
+                a.alu(ALU_CMP, stack(d - 2), stack(d - 1));
+                // Branch on the flags when the result only feeds a conditional jump
+                const Instruction* next = pc + 1 < end ? &instructions[pc + 1] : nullptr;
+                if (next && !is_target[pc + 1 - start] &&
+                    (next->opcode == Opcode::JMP_IF || next->opcode == Opcode::JMP_IF_NOT)) {
+                    if (next->opcode == Opcode::JMP_IF_NOT) {
+                        cc = static_cast<Cond>(cc ^ 1);
+                    }
+                    a.jump_if(cc, label(next->operand));
+                    ++pc;
+                } else {
+                    a.setcc(cc, stack(d - 2));
+                }
+                break;
+            }
+            case Opcode::AND:
+                a.alu(ALU_AND, stack(d - 2), stack(d - 1));
+                break;
+            case Opcode::OR:
+                a.alu(ALU_OR, stack(d - 2), stack(d - 1));
+                break;
+            case Opcode::NOT:
+                a.alu(ALU_XOR, stack(d - 1), 1);
+                break;
+            case Opcode::JMP:
+                a.jump(label(instr.operand));
+                break;
+            case Opcode::JMP_IF:
+            case Opcode::JMP_IF_NOT:
+                a.alu(ALU_CMP, stack(d - 1), 0);
+                a.jump_if(instr.opcode == Opcode::JMP_IF ? CC_NE : CC_E, label(instr.operand));
+                break;
+            case Opcode::CALL:
+            case Opcode::TAIL_CALL:
+                a.jump(exit_to_interpreter(pc, state));
+                break;
+            case Opcode::RET:
+                a.mov(Loc::in_frame(0), 0);
+                return_from(pc, NativeType::Int);
+                break;
+            case Opcode::RET_VAL:
+                a.mov(Loc::in_frame(0), stack(d - 1));
+                return_from(pc, native_type(state.stack.back()));
+                break;
+            case Opcode::ADD_LL:
+                a.mov(stack(d), local(instr.operand));
+                a.alu(ALU_ADD, stack(d), local(instr.arg1));
+                break;
+            case Opcode::ADD_LI:
+                a.mov(stack(d), local(instr.operand));
+                a.alu(ALU_ADD, stack(d), static_cast<int32_t>(instr.arg1));
+                break;
+            case Opcode::INC_LOCAL:
+                a.alu(ALU_ADD, local(instr.operand), static_cast<int32_t>(instr.arg1));
+                break;
+            case Opcode::LT_LL_JMPNOT:
+                a.alu(ALU_CMP, local(instr.arg1), local(instr.arg2));
+                a.jump_if(CC_GE, label(instr.operand));
+                break;
+            case Opcode::LT_LI_JMPNOT:
+                a.alu(ALU_CMP, local(instr.arg1), static_cast<int32_t>(instr.arg2));
+                a.jump_if(CC_GE, label(instr.operand));
+                break;
+            default:
+                return nullptr;
+        }
+    }
+
+    // Write the register homes back to the frame and report the exit
+    for (const auto& exit : pending) {
+        a.bind(exit.label);
+        for (const auto& [slot, reg] : local_regs) {
+            a.mov(Loc::in_frame(slot), Loc::in_reg(reg));
+        }
+        for (size_t d = 0; d < std::min(exit.depth, NUM_STACK_REGS); ++d) {
+            a.mov(Loc::in_frame(num_locals + d), stack(d));
+        }
+        a.mov(Loc::in_reg(RAX), static_cast<int32_t>(exit.index));
+        a.jump(epilogue);
+    }
+    a.link();
+
+#if NUST_JIT_SUPPORTED
+    void* memory = mmap(nullptr, a.code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    std::memcpy(memory, a.code.data(), a.code.size());
+    if (mprotect(memory, a.code.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, a.code.size());
+        return nullptr;
+    }
+    function->code = memory;
+    function->code_size = a.code.size();
+#endif
+    return function;
+}
+
+} // namespace nust
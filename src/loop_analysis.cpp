@@ -0,0 +1,269 @@
+#include "loop_analysis.h"
+
+namespace nust {
+
+namespace {
+
+bool is_trivial(const Expr& expr) {
+    return dynamic_cast<const IntLiteral*>(&expr) || dynamic_cast<const BoolLiteral*>(&expr) ||
+           dynamic_cast<const StringLiteral*>(&expr) || dynamic_cast<const Identifier*>(&expr);
+}
+
+const Identifier* as_identifier(const Expr* expr) {
+    return dynamic_cast<const Identifier*>(expr);
+}
+
+// Match `name = name + c` or `name = name - c` for an integer literal c
+bool is_induction_update(const BinaryExpr& assignment) {
+    auto target = as_identifier(assignment.left.get());
+    auto rhs = dynamic_cast<const BinaryExpr*>(assignment.right.get());
+    if (!target || !rhs || (rhs->op != BinaryExpr::Op::Add && rhs->op != BinaryExpr::Op::Sub)) {
+        return false;
+    }
+    auto operand = as_identifier(rhs->left.get());
+    return operand && operand->name == target->name &&
+           dynamic_cast<const IntLiteral*>(rhs->right.get());
+}
+
+// Key identifying the operands of a product, so that repeated occurrences of
+// the same `i * k` share a running value
+std::string factor_key(const Expr& factor) {
+    if (auto lit = dynamic_cast<const IntLiteral*>(&factor)) {
+        return "#" + std::to_string(lit->value);
+    }
+    return as_identifier(&factor)->name;
+}
+
+} // namespace
+
+LoopAnalysis::LoopAnalysis(const WhileStmt& loop) {
+    collect(*loop.condition);
+    collect(*loop.body);
+    
+    find_invariants(*loop.condition);
+    find_invariants(*loop.body);
+    
+    for (const auto& [name, updates] : assignments) {
+        if (declared.count(name) || borrowed.count(name)) {
+            continue;
+        }
+        bool all_updates = true;
+        for (auto update : updates) {
+            all_updates = all_updates && is_induction_update(*update);
+        }
+        if (all_updates) {
+            induction[name] = updates;
+        }
+    }
+    
+    if (!induction.empty()) {
+        find_induction(*loop.condition);
+        find_induction(*loop.body);
+    }
+    
+    if (auto cond = dynamic_cast<const BinaryExpr*>(loop.condition.get())) {
+        auto counter = as_identifier(cond->left.get());
+        if ((cond->op == BinaryExpr::Op::Lt || cond->op == BinaryExpr::Op::Le) && counter &&
+            is_invariant(*cond->right)) {
+            auto it = induction.find(counter->name);
+            counted = it != induction.end() && it->second.size() == 1 &&
+                      step_of(*it->second.front()) > 0;
+        }
+    }
+}
+
+bool LoopAnalysis::is_invariant(const Expr& expr) const {
+    if (auto ident = dynamic_cast<const Identifier*>(&expr)) {
+        return !is_modified(ident->name);
+    }
+    if (is_trivial(expr)) {
+        return true;
+    }
+    if (auto unary = dynamic_cast<const UnaryExpr*>(&expr)) {
+        return is_invariant(*unary->expr);
+    }
+    if (auto binary = dynamic_cast<const BinaryExpr*>(&expr)) {
+        if (binary->op == BinaryExpr::Op::Assignment) {
+            return false;
+        }
+        // Division may trap, and hoisting must not introduce a trap on a loop
+        // that never runs, so only a nonzero literal divisor is allowed
+        if (binary->op == BinaryExpr::Op::Div) {
+            auto divisor = dynamic_cast<const IntLiteral*>(binary->right.get());
+            if (!divisor || divisor->value == 0) {
+                return false;
+            }
+        }
+        return is_invariant(*binary->left) && is_invariant(*binary->right);
+    }
+    // Calls and borrows
+    return false;
+}
+
+int LoopAnalysis::step_of(const BinaryExpr& update) {
+    auto rhs = static_cast<const BinaryExpr*>(update.right.get());
+    int amount = static_cast<const IntLiteral*>(rhs->right.get())->value;
+    return rhs->op == BinaryExpr::Op::Add ? amount : -amount;
+}
+
+void LoopAnalysis::collect(const Stmt& stmt) {
+    if (auto let = dynamic_cast<const LetStmt*>(&stmt)) {
+        declared.insert(let->name);
+        collect(*let->init);
+    } else if (auto expr = dynamic_cast<const ExprStmt*>(&stmt)) {
+        collect(*expr->expr);
+    } else if (auto if_stmt = dynamic_cast<const IfStmt*>(&stmt)) {
+        collect(*if_stmt->condition);
+        collect(*if_stmt->then_branch);
+        if (if_stmt->else_branch) {
+            collect(*if_stmt->else_branch);
+        }
+    } else if (auto while_stmt = dynamic_cast<const WhileStmt*>(&stmt)) {
+        collect(*while_stmt->condition);
+        collect(*while_stmt->body);
+    } else if (auto block = dynamic_cast<const BlockStmt*>(&stmt)) {
+        for (const auto& inner : block->statements) {
+            collect(*inner);
+        }
+    }
+}
+
+void LoopAnalysis::collect(const Expr& expr) {
+    if (auto binary = dynamic_cast<const BinaryExpr*>(&expr)) {
+        if (binary->op == BinaryExpr::Op::Assignment) {
+            if (auto target = as_identifier(binary->left.get())) {
+                assigned.insert(target->name);
+                assignments[target->name].push_back(binary);
+            }
+        } else {
+            collect(*binary->left);
+        }
+        collect(*binary->right);
+    } else if (auto unary = dynamic_cast<const UnaryExpr*>(&expr)) {
+        collect(*unary->expr);
+    } else if (auto borrow = dynamic_cast<const BorrowExpr*>(&expr)) {
+        if (auto target = as_identifier(borrow->expr.get()); target && borrow->is_mut) {
+            borrowed.insert(target->name);
+        }
+        collect(*borrow->expr);
+    } else if (auto call = dynamic_cast<const CallExpr*>(&expr)) {
+        for (const auto& arg : call->args) {
+            collect(*arg);
+        }
+    }
+}
+
+void LoopAnalysis::find_invariants(const Stmt& stmt) {
+    if (auto let = dynamic_cast<const LetStmt*>(&stmt)) {
+        find_invariants(*let->init);
+    } else if (auto expr = dynamic_cast<const ExprStmt*>(&stmt)) {
+        find_invariants(*expr->expr);
+    } else if (auto if_stmt = dynamic_cast<const IfStmt*>(&stmt)) {
+        find_invariants(*if_stmt->condition);
+        find_invariants(*if_stmt->then_branch);
+        if (if_stmt->else_branch) {
+            find_invariants(*if_stmt->else_branch);
+        }
+    } else if (auto while_stmt = dynamic_cast<const WhileStmt*>(&stmt)) {
+        find_invariants(*while_stmt->condition);
+        find_invariants(*while_stmt->body);
+    } else if (auto block = dynamic_cast<const BlockStmt*>(&stmt)) {
+        for (const auto& inner : block->statements) {
+            find_invariants(*inner);
+        }
+    }
+}
+
+void LoopAnalysis::find_invariants(const Expr& expr) {
+    if (is_trivial(expr)) {
+        return;
+    }
+    if (is_invariant(expr)) {
+        invariants.push_back(&expr);
+        return;
+    }
+    if (auto binary = dynamic_cast<const BinaryExpr*>(&expr)) {
+        // The target of an assignment is not evaluated
+        if (binary->op != BinaryExpr::Op::Assignment) {
+            find_invariants(*binary->left);
+        }
+        find_invariants(*binary->right);
+    } else if (auto unary = dynamic_cast<const UnaryExpr*>(&expr)) {
+        find_invariants(*unary->expr);
+    } else if (auto borrow = dynamic_cast<const BorrowExpr*>(&expr)) {
+        find_invariants(*borrow->expr);
+    } else if (auto call = dynamic_cast<const CallExpr*>(&expr)) {
+        for (const auto& arg : call->args) {
+            find_invariants(*arg);
+        }
+    }
+}
+
+void LoopAnalysis::find_induction(const Stmt& stmt) {
+    if (auto let = dynamic_cast<const LetStmt*>(&stmt)) {
+        find_induction(*let->init);
+    } else if (auto expr = dynamic_cast<const ExprStmt*>(&stmt)) {
+        find_induction(*expr->expr);
+    } else if (auto if_stmt = dynamic_cast<const IfStmt*>(&stmt)) {
+        find_induction(*if_stmt->condition);
+        find_induction(*if_stmt->then_branch);
+        if (if_stmt->else_branch) {
+            find_induction(*if_stmt->else_branch);
+        }
+    } else if (auto while_stmt = dynamic_cast<const WhileStmt*>(&stmt)) {
+        find_induction(*while_stmt->condition);
+        find_induction(*while_stmt->body);
+    } else if (auto block = dynamic_cast<const BlockStmt*>(&stmt)) {
+        for (const auto& inner : block->statements) {
+            find_induction(*inner);
+        }
+    }
+}
+
+void LoopAnalysis::find_induction(const Expr& expr) {
+    auto binary = dynamic_cast<const BinaryExpr*>(&expr);
+    if (binary && binary->op == BinaryExpr::Op::Mul) {
+        // i * k or k * i, where k is a literal or an unmodified variable
+        const Identifier* variable = as_identifier(binary->left.get());
+        const Expr* factor = binary->right.get();
+        if (!variable || !induction.count(variable->name)) {
+            variable = as_identifier(binary->right.get());
+            factor = binary->left.get();
+        }
+        bool simple_factor = dynamic_cast<const IntLiteral*>(factor) ||
+                             (as_identifier(factor) && is_invariant(*factor));
+        if (variable && induction.count(variable->name) && simple_factor) {
+            std::string key = factor_key(*factor);
+            for (auto& candidate : derived) {
+                if (candidate.variable == variable->name && factor_key(*candidate.factor) == key) {
+                    candidate.uses.push_back(binary);
+                    return;
+                }
+            }
+            derived.push_back(DerivedInduction{variable->name, factor, {binary}});
+            return;
+        }
+    }
+    
+    if (binary) {
+        // The update itself (`i = i + c`) has no product in it
+        if (binary->op != BinaryExpr::Op::Assignment) {
+            find_induction(*binary->left);
+        }
+        find_induction(*binary->right);
+    } else if (auto unary = dynamic_cast<const UnaryExpr*>(&expr)) {
+        find_induction(*unary->expr);
+    } else if (auto borrow = dynamic_cast<const BorrowExpr*>(&expr)) {
+        find_induction(*borrow->expr);
+    } else if (auto call = dynamic_cast<const CallExpr*>(&expr)) {
+        for (const auto& arg : call->args) {
+            find_induction(*arg);
+        }
+    }
+}
+
+bool LoopAnalysis::is_modified(const std::string& name) const {
+    return assigned.count(name) || declared.count(name) || borrowed.count(name);
+}
+
+} // namespace nust
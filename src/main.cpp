@@ -1,49 +1,318 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <optional>
+#include <cstdlib>
+#include <new>
+#include <memory>
+#include <vector>
+#include <csignal>
+#include <charconv>
 #include "parser/parser.h"
 #include "type_checker.h"
 #include "compiler.h"
+#include "register_translator.h"
+#include "c_emitter.h"
+#include "debug_info.h"
+#include "compile_stats.h"
+#include "bytecode_writer.h"
+#include "session.h"
+#include "thread_pool.h"
+#include "compile_server.h"
+#include "source_file.h"
 
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <source_file>\n";
+namespace {
+
+// Set by --stats before anything else runs. Counting is off otherwise, so
+// threads in `nust build` don't contend on the shared counters.
+bool count_allocations = false;
+
+} // namespace
+
+// Count every allocation for --stats
+void* operator new(size_t size) {
+    if (count_allocations) {
+        nust::note_allocation(size);
+    }
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+namespace {
+
+// A whole command-line argument read as a count, or nothing if it isn't one
+std::optional<size_t> parse_count(const std::string& text) {
+    size_t value = 0;
+    const char* end = text.data() + text.size();
+    auto [stop, error] = std::from_chars(text.data(), end, value);
+    if (text.empty() || error != std::errc() || stop != end) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+// The path of `source_file` without its extension, to which each output's
+// extension is added
+std::string output_stem(const std::string& source_file) {
+    size_t dot_pos = source_file.find_last_of('.');
+    return dot_pos == std::string::npos ? source_file : source_file.substr(0, dot_pos);
+}
+
+// Compile one input of `nust build` and write its .ns and .no files, each
+// with a single write. Returns an error message, or an empty string.
+std::string build_file(nust::Session& session, const std::string& source_file, bool debug_info) {
+    nust::Module module;
+    try {
+        nust::SourceFile file(source_file);
+        module = session.compile(file.text());
+    } catch (const std::exception& e) {
+        return e.what();
+    }
+
+    std::string stem = output_stem(source_file);
+    std::ostringstream assembly;
+    nust::write_assembly(assembly, module.instructions);
+    std::ostringstream bytecode;
+    nust::write_bytecode(bytecode, module.instructions, debug_info ? &module.span_table : nullptr);
+    for (const auto& [path, contents] : {std::make_pair(stem + ".ns", assembly.str()),
+                                         std::make_pair(stem + ".no", bytecode.str())}) {
+        std::ofstream output(path, std::ios::binary);
+        if (!output.write(contents.data(), static_cast<std::streamsize>(contents.size()))) {
+            return "Failed to write output file: " + path;
+        }
+    }
+    return "";
+}
+
+// nust build: compile many files in one process, each worker thread with
+// its own session. Errors are reported in input order once all are done.
+int build(int argc, char* argv[]) {
+    nust::CompilerOptions options;
+    std::optional<size_t> inline_threshold;
+    bool debug_info = false;
+    size_t jobs = 0;
+    std::vector<std::string> inputs;
+    bool valid = true;
+    for (int i = 2; i < argc && valid; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-O") {
+            options = nust::CompilerOptions::optimized();
+        } else if (arg.rfind("--inline-threshold=", 0) == 0) {
+            inline_threshold = parse_count(arg.substr(arg.find('=') + 1));
+            valid = inline_threshold.has_value();
+        } else if (arg == "-g") {
+            debug_info = true;
+        } else if (arg == "-j" && i + 1 < argc) {
+            // -j 0 isn't accepted; leaving -j out uses every core
+            jobs = parse_count(argv[++i]).value_or(0);
+            valid = jobs > 0;
+        } else if (arg[0] == '@') {
+            // A file listing one input per line
+            std::ifstream list(arg.substr(1));
+            if (!list.is_open()) {
+                std::cerr << "Failed to open file: " << arg.substr(1) << "\n";
+                return 1;
+            }
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty()) {
+                    inputs.push_back(line);
+                }
+            }
+        } else if (arg[0] != '-') {
+            inputs.push_back(arg);
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid || inputs.empty()) {
+        std::cerr << "Usage: " << argv[0] << " build [-O] [--inline-threshold=N] [-g] [-j N]"
+                  << " <source_file|@list_file>...\n";
         return 1;
     }
+    if (inline_threshold) {
+        options.inline_functions = true;
+        options.inliner.threshold = *inline_threshold;
+    }
+
+    nust::ThreadPool pool(jobs);
+    std::vector<std::unique_ptr<nust::Session>> sessions(pool.size());
+    std::vector<std::string> errors(inputs.size());
+    pool.run(inputs.size(), [&](size_t index, size_t worker) {
+        if (!sessions[worker]) {
+            sessions[worker] = std::make_unique<nust::Session>(options);
+        }
+        errors[index] = build_file(*sessions[worker], inputs[index], debug_info);
+    });
+
+    int status = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (!errors[i].empty()) {
+            std::cerr << inputs[i] << ": " << errors[i] << "\n";
+            status = 1;
+        }
+    }
+    return status;
+}
+
+nust::CompileServer* running_server = nullptr;
+
+// Shut the server down cleanly on SIGINT and SIGTERM, removing its socket.
+// stop() only writes to a pipe, which is safe in a signal handler.
+void stop_server(int) {
+    running_server->stop();
+}
+
+// Have the server at `socket` compile the file, and write its .ns and .no
+// files as a local compile would
+int compile_remotely(const std::string& socket, const std::string& source_file, bool optimize, bool debug_info) {
+    try {
+        nust::SourceFile file(source_file);
+        nust::CompileResponse response =
+            nust::request_compile(socket, {optimize, debug_info, std::string(file.text())});
+        if (!response.ok) {
+            std::cerr << "Error: " << response.diagnostics << "\n";
+            return 1;
+        }
+        std::string stem = output_stem(source_file);
+        for (const auto& [path, contents] : {std::make_pair(stem + ".ns", &response.assembly),
+                                             std::make_pair(stem + ".no", &response.bytecode)}) {
+            std::ofstream output(path, std::ios::binary);
+            if (!output.write(contents->data(), static_cast<std::streamsize>(contents->size()))) {
+                std::cerr << "Failed to open output file: " << path << "\n";
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "build") {
+        return build(argc, argv);
+    }
+    if (argc == 3 && std::string(argv[1]) == "--server") {
+        try {
+            nust::CompileServer server;
+            running_server = &server;
+            std::signal(SIGINT, stop_server);
+            std::signal(SIGTERM, stop_server);
+            server.listen(argv[2]);
+            std::cerr << "Listening on " << argv[2] << "\n";
+            server.serve();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
     
-    // Read source file
-    std::ifstream file(argv[1]);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open file: " << argv[1] << "\n";
+    nust::CompilerOptions options;
+    bool optimize = false;
+    std::optional<size_t> inline_threshold;
+    bool emit_registers = false;
+    bool emit_c = false;
+    bool debug_info = false;
+    bool time_passes = false;
+    bool stats = false;
+    bool json = false;
+    const char* server_socket = nullptr;
+    const char* source_file = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-O") {
+            options = nust::CompilerOptions::optimized();
+            optimize = true;
+        } else if (arg.rfind("--inline-threshold=", 0) == 0) {
+            inline_threshold = parse_count(arg.substr(arg.find('=') + 1));
+            if (!inline_threshold) {
+                source_file = nullptr;
+                break;
+            }
+        } else if (arg == "--registers") {
+            emit_registers = true;
+        } else if (arg == "--emit-c") {
+            emit_c = true;
+        } else if (arg == "-g") {
+            debug_info = true;
+        } else if (arg == "--time-passes") {
+            time_passes = true;
+        } else if (arg == "--stats") {
+            stats = true;
+            count_allocations = true;
+        } else if (arg == "--json") {
+            json = true;
+        } else if (arg == "--client" && i + 1 < argc) {
+            server_socket = argv[++i];
+        } else if (!source_file && arg[0] != '-') {
+            source_file = argv[i];
+        } else {
+            source_file = nullptr;
+            break;
+        }
+    }
+    // The server compiles with the -O defaults and writes only .ns and .no
+    bool client_only = !inline_threshold && !emit_registers && !emit_c && !time_passes && !stats;
+    if (!source_file || (server_socket && !client_only)) {
+        std::cerr << "Usage: " << argv[0] << " [-O] [--inline-threshold=N] [--registers] [--emit-c] [-g]"
+                  << " [--time-passes] [--stats] [--json] <source_file>\n"
+                  << "       " << argv[0] << " build [-O] [--inline-threshold=N] [-g] [-j N]"
+                  << " <source_file|@list_file>...\n"
+                  << "       " << argv[0] << " --server <socket>\n"
+                  << "       " << argv[0] << " --client <socket> [-O] [-g] <source_file>\n";
         return 1;
     }
+    if (server_socket) {
+        return compile_remotely(server_socket, source_file, optimize, debug_info);
+    }
+    if (inline_threshold) {
+        options.inline_functions = true;
+        options.inliner.threshold = *inline_threshold;
+    }
     
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string source = buffer.str();
+    // Map the source file; the parser reads it in place
+    nust::CompileStats compile_stats;
+    std::optional<nust::SourceFile> file;
+    try {
+        compile_stats.measure("read", [&] { file.emplace(source_file); });
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
     
     try {
         // Parse source code
-        nust::Parser parser(source);
-        auto program = parser.parse();
+        nust::Parser parser(file->text());
+        auto program = compile_stats.measure("parse", [&] { return parser.parse(); });
         
         // Type check
         nust::TypeChecker type_checker;
-        if (!type_checker.check_program(*program)) {
+        if (!compile_stats.measure("typecheck", [&] { return type_checker.check_program(*program); })) {
             std::cerr << "Type checking failed\n";
             return 1;
         }
         
         // Compile to bytecode
-        nust::Compiler compiler;
-        auto instructions = compiler.compile(*program);
+        nust::Compiler compiler(options);
+        auto instructions = compile_stats.measure("compile", [&] { return compiler.compile(*program); });
 
         // get the filename without the extension
-        std::string filename = argv[1];
-        size_t dot_pos = filename.find_last_of('.');
-        if (dot_pos != std::string::npos) {
-            filename = filename.substr(0, dot_pos);
-        }
+        std::string filename = output_stem(source_file);
 
         // Output instructions as assembly to *.ns file
         std::ofstream output_asm_file(filename + std::string(".ns"));
@@ -51,14 +320,7 @@ int main(int argc, char* argv[]) {
             std::cerr << "Failed to open output file: " << filename + std::string(".s") << "\n";
             return 1;
         }
-        for (const auto& instr : instructions) {
-            output_asm_file << nust::opcode_to_string(instr.opcode);
-            if (instr.has_operand()) {
-                output_asm_file << " " << instr.operand;
-            }
-            output_asm_file << "\n";
-        }
-        
+        compile_stats.measure("write .ns", [&] { nust::write_assembly(output_asm_file, instructions); });
 
         // Output bytecode to *.no file
         std::ofstream output_bytecode_file(filename + std::string(".no"));
@@ -67,14 +329,45 @@ int main(int argc, char* argv[]) {
             return 1;
         }
         
-        for (const auto& instr : instructions) {
-            output_bytecode_file << static_cast<uint8_t>(instr.opcode);
-            if (instr.has_operand()) {
-                // Encode operand as little-endian
-                for (size_t i = 0; i < sizeof(size_t); ++i) {
-                    output_bytecode_file << static_cast<uint8_t>((instr.operand >> (i * 8)) & 0xFF);
-                }
+        compile_stats.measure("write .no", [&] {
+            nust::write_bytecode(output_bytecode_file, instructions,
+                                 debug_info ? &compiler.get_span_table() : nullptr);
+        });
+        
+        // Output the register machine translation to *.nr file
+        if (emit_registers) {
+            std::ofstream output_reg_file(filename + std::string(".nr"));
+            if (!output_reg_file.is_open()) {
+                std::cerr << "Failed to open output file: " << filename + std::string(".nr") << "\n";
+                return 1;
+            }
+            compile_stats.measure("write .nr", [&] {
+                nust::RegisterProgram reg_program = nust::RegisterTranslator().translate(
+                    instructions, compiler.get_function_table(), compiler.get_string_constants());
+                nust::write_register_code(output_reg_file, reg_program);
+            });
+        }
+        
+        // Output the program translated to C to *.c file
+        if (emit_c) {
+            std::ofstream output_c_file(filename + std::string(".c"));
+            if (!output_c_file.is_open()) {
+                std::cerr << "Failed to open output file: " << filename + std::string(".c") << "\n";
+                return 1;
             }
+            compile_stats.measure("write .c", [&] { output_c_file << nust::CEmitter().emit(*program); });
+        }
+        
+        if (stats) {
+            compile_stats.count_nodes(*program);
+            compile_stats.count_instructions(instructions);
+            compile_stats.set_function_count(compiler.get_function_table().size());
+            compile_stats.set_string_constants(compiler.get_string_constants());
+        }
+        if (json && (time_passes || stats)) {
+            compile_stats.write_json(std::cout, time_passes, stats);
+        } else if (time_passes || stats) {
+            compile_stats.write_text(std::cerr, time_passes, stats);
         }
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
@@ -6,8 +6,8 @@
 
 namespace nust {
 
-Parser::Parser(std::string source) 
-    : source(std::move(source)), current_scope(std::make_shared<Scope>()) {}
+Parser::Parser(std::string_view source) 
+    : source(source), current_scope(std::make_shared<Scope>()) {}
 
 std::unique_ptr<Program> Parser::parse() {
     std::vector<std::unique_ptr<ASTNode>> items;
@@ -131,6 +131,7 @@ std::unique_ptr<Stmt> Parser::parse_statement() {
     if (peek("{")) return parse_block();
     
     // Expression statement
+    skip_whitespace();
     size_t start = pos;
     auto expr = parse_expr();
     skip_whitespace();
@@ -144,8 +145,8 @@ std::unique_ptr<Stmt> Parser::parse_statement() {
 }
 
 std::unique_ptr<LetStmt> Parser::parse_let() {
-    size_t start = pos;
     skip_whitespace();
+    size_t start = pos;
     bool is_mut = match("mut");
     if (is_mut) skip_whitespace();
     
@@ -179,8 +180,8 @@ std::unique_ptr<LetStmt> Parser::parse_let() {
 }
 
 std::unique_ptr<IfStmt> Parser::parse_if() {
-    size_t start = pos;
     skip_whitespace();
+    size_t start = pos;
     
     auto condition = parse_expr();
     skip_whitespace();
@@ -213,8 +214,8 @@ std::unique_ptr<IfStmt> Parser::parse_if() {
 }
 
 std::unique_ptr<WhileStmt> Parser::parse_while() {
-    size_t start = pos;
     skip_whitespace();
+    size_t start = pos;
     
     auto condition = parse_expr();
     skip_whitespace();
@@ -346,16 +347,17 @@ std::unique_ptr<Expr> Parser::parse_equality() {
 }
 
 std::unique_ptr<Expr> Parser::parse_comparison() {
+    skip_whitespace();
     size_t start = pos;
     auto expr = parse_term();
     
     while (true) {
         skip_whitespace();
         BinaryExpr::Op op;
-        if (match("<")) op = BinaryExpr::Op::Lt;
-        else if (match("<=")) op = BinaryExpr::Op::Le;
-        else if (match(">")) op = BinaryExpr::Op::Gt;
+        if (match("<=")) op = BinaryExpr::Op::Le;
         else if (match(">=")) op = BinaryExpr::Op::Ge;
+        else if (match("<")) op = BinaryExpr::Op::Lt;
+        else if (match(">")) op = BinaryExpr::Op::Gt;
         else break;
         
         skip_whitespace();
@@ -372,6 +374,7 @@ std::unique_ptr<Expr> Parser::parse_comparison() {
 }
 
 std::unique_ptr<Expr> Parser::parse_term() {
+    skip_whitespace();
     size_t start = pos;
     auto expr = parse_factor();
     
@@ -396,6 +399,7 @@ std::unique_ptr<Expr> Parser::parse_term() {
 }
 
 std::unique_ptr<Expr> Parser::parse_factor() {
+    skip_whitespace();
     size_t start = pos;
     auto expr = parse_unary();
     
@@ -420,8 +424,8 @@ std::unique_ptr<Expr> Parser::parse_factor() {
 }
 
 std::unique_ptr<Expr> Parser::parse_unary() {
-    size_t start = pos;
     skip_whitespace();
+    size_t start = pos;
     
     if (match("-")) {
         auto operand = parse_unary();
@@ -456,6 +460,7 @@ std::unique_ptr<Expr> Parser::parse_unary() {
 }
 
 std::unique_ptr<Expr> Parser::parse_call() {
+    skip_whitespace();
     size_t start = pos;
     auto expr = parse_primary();
     
@@ -487,10 +492,10 @@ std::unique_ptr<Expr> Parser::parse_call() {
 }
 
 std::unique_ptr<Expr> Parser::parse_primary() {
-    size_t start = pos;
     skip_whitespace();
+    size_t start = pos;
     
-    if (std::isdigit(source[pos])) {
+    if (std::isdigit(current())) {
         return std::make_unique<IntLiteral>(make_span(start), consume_integer());
     }
     
@@ -502,11 +507,11 @@ std::unique_ptr<Expr> Parser::parse_primary() {
         return std::make_unique<BoolLiteral>(make_span(start), false);
     }
     
-    if (source[pos] == '"') {
+    if (current() == '"') {
         return std::make_unique<StringLiteral>(make_span(start), consume_string());
     }
     
-    if (std::isalpha(source[pos]) || source[pos] == '_') {
+    if (std::isalpha(current()) || current() == '_') {
         auto ident = std::make_unique<Identifier>(make_span(start), consume_identifier());
         // Check if identifier is mutable in current scope
         // This will be used by the type checker
@@ -544,9 +549,10 @@ void Parser::expect(const std::string& expected) {
 }
 
 std::string Parser::consume_identifier() {
+    skip_whitespace();
     size_t start = pos;
     
-    if (!std::isalpha(source[pos]) && source[pos] != '_') {
+    if (!std::isalpha(current()) && current() != '_') {
         error("Expected identifier");
     }
     
@@ -555,21 +561,22 @@ std::string Parser::consume_identifier() {
         pos++;
     }
     
-    return source.substr(start, pos - start);
+    return std::string(source.substr(start, pos - start));
 }
 
 int Parser::consume_integer() {
+    skip_whitespace();
     size_t start = pos;
     
     while (pos < source.length() && std::isdigit(source[pos])) {
         pos++;
     }
     
-    return std::stoi(source.substr(start, pos - start));
+    return std::stoi(std::string(source.substr(start, pos - start)));
 }
 
 std::string Parser::consume_string() {
-    if (source[pos] != '"') {
+    if (current() != '"') {
         error("Expected string");
     }
     pos++; // Skip opening quote
@@ -589,7 +596,7 @@ std::string Parser::consume_string() {
         error("Unterminated string");
     }
     
-    std::string value = source.substr(start, pos - start);
+    std::string value(source.substr(start, pos - start));
     pos++; // Skip closing quote
     return value;
 }
@@ -0,0 +1,138 @@
+#include "profiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+
+namespace nust {
+
+namespace {
+
+struct Transition {
+    size_t from;
+    size_t to;
+    uint64_t count;
+};
+
+std::string opcode_name(size_t index) {
+    return opcode_to_string(static_cast<Opcode>(index));
+}
+
+} // namespace
+
+OpcodeProfiler::OpcodeProfiler() : transitions(NUM_OPCODES * NUM_OPCODES, 0) {}
+
+void OpcodeProfiler::reset() {
+    opcodes = {};
+    std::fill(transitions.begin(), transitions.end(), 0);
+    functions.clear();
+    running = false;
+}
+
+void OpcodeProfiler::charge(uint64_t now) {
+    uint64_t cycles = now - started;
+    auto& stats = opcodes[previous];
+    stats.cycles += cycles;
+    size_t bucket = 0;
+    while (bucket + 1 < NUM_BUCKETS && (cycles >> (bucket + 1)) != 0) {
+        ++bucket;
+    }
+    ++stats.histogram[bucket];
+}
+
+void OpcodeProfiler::write_json(std::ostream& out, const FunctionTable& function_table) const {
+    out << "{\n  \"opcodes\": [";
+    const char* separator = "\n";
+    for (size_t i = 0; i < NUM_OPCODES; ++i) {
+        const auto& stats = opcodes[i];
+        if (stats.count == 0) {
+            continue;
+        }
+        size_t buckets = NUM_BUCKETS;
+        while (buckets > 0 && stats.histogram[buckets - 1] == 0) {
+            --buckets;
+        }
+        out << separator << "    {\"opcode\": \"" << opcode_name(i) << "\", \"count\": " << stats.count
+            << ", \"cycles\": " << stats.cycles << ", \"histogram\": [";
+        for (size_t b = 0; b < buckets; ++b) {
+            out << (b ? ", " : "") << stats.histogram[b];
+        }
+        out << "]}";
+        separator = ",\n";
+    }
+
+    out << "\n  ],\n  \"transitions\": [";
+    separator = "\n";
+    for (size_t from = 0; from < NUM_OPCODES; ++from) {
+        for (size_t to = 0; to < NUM_OPCODES; ++to) {
+            uint64_t count = transitions[from * NUM_OPCODES + to];
+            if (count != 0) {
+                out << separator << "    {\"from\": \"" << opcode_name(from) << "\", \"to\": \""
+                    << opcode_name(to) << "\", \"count\": " << count << "}";
+                separator = ",\n";
+            }
+        }
+    }
+
+    out << "\n  ],\n  \"functions\": [";
+    separator = "\n";
+    for (size_t i = 0; i < functions.size(); ++i) {
+        if (functions[i] != 0) {
+            out << separator << "    {\"name\": \"" << function_table.get_function(i).name
+                << "\", \"instructions\": " << functions[i] << "}";
+            separator = ",\n";
+        }
+    }
+    out << "\n  ]\n}\n";
+}
+
+void OpcodeProfiler::write_table(std::ostream& out, const FunctionTable& function_table, size_t top) const {
+    uint64_t total_cycles = 0;
+    std::vector<size_t> order;
+    for (size_t i = 0; i < NUM_OPCODES; ++i) {
+        if (opcodes[i].count != 0) {
+            order.push_back(i);
+            total_cycles += opcodes[i].cycles;
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return opcodes[a].cycles > opcodes[b].cycles;
+    });
+
+    out << std::left << std::setw(14) << "opcode" << std::right << std::setw(14) << "count"
+        << std::setw(16) << "cycles" << std::setw(12) << "cycles/op" << std::setw(9) << "time" << "\n";
+    for (size_t i : order) {
+        const auto& stats = opcodes[i];
+        double share = total_cycles ? 100.0 * stats.cycles / total_cycles : 0.0;
+        out << std::left << std::setw(14) << opcode_name(i) << std::right << std::setw(14) << stats.count
+            << std::setw(16) << stats.cycles << std::setw(12) << std::fixed << std::setprecision(1)
+            << static_cast<double>(stats.cycles) / stats.count << std::setw(8) << share << "%\n";
+    }
+
+    std::vector<Transition> pairs;
+    for (size_t from = 0; from < NUM_OPCODES; ++from) {
+        for (size_t to = 0; to < NUM_OPCODES; ++to) {
+            if (uint64_t count = transitions[from * NUM_OPCODES + to]) {
+                pairs.push_back(Transition{from, to, count});
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const Transition& a, const Transition& b) {
+        return a.count > b.count;
+    });
+    out << "\nmost frequent opcode pairs\n";
+    for (size_t i = 0; i < pairs.size() && i < top; ++i) {
+        out << std::right << std::setw(14) << pairs[i].count << "  " << opcode_name(pairs[i].from)
+            << " -> " << opcode_name(pairs[i].to) << "\n";
+    }
+
+    std::vector<size_t> hot(functions.size());
+    std::iota(hot.begin(), hot.end(), 0);
+    std::sort(hot.begin(), hot.end(), [&](size_t a, size_t b) { return functions[a] > functions[b]; });
+    out << "\ninstructions by function\n";
+    for (size_t i = 0; i < hot.size() && i < top && functions[hot[i]] != 0; ++i) {
+        out << std::right << std::setw(14) << functions[hot[i]] << "  "
+            << function_table.get_function(hot[i]).name << "\n";
+    }
+}
+
+} // namespace nust
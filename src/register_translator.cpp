@@ -0,0 +1,449 @@
+#include "register_translator.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace nust {
+
+RegisterProgram RegisterTranslator::translate(const std::vector<Instruction>& instructions,
+                                              const FunctionTable& function_table,
+                                              const std::vector<std::string>& string_constants) {
+    table = &function_table;
+    strings = &string_constants;
+    program = RegisterProgram();
+    int_constants.clear();
+    string_constant_indices.clear();
+    bool_constants[0] = bool_constants[1] = UINT32_MAX;
+    
+    // Functions keep their indices, so CALL operands carry over unchanged
+    std::vector<size_t> order(function_table.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return function_table.get_function(a).entry_point < function_table.get_function(b).entry_point;
+    });
+    program.functions.resize(function_table.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        const auto& info = function_table.get_function(order[i]);
+        size_t end = i + 1 < order.size()
+            ? function_table.get_function(order[i + 1]).entry_point
+            : instructions.size();
+        auto& function = program.functions[order[i]];
+        function.name = info.name;
+        function.num_params = info.num_params;
+        function.entry_point = program.code.size();
+        translate_function(instructions, info.entry_point, end, function);
+    }
+    
+    return std::move(program);
+}
+
+void RegisterTranslator::translate_function(const std::vector<Instruction>& instructions,
+                                            size_t start, size_t end, RegFunction& function) {
+    const auto& info = table->get_function(table->get_function_index(function.name));
+    temp_base = std::max(info.num_locals, info.num_params);
+    max_temps = 0;
+    stack.clear();
+    fresh_result = SIZE_MAX;
+    
+    std::vector<int> depths = stack_depths(instructions, start, end);
+    std::vector<bool> is_target(end - start, false);
+    for (size_t pc = start; pc < end; ++pc) {
+        if (instructions[pc].is_jump()) {
+            is_target[instructions[pc].operand - start] = true;
+        }
+    }
+    
+    std::vector<size_t> new_pc(end - start + 1);
+    std::vector<size_t> jumps;
+    bool terminated = false;
+    auto jump = [&](RegOpcode opcode, size_t target, uint32_t condition = 0) {
+        jumps.push_back(program.code.size());
+        emit(RegInstruction{opcode, static_cast<uint32_t>(target - start), condition});
+    };
+    auto push = [&](uint32_t operand) {
+        stack.push_back(operand);
+        max_temps = std::max(max_temps, stack.size());
+    };
+    
+    for (size_t pc = start; pc < end; ++pc) {
+        if (depths[pc - start] < 0) {
+            new_pc[pc - start] = program.code.size();
+            continue;
+        }
+        if (terminated) {
+            // Only reachable by jumps, which leave every value in its own register
+            stack.clear();
+            for (int i = 0; i < depths[pc - start]; ++i) {
+                push(temp(i));
+            }
+            terminated = false;
+        }
+        if (is_target[pc - start]) {
+            flush();
+            fresh_result = SIZE_MAX;
+        }
+        new_pc[pc - start] = program.code.size();
+        
+        const Instruction& instr = instructions[pc];
+        switch (instr.opcode) {
+            // Stack operations
+            case Opcode::PUSH_I32:
+                push(constant(Value(static_cast<Value::IntType>(instr.operand))));
+                break;
+            case Opcode::PUSH_BOOL:
+                push(constant(Value(instr.operand != 0)));
+                break;
+            case Opcode::PUSH_STR:
+                push(constant(Value(strings->at(instr.operand))));
+                break;
+            case Opcode::POP:
+                pop();
+                break;
+            case Opcode::DUP: {
+                uint32_t value = pop();
+                push(value);
+                push(value);
+                break;
+            }
+            case Opcode::SWAP: {
+                flush();
+                size_t depth = stack.size();
+                if (depth < 2) {
+                    throw std::runtime_error("Stack underflow in translation");
+                }
+                uint32_t scratch = temp(depth);
+                max_temps = std::max(max_temps, depth + 1);
+                emit(RegInstruction{RegOpcode::MOVE, scratch, temp(depth - 1)});
+                emit(RegInstruction{RegOpcode::MOVE, temp(depth - 1), temp(depth - 2)});
+                emit(RegInstruction{RegOpcode::MOVE, temp(depth - 2), scratch});
+                break;
+            }
+            
+            // Variable operations
+            case Opcode::LOAD:
+                push(static_cast<uint32_t>(instr.operand));
+                break;
+            case Opcode::STORE: {
+                uint32_t local = static_cast<uint32_t>(instr.operand);
+                uint32_t value = pop();
+                if (value == local) {
+                    break;
+                }
+                // Compute straight into the local when nothing else needs its old value
+                bool referenced = std::find(stack.begin(), stack.end(), local) != stack.end();
+                if (!referenced && value == temp(stack.size()) && fresh_result != SIZE_MAX &&
+                    fresh_result + 1 == program.code.size()) {
+                    program.code.back().a = local;
+                    fresh_result = SIZE_MAX;
+                    break;
+                }
+                detach(local);
+                emit(RegInstruction{RegOpcode::MOVE, local, value});
+                break;
+            }
+            case Opcode::LOAD_REF:
+                push_result(RegOpcode::LOAD_REF, static_cast<uint32_t>(instr.operand));
+                break;
+            case Opcode::STORE_REF: {
+                uint32_t value = pop();
+                uint32_t ref = pop();
+                emit(RegInstruction{RegOpcode::STORE_REF, ref, value});
+                break;
+            }
+            
+            // Arithmetic, comparison and logical operations
+            case Opcode::ADD_I32:
+            case Opcode::SUB_I32:
+            case Opcode::MUL_I32:
+            case Opcode::DIV_I32:
+            case Opcode::EQ_I32:
+            case Opcode::NE_I32:
+            case Opcode::LT_I32:
+            case Opcode::GT_I32:
+            case Opcode::LE_I32:
+            case Opcode::GE_I32:
+            case Opcode::AND:
+            case Opcode::OR: {
+                static const std::unordered_map<Opcode, RegOpcode> binary = {
+                    {Opcode::ADD_I32, RegOpcode::ADD_I32}, {Opcode::SUB_I32, RegOpcode::SUB_I32},
+                    {Opcode::MUL_I32, RegOpcode::MUL_I32}, {Opcode::DIV_I32, RegOpcode::DIV_I32},
+                    {Opcode::EQ_I32, RegOpcode::EQ_I32}, {Opcode::NE_I32, RegOpcode::NE_I32},
+                    {Opcode::LT_I32, RegOpcode::LT_I32}, {Opcode::GT_I32, RegOpcode::GT_I32},
+                    {Opcode::LE_I32, RegOpcode::LE_I32}, {Opcode::GE_I32, RegOpcode::GE_I32},
+                    {Opcode::AND, RegOpcode::AND}, {Opcode::OR, RegOpcode::OR},
+                };
+                uint32_t rhs = pop();
+                uint32_t lhs = pop();
+                push_result(binary.at(instr.opcode), lhs, rhs);
+                break;
+            }
+            case Opcode::NEG_I32:
+                push_result(RegOpcode::NEG_I32, pop());
+                break;
+            case Opcode::NOT:
+                push_result(RegOpcode::NOT, pop());
+                break;
+            
+            // Control flow
+            case Opcode::JMP:
+                flush();
+                jump(RegOpcode::JMP, instr.operand);
+                terminated = true;
+                break;
+            case Opcode::JMP_IF:
+            case Opcode::JMP_IF_NOT: {
+                uint32_t condition = pop();
+                flush();
+                jump(instr.opcode == Opcode::JMP_IF ? RegOpcode::JMP_IF : RegOpcode::JMP_IF_NOT,
+                     instr.operand, condition);
+                break;
+            }
+            case Opcode::CALL:
+            case Opcode::TAIL_CALL: {
+                flush();
+                size_t num_params = table->get_function(instr.operand).num_params;
+                if (stack.size() < num_params) {
+                    throw std::runtime_error("Stack underflow in translation");
+                }
+                size_t args = stack.size() - num_params;
+                bool tail = instr.opcode == Opcode::TAIL_CALL;
+                emit(RegInstruction{tail ? RegOpcode::TAIL_CALL : RegOpcode::CALL,
+                                    static_cast<uint32_t>(instr.operand), temp(args)});
+                stack.resize(args);
+                if (tail) {
+                    terminated = true;
+                } else {
+                    push(temp(args));
+                }
+                break;
+            }
+            case Opcode::RET:
+                emit(RegInstruction{RegOpcode::RET});
+                terminated = true;
+                break;
+            case Opcode::RET_VAL:
+                emit(RegInstruction{RegOpcode::RET_VAL, pop()});
+                terminated = true;
+                break;
+            
+            // Reference operations
+            case Opcode::BORROW:
+            case Opcode::BORROW_MUT: {
+                // The temporary moves into its slot, which is then borrowed like a local
+                uint32_t local = static_cast<uint32_t>(instr.operand);
+                uint32_t value = pop();
+                if (value != local) {
+                    detach(local);
+                    emit(RegInstruction{RegOpcode::MOVE, local, value});
+                }
+                push_result(RegOpcode::LOAD_REF, local);
+                break;
+            }
+            case Opcode::DEREF:
+            case Opcode::DEREF_MUT:
+                push_result(RegOpcode::DEREF, pop());
+                break;
+            
+            // Superinstructions
+            case Opcode::ADD_LL:
+                push_result(RegOpcode::ADD_I32, static_cast<uint32_t>(instr.operand), instr.arg1);
+                break;
+            case Opcode::ADD_LI:
+                push_result(RegOpcode::ADD_I32, static_cast<uint32_t>(instr.operand),
+                            constant(Value(static_cast<Value::IntType>(instr.arg1))));
+                break;
+            case Opcode::INC_LOCAL: {
+                uint32_t local = static_cast<uint32_t>(instr.operand);
+                detach(local);
+                emit(RegInstruction{RegOpcode::ADD_I32, local, local,
+                                    constant(Value(static_cast<Value::IntType>(instr.arg1)))});
+                break;
+            }
+            case Opcode::LT_LL_JMPNOT:
+            case Opcode::LT_LI_JMPNOT: {
+                flush();
+                uint32_t rhs = instr.opcode == Opcode::LT_LL_JMPNOT
+                    ? instr.arg2
+                    : constant(Value(static_cast<Value::IntType>(instr.arg2)));
+                uint32_t condition = temp(stack.size());
+                max_temps = std::max(max_temps, stack.size() + 1);
+                emit(RegInstruction{RegOpcode::LT_I32, condition, instr.arg1, rhs});
+                jump(RegOpcode::JMP_IF_NOT, instr.operand, condition);
+                break;
+            }
+            
+            default:
+                throw std::runtime_error("Cannot translate opcode: " + opcode_to_string(instr.opcode));
+        }
+    }
+    new_pc[end - start] = program.code.size();
+    
+    for (size_t index : jumps) {
+        auto& instr = program.code[index];
+        instr.a = static_cast<uint32_t>(new_pc[instr.a]);
+    }
+    function.num_registers = temp_base + max_temps;
+}
+
+std::vector<int> RegisterTranslator::stack_depths(const std::vector<Instruction>& instructions,
+                                                  size_t start, size_t end) const {
+    std::vector<int> depths(end - start, -1);
+    std::vector<size_t> worklist{start};
+    depths[0] = 0;
+    
+    auto reach = [&](size_t pc, int depth) {
+        if (pc < start || pc >= end) {
+            throw std::runtime_error("Jump out of function at instruction " + std::to_string(pc));
+        }
+        if (depths[pc - start] < 0) {
+            depths[pc - start] = depth;
+            worklist.push_back(pc);
+        } else if (depths[pc - start] != depth) {
+            throw std::runtime_error("Inconsistent stack depth at instruction " + std::to_string(pc));
+        }
+    };
+    
+    while (!worklist.empty()) {
+        size_t pc = worklist.back();
+        worklist.pop_back();
+        const Instruction& instr = instructions[pc];
+        int depth = depths[pc - start];
+        
+        switch (instr.opcode) {
+            case Opcode::PUSH_I32:
+            case Opcode::PUSH_BOOL:
+            case Opcode::PUSH_STR:
+            case Opcode::DUP:
+            case Opcode::LOAD:
+            case Opcode::LOAD_REF:
+            case Opcode::ADD_LL:
+            case Opcode::ADD_LI:
+                depth += 1;
+                break;
+            case Opcode::SWAP:
+            case Opcode::NEG_I32:
+            case Opcode::NOT:
+            case Opcode::BORROW:
+            case Opcode::BORROW_MUT:
+            case Opcode::DEREF:
+            case Opcode::DEREF_MUT:
+            case Opcode::INC_LOCAL:
+            case Opcode::JMP:
+            case Opcode::LT_LL_JMPNOT:
+            case Opcode::LT_LI_JMPNOT:
+                break;
+            case Opcode::STORE_REF:
+                depth -= 2;
+                break;
+            case Opcode::CALL:
+                depth -= static_cast<int>(table->get_function(instr.operand).num_params) - 1;
+                break;
+            case Opcode::TAIL_CALL:
+            case Opcode::RET:
+            case Opcode::RET_VAL:
+                continue;
+            default:
+                // Binary operations, POP, STORE and conditional jumps pop one value
+                depth -= 1;
+                break;
+        }
+        if (depth < 0) {
+            throw std::runtime_error("Stack underflow at instruction " + std::to_string(pc));
+        }
+        
+        if (instr.is_jump()) {
+            reach(instr.operand, depth);
+        }
+        if (instr.opcode != Opcode::JMP && pc + 1 < end) {
+            reach(pc + 1, depth);
+        }
+    }
+    return depths;
+}
+
+uint32_t RegisterTranslator::constant(const Value& value) {
+    auto add = [&]() {
+        program.constants.push_back(value);
+        return static_cast<uint32_t>(program.constants.size() - 1) | REG_CONSTANT;
+    };
+    if (value.is_int()) {
+        auto it = int_constants.find(value.as_int());
+        return it != int_constants.end() ? it->second : int_constants[value.as_int()] = add();
+    }
+    if (value.is_bool()) {
+        uint32_t& index = bool_constants[value.as_bool()];
+        return index != UINT32_MAX ? index : index = add();
+    }
+    auto it = string_constant_indices.find(value.as_string());
+    return it != string_constant_indices.end() ? it->second
+                                               : string_constant_indices[value.as_string()] = add();
+}
+
+void RegisterTranslator::emit(RegInstruction instr, bool writes_temp) {
+    program.code.push_back(instr);
+    fresh_result = writes_temp ? program.code.size() - 1 : SIZE_MAX;
+}
+
+void RegisterTranslator::flush() {
+    for (size_t i = 0; i < stack.size(); ++i) {
+        if (stack[i] != temp(i)) {
+            emit(RegInstruction{RegOpcode::MOVE, temp(i), stack[i]});
+            stack[i] = temp(i);
+        }
+    }
+}
+
+void RegisterTranslator::detach(uint32_t reg) {
+    for (size_t i = 0; i < stack.size(); ++i) {
+        if (stack[i] == reg) {
+            emit(RegInstruction{RegOpcode::MOVE, temp(i), reg});
+            stack[i] = temp(i);
+        }
+    }
+}
+
+void RegisterTranslator::push_result(RegOpcode opcode, uint32_t b, uint32_t c) {
+    uint32_t result = temp(stack.size());
+    emit(RegInstruction{opcode, result, b, c}, true);
+    stack.push_back(result);
+    max_temps = std::max(max_temps, stack.size());
+}
+
+uint32_t RegisterTranslator::pop() {
+    if (stack.empty()) {
+        throw std::runtime_error("Stack underflow in translation");
+    }
+    uint32_t value = stack.back();
+    stack.pop_back();
+    return value;
+}
+
+void write_register_code(std::ostream& out, const RegisterProgram& program) {
+    auto format_operand = [&](uint32_t operand) {
+        if (!(operand & REG_CONSTANT)) {
+            return "r" + std::to_string(operand);
+        }
+        const Value& value = program.constants[operand & ~REG_CONSTANT];
+        if (value.is_int()) return "#" + std::to_string(value.as_int());
+        if (value.is_bool()) return std::string(value.as_bool() ? "#true" : "#false");
+        return "#\"" + value.as_string() + "\"";
+    };
+    for (const auto& function : program.functions) {
+        out << "; " << function.name << " at " << function.entry_point
+            << ", " << function.num_registers << " registers\n";
+    }
+    for (const auto& instr : program.code) {
+        out << reg_opcode_to_string(instr.opcode);
+        const uint32_t operands[] = {instr.a, instr.b, instr.c};
+        for (size_t i = 0; i < instr.num_operands(); ++i) {
+            out << (i > 0 ? ", " : " ");
+            // Jump targets and function indices are plain numbers
+            bool plain = i == 0 && (instr.is_jump() || instr.opcode == RegOpcode::CALL ||
+                                    instr.opcode == RegOpcode::TAIL_CALL);
+            out << (plain ? std::to_string(operands[i]) : format_operand(operands[i]));
+        }
+        out << "\n";
+    }
+}
+
+} // namespace nust
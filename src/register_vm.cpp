@@ -0,0 +1,194 @@
+#include "register_vm.h"
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+namespace nust {
+
+namespace {
+
+// Integer arithmetic wraps around like the two's complement hardware it models
+Value::IntType wrap(uint32_t value) {
+    return static_cast<Value::IntType>(value);
+}
+
+} // namespace
+
+RegisterVM::RegisterVM(RegisterProgram program) : program(std::move(program)) {}
+
+Value RegisterVM::call(const std::string& name, const std::vector<Value>& args) {
+    size_t func_index = program.get_function_index(name);
+    if (args.size() != program.functions[func_index].num_params) {
+        throw std::runtime_error("Wrong number of arguments for function " + name);
+    }
+    
+    // Lay the arguments out the way CALL finds them, last argument first
+    registers.assign(args.rbegin(), args.rend());
+    frames.clear();
+    frames.push_back(Frame{0, args.size(), 0});
+    return run(enter_function(func_index, args.size(), 0));
+}
+
+size_t RegisterVM::enter_function(size_t func_index, size_t base, size_t args) {
+    const auto& function = program.functions[func_index];
+    size_t num_params = function.num_params;
+    registers.resize(std::max(registers.size(), base + function.num_registers));
+    if (args + num_params <= base || args >= base + num_params) {
+        for (size_t i = 0; i < num_params; ++i) {
+            registers[base + i] = registers[args + num_params - 1 - i];
+        }
+    } else {
+        // A tail call's arguments can overlap the parameters they replace,
+        // and reversing them in place would overwrite some before they are
+        // read, so go through a scratch buffer
+        scratch.assign(registers.begin() + args, registers.begin() + args + num_params);
+        std::copy(scratch.rbegin(), scratch.rend(), registers.begin() + base);
+    }
+    registers.resize(base + function.num_registers);
+    return function.entry_point;
+}
+
+Value RegisterVM::run(size_t pc) {
+    size_t base = frames.back().base;
+    while (true) {
+        if (pc >= program.code.size()) {
+            throw std::runtime_error("Instruction pointer out of bounds");
+        }
+        const RegInstruction& instr = program.code[pc++];
+        
+        switch (instr.opcode) {
+            // Data movement
+            case RegOpcode::MOVE:
+                registers[base + instr.a] = operand(base, instr.b);
+                break;
+            
+            // Arithmetic operations
+            case RegOpcode::ADD_I32: {
+                uint32_t a = operand(base, instr.b).as_int();
+                uint32_t b = operand(base, instr.c).as_int();
+                registers[base + instr.a] = Value(wrap(a + b));
+                break;
+            }
+            case RegOpcode::SUB_I32: {
+                uint32_t a = operand(base, instr.b).as_int();
+                uint32_t b = operand(base, instr.c).as_int();
+                registers[base + instr.a] = Value(wrap(a - b));
+                break;
+            }
+            case RegOpcode::MUL_I32: {
+                uint32_t a = operand(base, instr.b).as_int();
+                uint32_t b = operand(base, instr.c).as_int();
+                registers[base + instr.a] = Value(wrap(a * b));
+                break;
+            }
+            case RegOpcode::DIV_I32: {
+                Value::IntType a = operand(base, instr.b).as_int();
+                Value::IntType b = operand(base, instr.c).as_int();
+                if (b == 0) {
+                    throw std::runtime_error("Division by zero");
+                }
+                registers[base + instr.a] = Value(b == -1 ? wrap(0u - static_cast<uint32_t>(a)) : a / b);
+                break;
+            }
+            case RegOpcode::NEG_I32:
+                registers[base + instr.a] =
+                    Value(wrap(0u - static_cast<uint32_t>(operand(base, instr.b).as_int())));
+                break;
+            
+            // Comparison operations
+            case RegOpcode::EQ_I32:
+                registers[base + instr.a] = Value(operand(base, instr.b) == operand(base, instr.c));
+                break;
+            case RegOpcode::NE_I32:
+                registers[base + instr.a] = Value(operand(base, instr.b) != operand(base, instr.c));
+                break;
+            case RegOpcode::LT_I32:
+                registers[base + instr.a] =
+                    Value(operand(base, instr.b).as_int() < operand(base, instr.c).as_int());
+                break;
+            case RegOpcode::GT_I32:
+                registers[base + instr.a] =
+                    Value(operand(base, instr.b).as_int() > operand(base, instr.c).as_int());
+                break;
+            case RegOpcode::LE_I32:
+                registers[base + instr.a] =
+                    Value(operand(base, instr.b).as_int() <= operand(base, instr.c).as_int());
+                break;
+            case RegOpcode::GE_I32:
+                registers[base + instr.a] =
+                    Value(operand(base, instr.b).as_int() >= operand(base, instr.c).as_int());
+                break;
+            
+            // Logical operations
+            case RegOpcode::AND:
+                registers[base + instr.a] =
+                    Value(operand(base, instr.b).as_bool() && operand(base, instr.c).as_bool());
+                break;
+            case RegOpcode::OR:
+                registers[base + instr.a] =
+                    Value(operand(base, instr.b).as_bool() || operand(base, instr.c).as_bool());
+                break;
+            case RegOpcode::NOT:
+                registers[base + instr.a] = Value(!operand(base, instr.b).as_bool());
+                break;
+            
+            // Control flow
+            case RegOpcode::JMP:
+                pc = instr.a;
+                break;
+            case RegOpcode::JMP_IF:
+                if (operand(base, instr.b).as_bool()) {
+                    pc = instr.a;
+                }
+                break;
+            case RegOpcode::JMP_IF_NOT:
+                if (!operand(base, instr.b).as_bool()) {
+                    pc = instr.a;
+                }
+                break;
+            case RegOpcode::CALL: {
+                // The callee's registers start right after the caller's
+                size_t callee_base = registers.size();
+                frames.push_back(Frame{pc, callee_base, base + instr.b});
+                pc = enter_function(instr.a, callee_base, base + instr.b);
+                base = callee_base;
+                break;
+            }
+            case RegOpcode::TAIL_CALL:
+                pc = enter_function(instr.a, base, base + instr.b);
+                break;
+            case RegOpcode::RET:
+            case RegOpcode::RET_VAL: {
+                Value result = instr.opcode == RegOpcode::RET_VAL ? operand(base, instr.a) : Value();
+                Frame frame = frames.back();
+                frames.pop_back();
+                if (frames.empty()) {
+                    return result;
+                }
+                registers.resize(frame.base);
+                registers[frame.result] = std::move(result);
+                pc = frame.return_pc;
+                base = frames.back().base;
+                break;
+            }
+            
+            // Reference operations
+            case RegOpcode::LOAD_REF:
+                registers[base + instr.a] = Value(Ref{base + instr.b});
+                break;
+            case RegOpcode::STORE_REF:
+                registers[operand(base, instr.a).as_ref().slot] = operand(base, instr.b);
+                break;
+            case RegOpcode::DEREF: {
+                Value value = registers[operand(base, instr.b).as_ref().slot];
+                registers[base + instr.a] = std::move(value);
+                break;
+            }
+            
+            default:
+                throw std::runtime_error("Unknown opcode: " + reg_opcode_to_string(instr.opcode));
+        }
+    }
+}
+
+} // namespace nust
@@ -0,0 +1,156 @@
+#include "sampling_profiler.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#if NUST_SAMPLING_SUPPORTED
+#include <csignal>
+#include <ctime>
+#endif
+
+namespace nust {
+
+namespace {
+
+constexpr size_t RING_CAPACITY = 4096;
+constexpr uint32_t TRUNCATED = UINT32_MAX;
+
+std::atomic<SamplingProfiler*> active{nullptr};
+
+#if NUST_SAMPLING_SUPPORTED
+struct sigaction previous_action;
+#endif
+
+} // namespace
+
+SamplingProfiler::SamplingProfiler(unsigned frequency)
+    : frequency(std::max(1u, frequency)), ring(RING_CAPACITY) {}
+
+SamplingProfiler::~SamplingProfiler() {
+    stop();
+}
+
+void SamplingProfiler::handle_signal(int) {
+    if (SamplingProfiler* profiler = active.load(std::memory_order_relaxed)) {
+        profiler->pending.store(true, std::memory_order_relaxed);
+    }
+}
+
+void SamplingProfiler::start() {
+#if NUST_SAMPLING_SUPPORTED
+    if (running) {
+        return;
+    }
+    SamplingProfiler* expected = nullptr;
+    if (!active.compare_exchange_strong(expected, this)) {
+        throw std::runtime_error("Another sampling profiler is already running");
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = handle_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &previous_action);
+
+    struct sigevent event = {};
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGPROF;
+    timer_t id;
+    if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &id) != 0) {
+        sigaction(SIGPROF, &previous_action, nullptr);
+        active.store(nullptr);
+        throw std::runtime_error("Failed to create the profiling timer");
+    }
+    long interval = 1000000000L / frequency;
+    struct itimerspec spec = {};
+    spec.it_interval.tv_sec = interval / 1000000000L;
+    spec.it_interval.tv_nsec = interval % 1000000000L;
+    spec.it_value = spec.it_interval;
+    timer_settime(id, 0, &spec, nullptr);
+
+    timer = id;
+    running = true;
+#endif
+}
+
+void SamplingProfiler::stop() {
+#if NUST_SAMPLING_SUPPORTED
+    if (!running) {
+        return;
+    }
+    timer_delete(static_cast<timer_t>(timer));
+    sigaction(SIGPROF, &previous_action, nullptr);
+    active.store(nullptr);
+    pending.store(false, std::memory_order_relaxed);
+    running = false;
+#endif
+}
+
+void SamplingProfiler::record(const uint32_t* functions, size_t depth, size_t pc) {
+    pending.store(false, std::memory_order_relaxed);
+    size_t index = head.load(std::memory_order_relaxed);
+    if (index - tail.load(std::memory_order_acquire) == ring.size()) {
+        drain();
+    }
+
+    Sample& sample = ring[index & (ring.size() - 1)];
+    sample.truncated = depth > MAX_DEPTH;
+    sample.depth = static_cast<uint32_t>(std::min(depth, MAX_DEPTH));
+    sample.pc = static_cast<uint32_t>(pc);
+    std::copy(functions + (depth - sample.depth), functions + depth, sample.functions);
+    head.store(index + 1, std::memory_order_release);
+}
+
+void SamplingProfiler::drain() const {
+    size_t end = head.load(std::memory_order_acquire);
+    size_t index = tail.load(std::memory_order_relaxed);
+    for (; index != end; ++index) {
+        const Sample& sample = ring[index & (ring.size() - 1)];
+        std::vector<uint32_t> key;
+        if (sample.truncated) {
+            key.push_back(TRUNCATED);
+        }
+        key.insert(key.end(), sample.functions, sample.functions + sample.depth);
+        key.push_back(sample.pc);
+        ++stacks[key];
+    }
+    tail.store(index, std::memory_order_release);
+}
+
+uint64_t SamplingProfiler::sample_count() const {
+    drain();
+    uint64_t count = 0;
+    for (const auto& [stack, samples] : stacks) {
+        count += samples;
+    }
+    return count;
+}
+
+void SamplingProfiler::write_folded(std::ostream& out, const FunctionTable& function_table, bool pcs,
+                                    const SourceMap* source) const {
+    drain();
+    std::map<std::string, uint64_t> lines;
+    for (const auto& [stack, samples] : stacks) {
+        std::string line;
+        for (size_t i = 0; i + 1 < stack.size(); ++i) {
+            if (!line.empty()) {
+                line += ';';
+            }
+            line += stack[i] == TRUNCATED ? "[truncated]" : function_table.get_function(stack[i]).name;
+        }
+        if (pcs) {
+            auto location = source ? source->locate(stack.back()) : std::nullopt;
+            if (location) {
+                line += ";" + std::to_string(location->line) + ":" + std::to_string(location->column);
+            } else {
+                line += ";pc " + std::to_string(stack.back());
+            }
+        }
+        lines[line] += samples;
+    }
+    for (const auto& [line, samples] : lines) {
+        out << line << " " << samples << "\n";
+    }
+}
+
+} // namespace nust
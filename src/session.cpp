@@ -0,0 +1,27 @@
+#include "session.h"
+#include <stdexcept>
+
+namespace nust {
+
+Session::Session(CompilerOptions options) : type_checker(nullptr), compiler(options) {}
+
+Module Session::compile(std::string_view source) {
+    auto program = Parser(source).parse();
+    if (!type_checker.check_program(*program)) {
+        std::string message;
+        for (const auto& error : type_checker.errors()) {
+            message += (message.empty() ? "" : "\n") + error;
+        }
+        throw std::runtime_error(message.empty() ? "Type checking failed" : message);
+    }
+
+    Module module;
+    module.instructions = compiler.compile(*program);
+    module.function_table = compiler.take_function_table();
+    module.string_constants = compiler.take_string_constants();
+    module.span_table = compiler.take_span_table();
+    ++count;
+    return module;
+}
+
+} // namespace nust
@@ -0,0 +1,54 @@
+#include "source_file.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace nust {
+
+SourceFile::SourceFile(const std::string& path) {
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    struct stat info;
+    // Empty files can't be mapped, and pipes and the like have no size
+    // until they are read
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            mapping = address;
+            size = static_cast<size_t>(info.st_size);
+            madvise(mapping, size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+    if (mapping) {
+        return;
+    }
+#endif
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    buffer = contents.str();
+}
+
+SourceFile::~SourceFile() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (mapping) {
+        munmap(mapping, size);
+    }
+#endif
+}
+
+} // namespace nust
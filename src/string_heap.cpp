@@ -0,0 +1,30 @@
+#include "string_heap.h"
+
+namespace nust {
+
+InternedString::InternedString() : InternedString(StringHeap::global().intern("")) {}
+
+StringHeap& StringHeap::global() {
+    static StringHeap heap;
+    return heap;
+}
+
+InternedString StringHeap::intern(std::string_view text) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(text);
+    if (it != index.end()) {
+        return InternedString(it->second);
+    }
+    size_t hash = std::hash<std::string_view>()(text);
+    entries.push_back(StringEntry{std::string(text), hash});
+    const StringEntry& entry = entries.back();
+    index.emplace(std::string_view(entry.text), &entry);
+    return InternedString(&entry);
+}
+
+size_t StringHeap::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+} // namespace nust
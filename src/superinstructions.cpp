@@ -0,0 +1,141 @@
+#include "superinstructions.h"
+
+namespace nust {
+
+namespace {
+
+bool matches(const std::vector<Instruction>& code, size_t pc, std::initializer_list<Opcode> opcodes) {
+    if (pc + opcodes.size() > code.size()) {
+        return false;
+    }
+    for (Opcode opcode : opcodes) {
+        if (code[pc++].opcode != opcode) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t constant(const Instruction& push) {
+    return static_cast<uint32_t>(push.operand);
+}
+
+} // namespace
+
+void SuperinstructionSelector::run(std::vector<Instruction>& instructions, FunctionTable& function_table,
+                                   std::vector<size_t>* origins) {
+    jump_targets.assign(instructions.size() + 1, false);
+    for (const auto& instr : instructions) {
+        if (instr.is_jump()) {
+            jump_targets[instr.operand] = true;
+        }
+    }
+    // Function entry points are reached by calls
+    for (size_t i = 0; i < function_table.size(); ++i) {
+        jump_targets[function_table.get_function(i).entry_point] = true;
+    }
+    
+    // Instructions that get fused or dropped map to wherever the code that
+    // replaced them starts
+    std::vector<Instruction> result;
+    std::vector<size_t> new_pos(instructions.size() + 1);
+    if (origins) {
+        origins->clear();
+    }
+    size_t pc = 0;
+    while (pc < instructions.size()) {
+        size_t start = result.size();
+        size_t consumed = select(instructions, pc, result);
+        if (consumed == 0) {
+            result.push_back(instructions[pc]);
+            consumed = 1;
+        }
+        for (size_t i = 0; i < consumed; ++i) {
+            new_pos[pc + i] = start;
+        }
+        if (origins && result.size() > start) {
+            origins->push_back(pc + consumed - 1);
+        }
+        pc += consumed;
+    }
+    new_pos[instructions.size()] = result.size();
+    
+    for (auto& instr : result) {
+        if (instr.is_jump()) {
+            instr.operand = new_pos[instr.operand];
+        }
+    }
+    for (size_t i = 0; i < function_table.size(); ++i) {
+        auto& info = function_table.get_function(i);
+        size_t old_entry = info.entry_point;
+        info.entry_point = new_pos[old_entry];
+        for (auto& loop : info.counted_loops) {
+            loop.header = new_pos[old_entry + loop.header] - info.entry_point;
+            loop.exit = new_pos[old_entry + loop.exit] - info.entry_point;
+        }
+    }
+    
+    instructions = std::move(result);
+}
+
+size_t SuperinstructionSelector::select(const std::vector<Instruction>& code, size_t pc,
+                                        std::vector<Instruction>& out) const {
+    const Instruction& first = code[pc];
+    
+    if (matches(code, pc, {Opcode::LOAD, Opcode::PUSH_I32}) && pc + 3 < code.size() &&
+        (code[pc + 2].opcode == Opcode::ADD_I32 || code[pc + 2].opcode == Opcode::SUB_I32) &&
+        code[pc + 3].opcode == Opcode::STORE && code[pc + 3].operand == first.operand &&
+        !spans_target(pc, 4)) {
+        uint32_t k = constant(code[pc + 1]);
+        uint32_t delta = code[pc + 2].opcode == Opcode::ADD_I32 ? k : 0u - k;
+        out.push_back(Instruction{Opcode::INC_LOCAL, first.operand, delta});
+        return 4;
+    }
+    
+    if (matches(code, pc, {Opcode::LOAD, Opcode::PUSH_I32, Opcode::LT_I32, Opcode::JMP_IF_NOT}) &&
+        !spans_target(pc, 4)) {
+        out.push_back(Instruction{Opcode::LT_LI_JMPNOT, code[pc + 3].operand,
+                                  static_cast<uint32_t>(first.operand), constant(code[pc + 1])});
+        return 4;
+    }
+    
+    if (matches(code, pc, {Opcode::LOAD, Opcode::LOAD, Opcode::LT_I32, Opcode::JMP_IF_NOT}) &&
+        !spans_target(pc, 4)) {
+        out.push_back(Instruction{Opcode::LT_LL_JMPNOT, code[pc + 3].operand,
+                                  static_cast<uint32_t>(first.operand),
+                                  static_cast<uint32_t>(code[pc + 1].operand)});
+        return 4;
+    }
+    
+    if (matches(code, pc, {Opcode::LOAD, Opcode::LOAD, Opcode::ADD_I32}) && !spans_target(pc, 3)) {
+        out.push_back(Instruction{Opcode::ADD_LL, first.operand,
+                                  static_cast<uint32_t>(code[pc + 1].operand)});
+        return 3;
+    }
+    
+    if (matches(code, pc, {Opcode::LOAD, Opcode::PUSH_I32, Opcode::ADD_I32}) && !spans_target(pc, 3)) {
+        out.push_back(Instruction{Opcode::ADD_LI, first.operand, constant(code[pc + 1])});
+        return 3;
+    }
+    
+    // Pushing a value without side effects only to pop it again
+    bool pure_push = first.opcode == Opcode::LOAD || first.opcode == Opcode::PUSH_I32 ||
+                     first.opcode == Opcode::PUSH_BOOL || first.opcode == Opcode::PUSH_STR;
+    if (pure_push && pc + 1 < code.size() && code[pc + 1].opcode == Opcode::POP &&
+        !spans_target(pc, 2)) {
+        return 2;
+    }
+    
+    return 0;
+}
+
+bool SuperinstructionSelector::spans_target(size_t pc, size_t length) const {
+    for (size_t i = pc + 1; i < pc + length; ++i) {
+        if (jump_targets[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace nust
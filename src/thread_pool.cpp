@@ -0,0 +1,82 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+namespace nust {
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+}
+
+bool ThreadPool::next_task(size_t worker, size_t& index) {
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            index = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    // Nothing is added during a run, so one pass over the others finding
+    // them all empty means the batch is fully handed out
+    for (size_t i = 1; i < queues.size(); ++i) {
+        Queue& victim = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            index = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t index, size_t worker)>& task) {
+    // Deal contiguous ranges so each worker starts on neighbouring tasks, and
+    // push them in reverse so popping from the back runs them in order
+    size_t workers = std::min(queues.size(), std::max<size_t>(count, 1));
+    for (size_t worker = 0; worker < workers; ++worker) {
+        size_t begin = count * worker / workers;
+        size_t end = count * (worker + 1) / workers;
+        for (size_t index = end; index > begin; --index) {
+            queues[worker]->tasks.push_back(index - 1);
+        }
+    }
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto work = [&](size_t worker) {
+        size_t index;
+        while (next_task(worker, index)) {
+            try {
+                task(index, worker);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t worker = 1; worker < workers; ++worker) {
+        threads.emplace_back(work, worker);
+    }
+    work(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace nust
@@ -7,6 +7,8 @@ namespace nust {
 
 bool TypeChecker::check_program(const Program& program) {
     program_ = &program;
+    scopes_.clear();
+    errors_.clear();
     for (const auto& item : program.items) {
         if (auto func = dynamic_cast<const FunctionDecl*>(item.get())) {
             if (!check_function(*func)) {
@@ -490,7 +492,9 @@ void TypeChecker::error(const std::string& message, const Span& span) {
     std::stringstream ss;
     ss << "Type error at " << span.start << ":" << span.end << ": " << message;
     errors_.push_back(ss.str());
-    std::cerr << "Error: " << ss.str() << std::endl;
+    if (diagnostics_) {
+        *diagnostics_ << "Error: " << ss.str() << std::endl;
+    }
 }
 
 } // namespace nust 
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include "verifier.h"
+#include <algorithm>
+#include <numeric>
+
+namespace nust {
+
+namespace {
+
+SlotType join(SlotType a, SlotType b) {
+    if (a == b || b == SlotType::Unset) return a;
+    if (a == SlotType::Unset) return b;
+    return SlotType::Conflict;
+}
+
+// Slot type of a value of the given type, or nothing if it isn't representable
+std::optional<SlotType> slot_type_of(const Type* type) {
+    if (!type || type->kind == Type::Kind::I32) return SlotType::Int;
+    if (type->kind == Type::Kind::Bool) return SlotType::Bool;
+    return std::nullopt;
+}
+
+} // namespace
+
+BytecodeVerifier::BytecodeVerifier(const std::vector<Instruction>& instructions,
+                                   const FunctionTable& function_table)
+    : instructions(instructions), function_table(function_table), function_ends(function_table.size()) {
+    std::vector<size_t> order(function_table.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return function_table.get_function(a).entry_point < function_table.get_function(b).entry_point;
+    });
+    for (size_t i = 0; i < order.size(); ++i) {
+        function_ends[order[i]] = i + 1 < order.size()
+            ? function_table.get_function(order[i + 1]).entry_point
+            : instructions.size();
+    }
+}
+
+std::optional<std::vector<VerifiedFunction>> BytecodeVerifier::verify() const {
+    std::vector<VerifiedFunction> functions;
+    for (size_t i = 0; i < function_table.size(); ++i) {
+        auto function = verify_function(i);
+        if (!function) {
+            return std::nullopt;
+        }
+        functions.push_back(std::move(*function));
+    }
+    return functions;
+}
+
+std::optional<VerifiedFunction> BytecodeVerifier::verify_function(size_t func_index) const {
+    const auto& info = function_table.get_function(func_index);
+    VerifiedFunction function;
+    function.start = info.entry_point;
+    function.end = function_ends[func_index];
+    function.num_locals = std::max(info.num_locals, info.num_params);
+    if (function.start >= function.end || function.end > instructions.size()) {
+        return std::nullopt;
+    }
+    function.states.assign(function.end - function.start, std::nullopt);
+
+    auto result_type = slot_type_of(info.return_type.get());
+    if (!result_type) {
+        return std::nullopt;
+    }
+    SlotState entry;
+    entry.locals.assign(function.num_locals, SlotType::Unset);
+    for (size_t i = 0; i < info.num_params; ++i) {
+        auto type = slot_type_of(info.param_types[i].get());
+        if (!type) {
+            return std::nullopt;
+        }
+        entry.locals[i] = *type;
+    }
+
+    std::vector<size_t> worklist;
+    auto reach = [&](size_t pc, const SlotState& state) {
+        if (pc < function.start || pc >= function.end) {
+            return false;
+        }
+        auto& known = function.states[pc - function.start];
+        if (!known) {
+            known = state;
+            worklist.push_back(pc);
+            return true;
+        }
+        if (known->stack != state.stack) {
+            return false;
+        }
+        bool changed = false;
+        for (size_t i = 0; i < state.locals.size(); ++i) {
+            SlotType type = join(known->locals[i], state.locals[i]);
+            changed |= type != known->locals[i];
+            known->locals[i] = type;
+        }
+        if (changed) {
+            worklist.push_back(pc);
+        }
+        return true;
+    };
+    reach(function.start, entry);
+
+    while (!worklist.empty()) {
+        size_t pc = worklist.back();
+        worklist.pop_back();
+        SlotState state = *function.states[pc - function.start];
+        const Instruction& instr = instructions[pc];
+        auto& stack = state.stack;
+
+        // An uninitialized local reads as the VM's default, an i32 zero
+        auto read = [&](size_t slot) -> std::optional<SlotType> {
+            if (slot >= state.locals.size() || state.locals[slot] == SlotType::Conflict) {
+                return std::nullopt;
+            }
+            return state.locals[slot] == SlotType::Unset ? SlotType::Int : state.locals[slot];
+        };
+        // Pop values of the given types, the last one from the top
+        auto pop = [&](std::initializer_list<SlotType> types) {
+            if (stack.size() < types.size() ||
+                !std::equal(types.begin(), types.end(), stack.end() - types.size())) {
+                return false;
+            }
+            stack.resize(stack.size() - types.size());
+            return true;
+        };
+        // Pop a call's arguments, which are pushed last to first
+        auto pop_args = [&](const FunctionInfo& callee) {
+            if (stack.size() < callee.num_params) {
+                return false;
+            }
+            for (size_t i = 0; i < callee.num_params; ++i) {
+                if (slot_type_of(callee.param_types[i].get()) != stack.back()) {
+                    return false;
+                }
+                stack.pop_back();
+            }
+            return true;
+        };
+        auto callee = [&]() -> const FunctionInfo* {
+            return instr.operand < function_table.size() ? &function_table.get_function(instr.operand) : nullptr;
+        };
+
+        switch (instr.opcode) {
+            case Opcode::PUSH_I32:
+                stack.push_back(SlotType::Int);
+                break;
+            case Opcode::PUSH_BOOL:
+                stack.push_back(SlotType::Bool);
+                break;
+            case Opcode::POP:
+                if (stack.empty()) return std::nullopt;
+                stack.pop_back();
+                break;
+            case Opcode::DUP:
+                if (stack.empty()) return std::nullopt;
+                stack.push_back(stack.back());
+                break;
+            case Opcode::SWAP:
+                if (stack.size() < 2) return std::nullopt;
+                std::swap(stack[stack.size() - 1], stack[stack.size() - 2]);
+                break;
+            case Opcode::LOAD: {
+                auto type = read(instr.operand);
+                if (!type) return std::nullopt;
+                stack.push_back(*type);
+                break;
+            }
+            case Opcode::STORE:
+                if (stack.empty() || instr.operand >= state.locals.size()) return std::nullopt;
+                state.locals[instr.operand] = stack.back();
+                stack.pop_back();
+                break;
+            case Opcode::ADD_I32:
+            case Opcode::SUB_I32:
+            case Opcode::MUL_I32:
+            case Opcode::DIV_I32:
+                if (!pop({SlotType::Int, SlotType::Int})) return std::nullopt;
+                stack.push_back(SlotType::Int);
+                break;
+            case Opcode::NEG_I32:
+                if (!pop({SlotType::Int})) return std::nullopt;
+                stack.push_back(SlotType::Int);
+                break;
+            case Opcode::EQ_I32:
+            case Opcode::NE_I32:
+                // Both sides must have the same type, as values of different
+                // types compare unequal in the VM but might not as raw slots
+                if (stack.size() < 2 || stack[stack.size() - 1] != stack[stack.size() - 2]) {
+                    return std::nullopt;
+                }
+                stack.resize(stack.size() - 2);
+                stack.push_back(SlotType::Bool);
+                break;
+            case Opcode::LT_I32:
+            case Opcode::GT_I32:
+            case Opcode::LE_I32:
+            case Opcode::GE_I32:
+                if (!pop({SlotType::Int, SlotType::Int})) return std::nullopt;
+                stack.push_back(SlotType::Bool);
+                break;
+            case Opcode::AND:
+            case Opcode::OR:
+                if (!pop({SlotType::Bool, SlotType::Bool})) return std::nullopt;
+                stack.push_back(SlotType::Bool);
+                break;
+            case Opcode::NOT:
+                if (!pop({SlotType::Bool})) return std::nullopt;
+                stack.push_back(SlotType::Bool);
+                break;
+            case Opcode::JMP:
+                if (!reach(instr.operand, state)) return std::nullopt;
+                continue;
+            case Opcode::JMP_IF:
+            case Opcode::JMP_IF_NOT:
+                if (!pop({SlotType::Bool}) || !reach(instr.operand, state)) return std::nullopt;
+                break;
+            case Opcode::CALL: {
+                auto* info = callee();
+                auto result = info ? slot_type_of(info->return_type.get()) : std::nullopt;
+                if (!result || !pop_args(*info)) return std::nullopt;
+                stack.push_back(*result);
+                break;
+            }
+            case Opcode::TAIL_CALL: {
+                // The callee's result becomes ours
+                auto* info = callee();
+                if (!info || slot_type_of(info->return_type.get()) != result_type || !pop_args(*info)) {
+                    return std::nullopt;
+                }
+                continue;
+            }
+            case Opcode::RET:
+                if (result_type != SlotType::Int) return std::nullopt;
+                continue;
+            case Opcode::RET_VAL:
+                if (!pop({*result_type})) return std::nullopt;
+                continue;
+            case Opcode::ADD_LL:
+                if (read(instr.operand) != SlotType::Int || read(instr.arg1) != SlotType::Int) return std::nullopt;
+                stack.push_back(SlotType::Int);
+                break;
+            case Opcode::ADD_LI:
+                if (read(instr.operand) != SlotType::Int) return std::nullopt;
+                stack.push_back(SlotType::Int);
+                break;
+            case Opcode::INC_LOCAL:
+                if (read(instr.operand) != SlotType::Int) return std::nullopt;
+                state.locals[instr.operand] = SlotType::Int;
+                break;
+            case Opcode::LT_LL_JMPNOT:
+                if (read(instr.arg1) != SlotType::Int || read(instr.arg2) != SlotType::Int ||
+                    !reach(instr.operand, state)) {
+                    return std::nullopt;
+                }
+                break;
+            case Opcode::LT_LI_JMPNOT:
+                if (read(instr.arg1) != SlotType::Int || !reach(instr.operand, state)) return std::nullopt;
+                break;
+            default:
+                // Strings and references have no raw representation
+                return std::nullopt;
+        }
+        if (!reach(pc + 1, state)) {
+            return std::nullopt;
+        }
+    }
+
+    for (const auto& state : function.states) {
+        if (state) {
+            function.max_depth = std::max(function.max_depth, state->stack.size());
+        }
+    }
+    return function;
+}
+
+} // namespace nust
@@ -0,0 +1,657 @@
+#include "vm.h"
+#include <algorithm>
+#include <stdexcept>
+
+// Profiler hooks, which are only compiled into NUST_PROFILE builds
+#if NUST_PROFILE
+#define PROFILE(call) profiler.call
+#else
+#define PROFILE(call)
+#endif
+
+namespace nust {
+
+namespace {
+
+// Integer arithmetic wraps around like the two's complement hardware it models
+Value::IntType wrap(uint32_t value) {
+    return static_cast<Value::IntType>(value);
+}
+
+// Compiled code sees i32 and bool values as int32_t; anything else is in a
+// slot it never reads
+int32_t to_native(const Value& value) {
+    if (value.is_int()) return value.as_int();
+    if (value.is_bool()) return value.as_bool();
+    return 0;
+}
+
+Value from_native(int32_t value, NativeType type) {
+    return type == NativeType::Bool ? Value(value != 0) : Value(static_cast<Value::IntType>(value));
+}
+
+} // namespace
+
+VM::VM(std::vector<Instruction> instructions, const FunctionTable& function_table,
+       std::vector<std::string> string_constants, VMOptions options)
+    : instructions(std::move(instructions)), function_table(function_table),
+      options(options),
+      jit(this->instructions, function_table), hotness(function_table.size(), 0),
+      compiled(function_table.size()) {
+    // Callee frames are laid over their arguments in this one stack, so
+    // calls only move an index once the space is there
+    frames.reserve(std::min<size_t>(options.max_call_depth, 1 << 16));
+    stack.reserve(4096);
+    
+    for (const auto& constant : string_constants) {
+        this->string_constants.push_back(StringHeap::global().intern(constant));
+    }
+    
+    for (size_t i = 0; i < function_table.size(); ++i) {
+        const auto& info = function_table.get_function(i);
+        size_t num_slots = std::max(info.num_locals, info.num_params);
+        call_targets.push_back(CallTarget{info.entry_point, info.num_params, num_slots, 0});
+    }
+    // Call operands are checked here once rather than on every call
+    for (const auto& instr : this->instructions) {
+        if ((instr.opcode == Opcode::CALL || instr.opcode == Opcode::TAIL_CALL) &&
+            instr.operand >= call_targets.size()) {
+            throw std::runtime_error("Invalid function index");
+        }
+    }
+    if (options.verify) {
+        if (auto functions = BytecodeVerifier(this->instructions, function_table).verify()) {
+            // Plus the slot an empty stack's cached top is spilled into
+            for (size_t i = 0; i < functions->size(); ++i) {
+                call_targets[i].raw_frame_size = (*functions)[i].frame_size() + 1;
+            }
+            verified = true;
+        }
+    }
+}
+
+Value VM::call(const std::string& name, const std::vector<Value>& args) {
+    size_t func_index = function_table.get_function_index(name);
+    if (args.size() != function_table.get_function(func_index).num_params) {
+        throw std::runtime_error("Wrong number of arguments for function " + name);
+    }
+    PROFILE(cancel());
+    if (is_verified() && !options.jit.enabled) {
+        Value result = run_unchecked(func_index, args);
+        PROFILE(stop());
+        return result;
+    }
+    
+    stack.clear();
+    frames.clear();
+    
+    // Arguments are pushed right to left, as compiled code does
+    for (auto it = args.rbegin(); it != args.rend(); ++it) {
+        stack.push_back(*it);
+    }
+    size_t pc = enter_frame(func_index, 0);
+    Value result;
+    if (!options.jit.enabled || !run_compiled(pc, result)) {
+        result = run(pc);
+    }
+    PROFILE(stop());
+    return result;
+}
+
+bool VM::is_compiled(const std::string& name) const {
+    return compiled[function_table.get_function_index(name)] != nullptr;
+}
+
+void VM::check_depth(size_t func_index) const {
+    if (frames.size() >= options.max_call_depth) {
+        const auto& name = function_table.get_function(func_index).name;
+        throw std::runtime_error("Stack overflow in call to " + name + ": more than " +
+                                 std::to_string(options.max_call_depth) + " nested calls");
+    }
+}
+
+size_t VM::enter_frame(size_t func_index, size_t return_pc) {
+    const CallTarget& target = call_targets[func_index];
+    if (stack.size() < target.num_params) {
+        throw std::runtime_error("Stack underflow in call to " + function_table.get_function(func_index).name);
+    }
+    check_depth(func_index);
+    
+    // The first argument is on top, so reverse them in place into slots 0..n-1
+    size_t base = stack.size() - target.num_params;
+    std::reverse(stack.begin() + base, stack.end());
+    stack.resize(base + target.num_slots);
+    frames.push_back(Frame{return_pc, base, func_index});
+    return target.entry_point;
+}
+
+size_t VM::reuse_frame(size_t func_index) {
+    const CallTarget& target = call_targets[func_index];
+    if (stack.size() < frames.back().base + target.num_params) {
+        throw std::runtime_error("Stack underflow in call to " + function_table.get_function(func_index).name);
+    }
+    
+    // Slide the arguments down over the current frame
+    size_t base = frames.back().base;
+    size_t args = stack.size() - target.num_params;
+    std::reverse(stack.begin() + args, stack.end());
+    if (args != base) {
+        std::move(stack.begin() + args, stack.end(), stack.begin() + base);
+    }
+    stack.resize(base + target.num_slots);
+    frames.back().func_index = func_index;
+    return target.entry_point;
+}
+
+bool VM::leave_frame(Value& result, size_t& pc) {
+    Frame frame = frames.back();
+    frames.pop_back();
+    stack.resize(frame.base);
+    if (frames.empty()) {
+        return true;
+    }
+    stack.push_back(std::move(result));
+    pc = frame.return_pc;
+    return false;
+}
+
+bool VM::run_compiled(size_t& pc, Value& result) {
+    size_t func_index = frames.back().func_index;
+    if (!compiled[func_index] && hotness[func_index]++ == options.jit.threshold) {
+        compiled[func_index] = jit.compile(func_index);
+    }
+    const JitFunction* code = compiled[func_index].get();
+    JitFunction::Entry entry = code ? code->entry(pc) : nullptr;
+    if (!entry) {
+        return false;
+    }
+    
+    size_t base = frames.back().base;
+    native_frame.assign(std::max(code->frame_size(), stack.size() - base), 0);
+    for (size_t i = base; i < stack.size(); ++i) {
+        native_frame[i - base] = to_native(stack[i]);
+    }
+    const JitExit& exit = code->exit(entry(native_frame.data()));
+    if (exit.returns) {
+        result = from_native(native_frame[0], exit.types[0]);
+        return leave_frame(result, pc);
+    }
+    
+    // Rebuild the frame and let the interpreter carry on
+    stack.resize(base + exit.types.size());
+    for (size_t i = 0; i < exit.types.size(); ++i) {
+        stack[base + i] = from_native(native_frame[i], exit.types[i]);
+    }
+    pc = exit.pc;
+    return false;
+}
+
+void VM::take_sample(size_t pc) {
+    sample_stack.clear();
+    for (const auto& frame : frames) {
+        sample_stack.push_back(static_cast<uint32_t>(frame.func_index));
+    }
+    options.sampler->record(sample_stack.data(), sample_stack.size(), pc);
+}
+
+Value VM::pop() {
+    if (stack.empty() || (!frames.empty() && stack.size() <= frames.back().base)) {
+        throw std::runtime_error("Stack underflow");
+    }
+    Value value = std::move(stack.back());
+    stack.pop_back();
+    return value;
+}
+
+Value VM::run(size_t pc) {
+    while (true) {
+        if (pc >= instructions.size()) {
+            throw std::runtime_error("Instruction pointer out of bounds");
+        }
+        size_t at = pc++;
+        const Instruction& instr = instructions[at];
+        ++executed;
+        PROFILE(step(instr.opcode, frames.back().func_index));
+        size_t base = frames.back().base;
+        
+        switch (instr.opcode) {
+            // Stack operations
+            case Opcode::PUSH_I32:
+                stack.push_back(Value(static_cast<Value::IntType>(instr.operand)));
+                break;
+            case Opcode::PUSH_BOOL:
+                stack.push_back(Value(instr.operand != 0));
+                break;
+            case Opcode::PUSH_STR:
+                stack.push_back(Value(string_constants[instr.operand]));
+                break;
+            case Opcode::POP:
+                pop();
+                break;
+            case Opcode::DUP: {
+                Value value = pop();
+                stack.push_back(value);
+                stack.push_back(std::move(value));
+                break;
+            }
+            case Opcode::SWAP: {
+                Value b = pop();
+                Value a = pop();
+                stack.push_back(std::move(b));
+                stack.push_back(std::move(a));
+                break;
+            }
+            
+            // Variable operations
+            case Opcode::LOAD:
+                stack.push_back(stack[base + instr.operand]);
+                break;
+            case Opcode::STORE:
+                stack[base + instr.operand] = pop();
+                break;
+            case Opcode::LOAD_REF:
+                stack.push_back(Value(Ref{base + instr.operand}));
+                break;
+            case Opcode::STORE_REF: {
+                Value value = pop();
+                stack[pop().as_ref().slot] = std::move(value);
+                break;
+            }
+            
+            // Arithmetic operations
+            case Opcode::ADD_I32: {
+                uint32_t b = pop().as_int();
+                uint32_t a = pop().as_int();
+                stack.push_back(Value(wrap(a + b)));
+                break;
+            }
+            case Opcode::SUB_I32: {
+                uint32_t b = pop().as_int();
+                uint32_t a = pop().as_int();
+                stack.push_back(Value(wrap(a - b)));
+                break;
+            }
+            case Opcode::MUL_I32: {
+                uint32_t b = pop().as_int();
+                uint32_t a = pop().as_int();
+                stack.push_back(Value(wrap(a * b)));
+                break;
+            }
+            case Opcode::DIV_I32: {
+                Value::IntType b = pop().as_int();
+                Value::IntType a = pop().as_int();
+                if (b == 0) {
+                    throw std::runtime_error("Division by zero");
+                }
+                stack.push_back(Value(b == -1 ? wrap(0u - static_cast<uint32_t>(a)) : a / b));
+                break;
+            }
+            case Opcode::NEG_I32:
+                stack.push_back(Value(wrap(0u - static_cast<uint32_t>(pop().as_int()))));
+                break;
+            
+            // Comparison operations
+            case Opcode::EQ_I32: {
+                Value b = pop();
+                Value a = pop();
+                stack.push_back(Value(a == b));
+                break;
+            }
+            case Opcode::NE_I32: {
+                Value b = pop();
+                Value a = pop();
+                stack.push_back(Value(a != b));
+                break;
+            }
+            case Opcode::LT_I32: {
+                Value::IntType b = pop().as_int();
+                Value::IntType a = pop().as_int();
+                stack.push_back(Value(a < b));
+                break;
+            }
+            case Opcode::GT_I32: {
+                Value::IntType b = pop().as_int();
+                Value::IntType a = pop().as_int();
+                stack.push_back(Value(a > b));
+                break;
+            }
+            case Opcode::LE_I32: {
+                Value::IntType b = pop().as_int();
+                Value::IntType a = pop().as_int();
+                stack.push_back(Value(a <= b));
+                break;
+            }
+            case Opcode::GE_I32: {
+                Value::IntType b = pop().as_int();
+                Value::IntType a = pop().as_int();
+                stack.push_back(Value(a >= b));
+                break;
+            }
+            
+            // Logical operations
+            case Opcode::AND: {
+                bool b = pop().as_bool();
+                bool a = pop().as_bool();
+                stack.push_back(Value(a && b));
+                break;
+            }
+            case Opcode::OR: {
+                bool b = pop().as_bool();
+                bool a = pop().as_bool();
+                stack.push_back(Value(a || b));
+                break;
+            }
+            case Opcode::NOT:
+                stack.push_back(Value(!pop().as_bool()));
+                break;
+            
+            // Control flow
+            case Opcode::JMP:
+                poll_sampler(pc - 1);
+                pc = instr.operand;
+                break;
+            case Opcode::JMP_IF:
+                if (pop().as_bool()) {
+                    pc = instr.operand;
+                }
+                break;
+            case Opcode::JMP_IF_NOT:
+                if (!pop().as_bool()) {
+                    pc = instr.operand;
+                }
+                break;
+            case Opcode::CALL:
+                poll_sampler(pc - 1);
+                pc = enter_frame(instr.operand, pc);
+                break;
+            case Opcode::TAIL_CALL:
+                poll_sampler(pc - 1);
+                pc = reuse_frame(instr.operand);
+                break;
+            case Opcode::RET:
+            case Opcode::RET_VAL: {
+                Value result = instr.opcode == Opcode::RET_VAL ? pop() : Value();
+                if (leave_frame(result, pc)) {
+                    return result;
+                }
+                break;
+            }
+            
+            // Reference operations
+            case Opcode::BORROW:
+            case Opcode::BORROW_MUT:
+                stack[base + instr.operand] = pop();
+                stack.push_back(Value(Ref{base + instr.operand}));
+                break;
+            case Opcode::DEREF:
+            case Opcode::DEREF_MUT: {
+                Value value = stack[pop().as_ref().slot];
+                stack.push_back(std::move(value));
+                break;
+            }
+
+            // Superinstructions
+            case Opcode::ADD_LL: {
+                uint32_t a = stack[base + instr.operand].as_int();
+                uint32_t b = stack[base + instr.arg1].as_int();
+                stack.push_back(Value(wrap(a + b)));
+                break;
+            }
+            case Opcode::ADD_LI: {
+                uint32_t a = stack[base + instr.operand].as_int();
+                stack.push_back(Value(wrap(a + instr.arg1)));
+                break;
+            }
+            case Opcode::INC_LOCAL: {
+                Value& local = stack[base + instr.operand];
+                local = Value(wrap(static_cast<uint32_t>(local.as_int()) + instr.arg1));
+                break;
+            }
+            case Opcode::LT_LL_JMPNOT:
+                if (!(stack[base + instr.arg1].as_int() < stack[base + instr.arg2].as_int())) {
+                    pc = instr.operand;
+                }
+                break;
+            case Opcode::LT_LI_JMPNOT:
+                if (!(stack[base + instr.arg1].as_int() < static_cast<Value::IntType>(instr.arg2))) {
+                    pc = instr.operand;
+                }
+                break;
+
+            default:
+                throw std::runtime_error("Unknown opcode: " + opcode_to_string(instr.opcode));
+        }
+        
+        // Calls and loop back edges are where compiled code takes over
+        if (options.jit.enabled && (instr.opcode == Opcode::CALL || instr.opcode == Opcode::TAIL_CALL ||
+                                  (instr.is_jump() && pc <= at))) {
+            Value result;
+            if (run_compiled(pc, result)) {
+                return result;
+            }
+        }
+    }
+}
+
+Value VM::run_unchecked(size_t func_index, const std::vector<Value>& args) {
+    // Arguments are the one place values arrive from outside the program
+    const auto& entry = function_table.get_function(func_index);
+    for (size_t i = 0; i < args.size(); ++i) {
+        bool is_bool = entry.param_types[i] && entry.param_types[i]->kind == Type::Kind::Bool;
+        if (is_bool ? !args[i].is_bool() : !args[i].is_int()) {
+            throw std::runtime_error("Wrong argument type for function " + entry.name);
+        }
+    }
+    
+    frames.clear();
+    if (raw_stack.size() < call_targets[func_index].raw_frame_size) {
+        raw_stack.resize(call_targets[func_index].raw_frame_size);
+    }
+    int32_t* locals = raw_stack.data();
+    for (size_t i = 0; i < args.size(); ++i) {
+        locals[i] = args[i].is_bool() ? args[i].as_bool() : args[i].as_int();
+    }
+    size_t num_locals = call_targets[func_index].num_slots;
+    std::fill(locals + args.size(), locals + num_locals, 0);
+    frames.push_back(Frame{0, 0, func_index});
+    size_t pc = entry.entry_point;
+    
+    // The top of the operand stack is cached in `tos` and the rest is in
+    // memory below `sp`. An empty stack still has a value in `tos`, which a
+    // push spills into the slot reserved for it like any other, so every
+    // opcode has one form whatever the depth.
+    int32_t* sp = locals + num_locals;
+    int32_t tos = 0;
+    
+    // Verification bounds each frame, so the stack only has to be checked
+    // for room when a call pushes one starting at `base`
+    auto reserve = [&](int32_t* base, const CallTarget& callee) {
+        size_t needed = static_cast<size_t>(base - raw_stack.data()) + callee.raw_frame_size;
+        if (needed > raw_stack.size()) {
+            ptrdiff_t sp_offset = sp - raw_stack.data();
+            ptrdiff_t locals_offset = locals - raw_stack.data();
+            ptrdiff_t base_offset = base - raw_stack.data();
+            raw_stack.resize(std::max(needed, raw_stack.size() * 2));
+            sp = raw_stack.data() + sp_offset;
+            locals = raw_stack.data() + locals_offset;
+            base = raw_stack.data() + base_offset;
+        }
+        return base;
+    };
+    
+    while (true) {
+        const Instruction& instr = instructions[pc++];
+        PROFILE(step(instr.opcode, frames.back().func_index));
+        
+        switch (instr.opcode) {
+            case Opcode::PUSH_I32:
+            case Opcode::PUSH_BOOL:
+                *sp++ = tos;
+                tos = static_cast<int32_t>(instr.operand);
+                break;
+            case Opcode::POP:
+                tos = *--sp;
+                break;
+            case Opcode::DUP:
+                *sp++ = tos;
+                break;
+            case Opcode::SWAP:
+                std::swap(sp[-1], tos);
+                break;
+            case Opcode::LOAD:
+                *sp++ = tos;
+                tos = locals[instr.operand];
+                break;
+            case Opcode::STORE:
+                locals[instr.operand] = tos;
+                tos = *--sp;
+                break;
+            
+            case Opcode::ADD_I32:
+                tos = wrap(static_cast<uint32_t>(*--sp) + static_cast<uint32_t>(tos));
+                break;
+            case Opcode::SUB_I32:
+                tos = wrap(static_cast<uint32_t>(*--sp) - static_cast<uint32_t>(tos));
+                break;
+            case Opcode::MUL_I32:
+                tos = wrap(static_cast<uint32_t>(*--sp) * static_cast<uint32_t>(tos));
+                break;
+            case Opcode::DIV_I32: {
+                int32_t a = *--sp;
+                if (tos == 0) {
+                    throw std::runtime_error("Division by zero");
+                }
+                tos = tos == -1 ? wrap(0u - static_cast<uint32_t>(a)) : a / tos;
+                break;
+            }
+            case Opcode::NEG_I32:
+                tos = wrap(0u - static_cast<uint32_t>(tos));
+                break;
+            
+            case Opcode::EQ_I32:
+                tos = *--sp == tos;
+                break;
+            case Opcode::NE_I32:
+                tos = *--sp != tos;
+                break;
+            case Opcode::LT_I32:
+                tos = *--sp < tos;
+                break;
+            case Opcode::GT_I32:
+                tos = *--sp > tos;
+                break;
+            case Opcode::LE_I32:
+                tos = *--sp <= tos;
+                break;
+            case Opcode::GE_I32:
+                tos = *--sp >= tos;
+                break;
+            
+            case Opcode::AND:
+                tos = *--sp && tos;
+                break;
+            case Opcode::OR:
+                tos = *--sp || tos;
+                break;
+            case Opcode::NOT:
+                tos = !tos;
+                break;
+            
+            case Opcode::JMP:
+                poll_sampler(pc - 1);
+                pc = instr.operand;
+                break;
+            case Opcode::JMP_IF: {
+                bool condition = tos;
+                tos = *--sp;
+                if (condition) {
+                    pc = instr.operand;
+                }
+                break;
+            }
+            case Opcode::JMP_IF_NOT: {
+                bool condition = tos;
+                tos = *--sp;
+                if (!condition) {
+                    pc = instr.operand;
+                }
+                break;
+            }
+            case Opcode::CALL: {
+                poll_sampler(pc - 1);
+                // Spill the last argument so all of them are in memory
+                const CallTarget& callee = call_targets[instr.operand];
+                check_depth(instr.operand);
+                *sp++ = tos;
+                int32_t* base = reserve(sp - callee.num_params, callee);
+                int32_t* top = base + callee.num_params;
+                std::reverse(base, top);
+                std::fill(top, base + callee.num_slots, 0);
+                frames.push_back(Frame{pc, static_cast<size_t>(base - raw_stack.data()), instr.operand});
+                locals = base;
+                sp = base + callee.num_slots;
+                pc = callee.entry_point;
+                break;
+            }
+            case Opcode::TAIL_CALL: {
+                poll_sampler(pc - 1);
+                const CallTarget& callee = call_targets[instr.operand];
+                *sp++ = tos;
+                reserve(locals, callee);
+                int32_t* arguments = sp - callee.num_params;
+                std::reverse(arguments, sp);
+                std::copy(arguments, sp, locals);
+                std::fill(locals + callee.num_params, locals + callee.num_slots, 0);
+                frames.back().func_index = instr.operand;
+                sp = locals + callee.num_slots;
+                pc = callee.entry_point;
+                break;
+            }
+            case Opcode::RET:
+            case Opcode::RET_VAL: {
+                int32_t result = instr.opcode == Opcode::RET_VAL ? tos : 0;
+                Frame frame = frames.back();
+                frames.pop_back();
+                if (frames.empty()) {
+                    // Tail calls keep the declared return type, so the entry's is the result's
+                    const auto& type = entry.return_type;
+                    return type && type->kind == Type::Kind::Bool ? Value(result != 0) : Value(result);
+                }
+                // The caller's stack below the arguments is as it left it,
+                // with its own top already spilled
+                sp = raw_stack.data() + frame.base;
+                tos = result;
+                locals = raw_stack.data() + frames.back().base;
+                pc = frame.return_pc;
+                break;
+            }
+            
+            case Opcode::ADD_LL:
+                *sp++ = tos;
+                tos = wrap(static_cast<uint32_t>(locals[instr.operand]) + static_cast<uint32_t>(locals[instr.arg1]));
+                break;
+            case Opcode::ADD_LI:
+                *sp++ = tos;
+                tos = wrap(static_cast<uint32_t>(locals[instr.operand]) + instr.arg1);
+                break;
+            case Opcode::INC_LOCAL:
+                locals[instr.operand] = wrap(static_cast<uint32_t>(locals[instr.operand]) + instr.arg1);
+                break;
+            case Opcode::LT_LL_JMPNOT:
+                if (!(locals[instr.arg1] < locals[instr.arg2])) {
+                    pc = instr.operand;
+                }
+                break;
+            case Opcode::LT_LI_JMPNOT:
+                if (!(locals[instr.arg1] < static_cast<int32_t>(instr.arg2))) {
+                    pc = instr.operand;
+                }
+                break;
+            
+            default:
+                throw std::runtime_error("Unknown opcode: " + opcode_to_string(instr.opcode));
+        }
+    }
+}
+
+} // namespace nust
@@ -0,0 +1,232 @@
+#include "parser/parser.h"
+#include "type_checker.h"
+#include "c_emitter.h"
+#include "compiler.h"
+#include "vm.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <optional>
+
+namespace nust {
+
+class CEmitterTest : public ::testing::Test {
+protected:
+    std::string emit(const std::string& source) {
+        Parser parser(source);
+        auto program = parser.parse();
+        EXPECT_TRUE(program != nullptr);
+        
+        TypeChecker type_checker;
+        EXPECT_TRUE(type_checker.check_program(*program));
+        
+        return CEmitter().emit(*program);
+    }
+    
+    void expect_contains(const std::string& code, const std::string& expected) {
+        EXPECT_NE(code.find(expected), std::string::npos) << "missing: " << expected << "\nin:\n" << code;
+    }
+    
+    // Build the C code with the system compiler and run it, returning what it
+    // prints, or nothing if there is no C compiler
+    std::optional<std::string> build_and_run(const std::string& code, const std::string& args) {
+        if (std::system("cc --version > /dev/null 2>&1") != 0) {
+            return std::nullopt;
+        }
+        std::string base = ::testing::TempDir() + "nust_emit_c_test";
+        std::ofstream(base + ".c") << code;
+        std::string build = "cc -std=c99 -O2 -o " + base + " " + base + ".c";
+        EXPECT_EQ(std::system(build.c_str()), 0) << code;
+        std::string run = base + " " + args + " > " + base + ".out 2>&1";
+        std::system(run.c_str());
+        std::ifstream output(base + ".out");
+        std::string text((std::istreambuf_iterator<char>(output)), std::istreambuf_iterator<char>());
+        std::remove((base + ".c").c_str());
+        std::remove((base + ".out").c_str());
+        std::remove(base.c_str());
+        return text;
+    }
+};
+
+TEST_F(CEmitterTest, FunctionsAndLoops) {
+    std::string source = R"(
+        fn step(x: i32) -> i32 {
+            x * 3 + 1
+        }
+        
+        fn main(mut n: i32, mut total: i32) -> i32 {
+            while n > 0 {
+                if n / 2 * 2 == n {
+                    total = total + n;
+                } else {
+                    total = step(total);
+                }
+                n = n - 1;
+            }
+            total
+        }
+    )";
+    
+    std::string code = emit(source);
+    expect_contains(code, "int32_t fn_step(int32_t);");
+    expect_contains(code, "int32_t fn_main(int32_t v_n, int32_t v_total) {");
+    expect_contains(code, "    while ((v_n > 0)) {\n");
+    expect_contains(code, "            v_total = nust_add(v_total, v_n);\n");
+    expect_contains(code, "            v_total = fn_step(v_total);\n");
+    expect_contains(code, "    return v_total;\n");
+    
+    auto output = build_and_run(code, "10 0");
+    if (!output) {
+        GTEST_SKIP() << "No C compiler";
+    }
+    // Odd n: 9, 7, 5, 3, 1 apply step; even n add themselves
+    int total = 0;
+    for (int n = 10; n > 0; --n) {
+        total = n % 2 == 0 ? total + n : total * 3 + 1;
+    }
+    EXPECT_EQ(*output, std::to_string(total) + "\n");
+}
+
+TEST_F(CEmitterTest, ShadowingAndReservedNames) {
+    std::string source = R"(
+        fn main(int: i32, mut done: bool) -> bool {
+            let x: i32 = int * 2;
+            let nust_t0: i32 = x;
+            {
+                let x: i32 = x + 1;
+                done = x > 4 && !done;
+            }
+            done
+        }
+    )";
+    
+    std::string code = emit(source);
+    expect_contains(code, "bool fn_main(int32_t const v_int, bool v_done) {");
+    expect_contains(code, "    int32_t const v_x = nust_mul(v_int, 2);\n");
+    expect_contains(code, "    int32_t const v_nust_t0 = v_x;\n");
+    // The shadowing binding is initialized from the outer one
+    expect_contains(code, "        int32_t const v_x_1 = nust_add(v_x, 1);\n");
+    expect_contains(code, "        v_done = ((v_x_1 > 4) && !v_done);\n");
+    
+    auto output = build_and_run(code, "2 false");
+    if (!output) {
+        GTEST_SKIP() << "No C compiler";
+    }
+    EXPECT_EQ(*output, "true\n");
+}
+
+TEST_F(CEmitterTest, NamesTheHeadersDefine) {
+    std::string source = R"(
+        fn main(NULL: i32, errno: i32, mut int32_t: i32) -> i32 {
+            let stdout: i32 = NULL * 10;
+            let EOF: bool = errno > 0;
+            int32_t = int32_t + stdout + errno;
+            if EOF {
+                int32_t = int32_t + 1;
+            }
+            int32_t
+        }
+    )";
+    
+    std::string code = emit(source);
+    expect_contains(code, "int32_t fn_main(int32_t const v_NULL, int32_t const v_errno, int32_t v_int32_t) {");
+    expect_contains(code, "    int32_t const v_stdout = nust_mul(v_NULL, 10);\n");
+    
+    auto output = build_and_run(code, "4 2 0");
+    if (!output) {
+        GTEST_SKIP() << "No C compiler";
+    }
+    EXPECT_EQ(*output, "43\n");
+}
+
+TEST_F(CEmitterTest, StringsKeepTheirEscapes) {
+    // The VM doesn't interpret escapes, so neither may the C compiler; the
+    // literal also holds a newline, a trigraph and a digit after a tab
+    std::string source = "fn main() -> str {\n"
+                         "    \"a\\tb\\\"c \\\\ ?\?= \\0\n\t7\"\n"
+                         "}\n";
+    
+    Parser parser(source);
+    auto program = parser.parse();
+    ASSERT_TRUE(program != nullptr);
+    TypeChecker type_checker;
+    ASSERT_TRUE(type_checker.check_program(*program));
+    Compiler compiler;
+    auto instructions = compiler.compile(*program);
+    VM vm(instructions, compiler.get_function_table(), compiler.get_string_constants());
+    std::string expected = vm.call("main", {}).as_string();
+    EXPECT_EQ(expected, "a\\tb\\\"c \\\\ ?\?= \\0\n\t7");
+    
+    auto output = build_and_run(CEmitter().emit(*program), "");
+    if (!output) {
+        GTEST_SKIP() << "No C compiler";
+    }
+    EXPECT_EQ(*output, expected + "\n");
+}
+
+TEST_F(CEmitterTest, DivisionByZeroIsReported) {
+    std::string source = R"(
+        fn main(x: i32) -> i32 {
+            x / (x - 3) + -x
+        }
+    )";
+    
+    std::string code = emit(source);
+    expect_contains(code, "return nust_add(nust_div(v_x, nust_sub(v_x, 3)), nust_neg(v_x));");
+    
+    auto output = build_and_run(code, "3");
+    if (!output) {
+        GTEST_SKIP() << "No C compiler";
+    }
+    EXPECT_EQ(*output, "Error: Division by zero\n");
+}
+
+TEST_F(CEmitterTest, SideEffectsFollowTheVMOrder) {
+    std::string source = R"(
+        fn sub(a: i32, b: i32) -> i32 {
+            a - b
+        }
+        
+        fn main(mut x: i32, mut y: i32, mut r: i32) -> i32 {
+            let a: i32 = (x = 10) - x;
+            let b: i32 = x - (x = 3);
+            let c: i32 = sub((x = 5), x);
+            let d: i32 = sub(x * 2, sub(x, (x = 1)) + (y = 4));
+            let e: bool = a > 0 || sub((x = x + 1), x) == 0;
+            while (y = y - 1) > 0 && sub(y, (x = x + y)) < 0 {
+                x = x * 2;
+            }
+            if e {
+                r = 1;
+            }
+            r = ((((r * 10 + a) * 10 + b) * 10 + c) * 10 + d) * 100 + x * 10 + y;
+            r
+        }
+    )";
+    
+    std::string code = emit(source);
+    expect_contains(code, "    int32_t const nust_t0 = (v_x = 10);\n"
+                          "    int32_t const v_a = nust_sub(nust_t0, v_x);\n");
+    expect_contains(code, "    int32_t const nust_t2 = v_x;\n"
+                          "    int32_t const v_c = fn_sub((v_x = 5), nust_t2);\n");
+    expect_contains(code, "    while (true) {\n");
+    
+    Parser parser(source);
+    auto program = parser.parse();
+    TypeChecker type_checker;
+    ASSERT_TRUE(type_checker.check_program(*program));
+    Compiler compiler;
+    auto instructions = compiler.compile(*program);
+    VM vm(instructions, compiler.get_function_table(), compiler.get_string_constants());
+    auto expected = vm.call("main", {Value(0), Value(0), Value(0)}).as_int();
+    
+    auto output = build_and_run(code, "0 0 0");
+    if (!output) {
+        GTEST_SKIP() << "No C compiler";
+    }
+    EXPECT_EQ(*output, std::to_string(expected) + "\n");
+}
+
+} // namespace nust
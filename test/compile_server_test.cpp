@@ -0,0 +1,128 @@
+#include "compile_server.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace nust {
+
+namespace {
+
+const char* const source = R"(
+    fn main(x: i32) -> i32 {
+        x + 1
+    }
+)";
+
+} // namespace
+
+TEST(CompileServerTest, CachesBySourceAndOptions) {
+    CompileServer server;
+    auto first = server.compile({false, false, source});
+    ASSERT_TRUE(first->ok);
+    EXPECT_NE(first->assembly.find("ADD_I32"), std::string::npos);
+    EXPECT_EQ(server.compile({false, false, source}), first);
+    EXPECT_EQ(server.cache_hits(), 1u);
+
+    // Different options are a different entry
+    auto debug = server.compile({false, true, source});
+    EXPECT_NE(debug, first);
+    EXPECT_GT(debug->bytecode.size(), first->bytecode.size());
+    EXPECT_EQ(server.cache_misses(), 2u);
+
+    auto failed = server.compile({false, false, "fn main() -> i32 { true }"});
+    EXPECT_FALSE(failed->ok);
+    EXPECT_NE(failed->diagnostics.find("Function return type mismatch"), std::string::npos);
+}
+
+TEST(CompileServerTest, EvictsLeastRecentlyUsed) {
+    // Each of these sources compiles to as many bytes as the others
+    size_t entry_size = 0;
+    {
+        CompileServer sizing;
+        sizing.compile({false, false, "fn a() -> i32 { 1 }"});
+        entry_size = sizing.cache_size();
+    }
+    ASSERT_GT(entry_size, 0u);
+
+    CompileServer server(2 * entry_size);
+    server.compile({false, false, "fn a() -> i32 { 1 }"});
+    server.compile({false, false, "fn b() -> i32 { 2 }"});
+    server.compile({false, false, "fn a() -> i32 { 1 }"});
+    server.compile({false, false, "fn c() -> i32 { 3 }"});  // Evicts b
+    EXPECT_EQ(server.cache_misses(), 3u);
+    EXPECT_EQ(server.cache_size(), 2 * entry_size);
+    server.compile({false, false, "fn a() -> i32 { 1 }"});
+    EXPECT_EQ(server.cache_misses(), 3u);
+    server.compile({false, false, "fn b() -> i32 { 2 }"});
+    EXPECT_EQ(server.cache_misses(), 4u);
+
+    // Output bigger than the whole cache isn't kept
+    CompileServer tiny(entry_size - 1);
+    tiny.compile({false, false, "fn a() -> i32 { 1 }"});
+    tiny.compile({false, false, "fn a() -> i32 { 1 }"});
+    EXPECT_EQ(tiny.cache_misses(), 2u);
+    EXPECT_EQ(tiny.cache_size(), 0u);
+}
+
+TEST(CompileServerTest, ServesOverSocket) {
+    std::string path = "/tmp/nust_test_" + std::to_string(getpid()) + ".sock";
+    CompileServer server;
+    std::thread serving([&] { server.serve(path); });
+
+    // The socket appears once the server is listening
+    CompileResponse response;
+    for (int attempt = 0;; ++attempt) {
+        try {
+            response = request_compile(path, {true, false, source});
+            break;
+        } catch (const std::runtime_error&) {
+            ASSERT_LT(attempt, 500);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    EXPECT_TRUE(response.ok);
+    EXPECT_EQ(response.assembly, server.compile({true, false, source})->assembly);
+
+    CompileResponse failed = request_compile(path, {false, false, "fn main( -> i32 { 1 }"});
+    EXPECT_FALSE(failed.ok);
+    EXPECT_NE(failed.diagnostics.find("Parse error"), std::string::npos);
+
+    // A second server must not take over the socket
+    CompileServer other;
+    EXPECT_THROW(other.serve(path), std::runtime_error);
+
+    server.stop();
+    serving.join();
+    EXPECT_EQ(access(path.c_str(), F_OK), -1);
+    EXPECT_THROW(request_compile(path, {false, false, source}), std::runtime_error);
+}
+
+TEST(CompileServerTest, ReplacesOnlyStaleSockets) {
+    std::string path = "/tmp/nust_test_" + std::to_string(getpid()) + ".nust";
+    std::ofstream(path) << source;
+    CompileServer server;
+    EXPECT_THROW(server.serve(path), std::runtime_error);
+    EXPECT_EQ(access(path.c_str(), F_OK), 0);
+    std::remove(path.c_str());
+
+    // A socket whose server exited without removing it
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_EQ(bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)), 0);
+    close(fd);
+    // Stopped ahead of time, serve() returns as soon as it is listening
+    server.stop();
+    server.serve(path);
+    EXPECT_EQ(access(path.c_str(), F_OK), -1);
+}
+
+} // namespace nust
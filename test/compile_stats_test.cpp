@@ -0,0 +1,77 @@
+#include "parser/parser.h"
+#include "compiler.h"
+#include "compile_stats.h"
+#include <gtest/gtest.h>
+#include <sstream>
+#include <stdexcept>
+
+namespace nust {
+
+TEST(CompileStatsTest, CountsNodesAndOpcodes) {
+    Parser parser(R"(
+        fn add(a: i32, b: i32) -> i32 {
+            a + b
+        }
+
+        fn main() -> i32 {
+            let mut x: i32 = add(1, 2);
+            if x > 2 {
+                x = 0;
+            }
+            x
+        }
+    )");
+    auto program = parser.parse();
+    ASSERT_TRUE(program != nullptr);
+    Compiler compiler;
+    auto instructions = compiler.compile(*program);
+
+    CompileStats stats;
+    stats.count_nodes(*program);
+    stats.count_instructions(instructions);
+    const auto& nodes = stats.get_node_counts();
+    EXPECT_EQ(nodes.at("FunctionDecl"), 2u);
+    EXPECT_EQ(nodes.at("Param"), 2u);
+    EXPECT_EQ(nodes.at("CallExpr"), 1u);
+    EXPECT_EQ(nodes.at("IntLiteral"), 4u);
+    EXPECT_EQ(nodes.at("IfStmt"), 1u);
+    EXPECT_EQ(stats.get_opcode_counts().at("CALL"), 1u);
+    EXPECT_EQ(stats.get_opcode_counts().at("ADD_I32"), 1u);
+}
+
+TEST(CompileStatsTest, MeasuresPhases) {
+    CompileStats stats;
+    EXPECT_EQ(stats.measure("first", [] { return 42; }), 42);
+    EXPECT_THROW(stats.measure("failing", []() -> int { throw std::runtime_error("failed"); }),
+                 std::runtime_error);
+
+    const auto& phases = stats.get_phases();
+    ASSERT_EQ(phases.size(), 2u);
+    EXPECT_EQ(phases[0].name, "first");
+    EXPECT_EQ(phases[1].name, "failing");
+    EXPECT_GE(phases[0].wall_ms, 0.0);
+    EXPECT_EQ(phases[0].allocations.count, 0u);
+}
+
+TEST(CompileStatsTest, WritesTextAndJson) {
+    CompileStats stats;
+    stats.measure("parse", [] {});
+    stats.set_function_count(3);
+    stats.set_string_constants({"ab", "cde"});
+
+    std::ostringstream times;
+    stats.write_text(times, true, false);
+    EXPECT_NE(times.str().find("wall ms"), std::string::npos);
+    EXPECT_EQ(times.str().find("allocs"), std::string::npos);
+    EXPECT_EQ(times.str().find("functions"), std::string::npos);
+
+    std::ostringstream json;
+    stats.write_json(json, false, true);
+    EXPECT_NE(json.str().find("{\"name\": \"parse\", \"allocations\": "), std::string::npos);
+    EXPECT_NE(json.str().find("\"functions\": 3"), std::string::npos);
+    EXPECT_NE(json.str().find("\"string_constant_bytes\": 5"), std::string::npos);
+    EXPECT_NE(json.str().find("\"peak_rss_bytes\": "), std::string::npos);
+    EXPECT_EQ(json.str().find("wall_ms"), std::string::npos);
+}
+
+} // namespace nust
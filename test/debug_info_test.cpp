@@ -0,0 +1,133 @@
+#include "parser/parser.h"
+#include "type_checker.h"
+#include "compiler.h"
+#include "debug_info.h"
+#include "sampling_profiler.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <sstream>
+
+namespace nust {
+
+class DebugInfoTest : public ::testing::Test {
+protected:
+    std::vector<Instruction> compile(const std::string& source, CompilerOptions options = CompilerOptions()) {
+        Parser parser(source);
+        auto program = parser.parse();
+        EXPECT_TRUE(program != nullptr);
+
+        TypeChecker type_checker;
+        EXPECT_TRUE(type_checker.check_program(*program));
+
+        compiler = std::make_unique<Compiler>(options);
+        return compiler->compile(*program);
+    }
+
+    // Line and column of the first instruction with the given opcode
+    SourceLocation locate(const std::vector<Instruction>& instructions, const std::string& source, Opcode opcode) {
+        auto it = std::find_if(instructions.begin(), instructions.end(),
+                               [&](const Instruction& instr) { return instr.opcode == opcode; });
+        EXPECT_NE(it, instructions.end());
+        SourceMap map{compiler->get_span_table(), LineIndex(source)};
+        auto location = map.locate(static_cast<size_t>(it - instructions.begin()));
+        EXPECT_TRUE(location.has_value());
+        return location.value_or(SourceLocation{0, 0});
+    }
+
+    std::unique_ptr<Compiler> compiler;
+};
+
+TEST_F(DebugInfoTest, LineIndexResolvesOffsets) {
+    LineIndex lines("ab\ncd\n\nefg");
+    EXPECT_EQ(lines.line_count(), 4u);
+    EXPECT_EQ(lines.locate(0).line, 1u);
+    EXPECT_EQ(lines.locate(0).column, 1u);
+    EXPECT_EQ(lines.locate(2).line, 1u);
+    EXPECT_EQ(lines.locate(2).column, 3u);
+    EXPECT_EQ(lines.locate(3).line, 2u);
+    EXPECT_EQ(lines.locate(6).line, 3u);
+    EXPECT_EQ(lines.locate(9).line, 4u);
+    EXPECT_EQ(lines.locate(9).column, 3u);
+}
+
+TEST_F(DebugInfoTest, SpanTableRoundTrips) {
+    std::vector<Span> spans = {{10, 20}, {10, 20}, {4, 6}, {300, 310}, {300, 310}, {300, 310}, {0, 1}};
+    SpanTable table = SpanTable::build(spans);
+    // Four runs of three one-byte numbers, except the start deltas to and
+    // from 300, plus the closing distance
+    EXPECT_EQ(table.encoded().size(), 15u);
+    for (size_t pc = 0; pc < spans.size(); ++pc) {
+        auto span = table.find(pc);
+        ASSERT_TRUE(span.has_value());
+        EXPECT_EQ(span->start, spans[pc].start);
+        EXPECT_EQ(span->end, spans[pc].end);
+    }
+    EXPECT_FALSE(table.find(spans.size()).has_value());
+    EXPECT_FALSE(SpanTable().find(0).has_value());
+}
+
+TEST_F(DebugInfoTest, SectionIsReadFromTheEndOfTheFile) {
+    SpanTable table = SpanTable::build({{1, 2}, {5, 9}});
+    std::stringstream file;
+    file << "code bytes";
+    table.write_section(file);
+
+    file.seekg(4);
+    SpanTable loaded = SpanTable::read_section(file);
+    EXPECT_EQ(loaded.encoded(), table.encoded());
+    EXPECT_EQ(file.tellg(), 4);
+    ASSERT_TRUE(loaded.find(1).has_value());
+    EXPECT_EQ(loaded.find(1)->start, 5u);
+
+    std::stringstream plain("no debug info here");
+    EXPECT_TRUE(SpanTable::read_section(plain).empty());
+}
+
+TEST_F(DebugInfoTest, InstructionsMapToTheirSourceLines) {
+    std::string source = R"(fn scale(x: i32) -> i32 {
+    x * 3
+}
+
+fn sum(n: i32, mut total: i32) -> i32 {
+    let mut i: i32 = 0;
+    while i < n {
+        total = total + scale(i);
+        i = i + 1;
+    }
+    total
+})";
+    for (bool optimize : {false, true}) {
+        auto instructions = compile(source, optimize ? CompilerOptions::optimized() : CompilerOptions());
+        EXPECT_EQ(compiler->get_span_table().find(instructions.size() - 1).has_value(), true);
+
+        SourceLocation mul = locate(instructions, source, Opcode::MUL_I32);
+        EXPECT_EQ(mul.line, 2u);
+        EXPECT_EQ(mul.column, 5u);
+        if (optimize) {
+            // Fused and inlined instructions keep pointing at their source
+            EXPECT_EQ(locate(instructions, source, Opcode::INC_LOCAL).line, 9u);
+            EXPECT_EQ(locate(instructions, source, Opcode::LT_LL_JMPNOT).line, 7u);
+        } else {
+            EXPECT_EQ(locate(instructions, source, Opcode::CALL).line, 8u);
+            EXPECT_EQ(locate(instructions, source, Opcode::LT_I32).line, 7u);
+        }
+    }
+}
+
+TEST_F(DebugInfoTest, FoldedStacksUseSourceLocations) {
+    std::string source = "fn main() -> i32 {\n    1 + 2\n}";
+    auto instructions = compile(source);
+    auto add = std::find_if(instructions.begin(), instructions.end(),
+                            [](const Instruction& instr) { return instr.opcode == Opcode::ADD_I32; });
+    ASSERT_NE(add, instructions.end());
+
+    uint32_t main = 0;
+    SamplingProfiler profiler;
+    profiler.record(&main, 1, static_cast<size_t>(add - instructions.begin()));
+    SourceMap map{compiler->get_span_table(), LineIndex(source)};
+    std::ostringstream folded;
+    profiler.write_folded(folded, compiler->get_function_table(), true, &map);
+    EXPECT_EQ(folded.str(), "main;2:5 1\n");
+}
+
+} // namespace nust
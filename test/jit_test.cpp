@@ -0,0 +1,167 @@
+#include "parser/parser.h"
+#include "type_checker.h"
+#include "compiler.h"
+#include "vm.h"
+#include "jit.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+namespace nust {
+
+class JitTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        if (!JitCompiler::supported()) {
+            GTEST_SKIP() << "No JIT for this platform";
+        }
+    }
+
+    // Compile the source into a VM that compiles functions after `threshold`
+    // calls and loop back edges
+    std::unique_ptr<VM> load(const std::string& source, size_t threshold = 0,
+                             CompilerOptions options = CompilerOptions()) {
+        Parser parser(source);
+        auto program = parser.parse();
+        EXPECT_TRUE(program != nullptr);
+
+        TypeChecker type_checker;
+        EXPECT_TRUE(type_checker.check_program(*program));
+
+        compiler = std::make_unique<Compiler>(options);
+        auto instructions = compiler->compile(*program);
+        VMOptions vm_options;
+        vm_options.jit.enabled = true;
+        vm_options.jit.threshold = threshold;
+        return std::make_unique<VM>(instructions, compiler->get_function_table(),
+                                    compiler->get_string_constants(), vm_options);
+    }
+
+    std::unique_ptr<Compiler> compiler;
+};
+
+TEST_F(JitTest, CompilesIntegerLoops) {
+    std::string source = R"(
+        fn sum(n: i32, mut total: i32) -> i32 {
+            let mut i: i32 = 0;
+            while i < n {
+                total = total + i * 3 / 2 - -i;
+                i = i + 1;
+            }
+            total
+        }
+    )";
+
+    for (bool optimized : {false, true}) {
+        auto vm = load(source, 0, optimized ? CompilerOptions::optimized() : CompilerOptions());
+        EXPECT_EQ(vm->call("sum", {Value(1000), Value(0)}).as_int(), 1248500);
+        EXPECT_TRUE(vm->is_compiled("sum"));
+    }
+}
+
+TEST_F(JitTest, WrapsLikeTheInterpreter) {
+    std::string source = R"(
+        fn main(x: i32, y: i32) -> i32 {
+            x * 65536 + x / y
+        }
+    )";
+
+    auto vm = load(source);
+    // INT_MIN / -1 negates instead of trapping
+    EXPECT_EQ(vm->call("main", {Value(-2147483647 - 1), Value(-1)}).as_int(), -2147483647 - 1);
+    EXPECT_EQ(vm->call("main", {Value(65536), Value(7)}).as_int(), 65536 / 7);
+    EXPECT_TRUE(vm->is_compiled("main"));
+}
+
+TEST_F(JitTest, KeepsBooleans) {
+    std::string source = R"(
+        fn main(a: i32, b: bool, mut c: bool) -> bool {
+            c = a > 3 && !b;
+            let d: bool = a == 4 || b;
+            c = c == d;
+            c
+        }
+    )";
+
+    auto vm = load(source);
+    Value result = vm->call("main", {Value(4), Value(false), Value(false)});
+    ASSERT_TRUE(result.is_bool());
+    EXPECT_TRUE(result.as_bool());
+    EXPECT_FALSE(vm->call("main", {Value(5), Value(false), Value(false)}).as_bool());
+    EXPECT_TRUE(vm->is_compiled("main"));
+}
+
+TEST_F(JitTest, ExitsToInterpreterOnDivisionByZero) {
+    std::string source = R"(
+        fn main(n: i32, mut total: i32) -> i32 {
+            let mut i: i32 = 3;
+            while i > -1 {
+                total = total + n / i;
+                i = i - 1;
+            }
+            total
+        }
+    )";
+
+    auto vm = load(source);
+    EXPECT_THROW(vm->call("main", {Value(12), Value(0)}), std::runtime_error);
+    EXPECT_TRUE(vm->is_compiled("main"));
+}
+
+TEST_F(JitTest, ReentersAtLoopHeadersAfterCalls) {
+    std::string source = R"(
+        fn square(x: i32) -> i32 {
+            x * x
+        }
+
+        fn main(n: i32, mut total: i32) -> i32 {
+            let mut i: i32 = 0;
+            while i < n {
+                total = total + square(i);
+                i = i + 1;
+            }
+            total
+        }
+    )";
+
+    auto vm = load(source, 10);
+    EXPECT_EQ(vm->call("main", {Value(100), Value(0)}).as_int(), 328350);
+    EXPECT_TRUE(vm->is_compiled("main"));
+    EXPECT_TRUE(vm->is_compiled("square"));
+}
+
+TEST_F(JitTest, WaitsForThreshold) {
+    std::string source = R"(
+        fn id(x: i32) -> i32 {
+            x
+        }
+    )";
+
+    auto vm = load(source, 3);
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(vm->call("id", {Value(i)}).as_int(), i);
+        EXPECT_FALSE(vm->is_compiled("id"));
+    }
+    EXPECT_EQ(vm->call("id", {Value(7)}).as_int(), 7);
+    EXPECT_TRUE(vm->is_compiled("id"));
+}
+
+TEST_F(JitTest, LeavesStringsAndReferencesToTheInterpreter) {
+    std::string source = R"(
+        fn named(x: i32, name: str) -> i32 {
+            x + 1
+        }
+
+        fn borrows(x: i32) -> i32 {
+            let r: &i32 = &x;
+            x + 2
+        }
+    )";
+
+    auto vm = load(source);
+    EXPECT_EQ(vm->call("named", {Value(1), Value(std::string("x"))}).as_int(), 2);
+    EXPECT_EQ(vm->call("borrows", {Value(1)}).as_int(), 3);
+    EXPECT_FALSE(vm->is_compiled("named"));
+    EXPECT_FALSE(vm->is_compiled("borrows"));
+}
+
+} // namespace nust
@@ -546,4 +546,37 @@ TEST(ParserTest, AssignmentWithLogicalOperators) {
     ASSERT_TRUE(true_lit->value);
 }
 
+TEST(ParserTest, StringLiteralContents) {
+    std::string source = R"(
+        fn main() -> str {
+            let a: str = "   padded";
+            "// not a comment"
+        }
+    )";
+    
+    Parser parser(source);
+    auto program = parser.parse();
+    ASSERT_TRUE(program != nullptr);
+    
+    auto* func = dynamic_cast<FunctionDecl*>(program->items[0].get());
+    ASSERT_TRUE(func != nullptr);
+    auto* body = dynamic_cast<BlockStmt*>(func->body.get());
+    ASSERT_TRUE(body != nullptr);
+    ASSERT_EQ(body->statements.size(), 2);
+    
+    // Leading spaces belong to the string
+    auto* let = dynamic_cast<LetStmt*>(body->statements[0].get());
+    ASSERT_TRUE(let != nullptr);
+    auto* padded = dynamic_cast<StringLiteral*>(let->init.get());
+    ASSERT_TRUE(padded != nullptr);
+    ASSERT_EQ(padded->value, "   padded");
+    
+    // So does a leading //, which doesn't start a comment inside the quotes
+    auto* tail = dynamic_cast<ExprStmt*>(body->statements[1].get());
+    ASSERT_TRUE(tail != nullptr);
+    auto* slashes = dynamic_cast<StringLiteral*>(tail->expr.get());
+    ASSERT_TRUE(slashes != nullptr);
+    ASSERT_EQ(slashes->value, "// not a comment");
+}
+
 } // namespace nust 
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "parser/parser.h"
+#include "type_checker.h"
+#include "compiler.h"
+#include "profiler.h"
+#include "vm.h"
+#include <gtest/gtest.h>
+#include <numeric>
+#include <sstream>
+
+namespace nust {
+
+class ProfilerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Parser parser("fn main() -> i32 { 1 } fn helper() -> i32 { 2 }");
+        auto program = parser.parse();
+        ASSERT_TRUE(program != nullptr);
+        compiler.compile(*program);
+    }
+
+    Compiler compiler;
+};
+
+TEST_F(ProfilerTest, CountsOpcodesTransitionsAndFunctions) {
+    OpcodeProfiler profiler;
+    profiler.step(Opcode::LOAD, 0);
+    profiler.step(Opcode::LOAD, 0);
+    profiler.step(Opcode::ADD_I32, 0);
+    profiler.step(Opcode::CALL, 0);
+    profiler.step(Opcode::LOAD, 1);
+    profiler.step(Opcode::RET_VAL, 1);
+    profiler.stop();
+
+    EXPECT_EQ(profiler.stats(Opcode::LOAD).count, 3u);
+    EXPECT_EQ(profiler.stats(Opcode::ADD_I32).count, 1u);
+    EXPECT_EQ(profiler.stats(Opcode::SUB_I32).count, 0u);
+    EXPECT_EQ(profiler.transition_count(Opcode::LOAD, Opcode::LOAD), 1u);
+    EXPECT_EQ(profiler.transition_count(Opcode::LOAD, Opcode::ADD_I32), 1u);
+    EXPECT_EQ(profiler.transition_count(Opcode::CALL, Opcode::LOAD), 1u);
+    EXPECT_EQ(profiler.transition_count(Opcode::ADD_I32, Opcode::LOAD), 0u);
+    EXPECT_EQ(profiler.function_counts(), (std::vector<uint64_t>{4, 2}));
+
+    // Every executed instruction lands in exactly one histogram bucket
+    for (Opcode opcode : {Opcode::LOAD, Opcode::ADD_I32, Opcode::RET_VAL}) {
+        const auto& stats = profiler.stats(opcode);
+        EXPECT_EQ(std::accumulate(stats.histogram.begin(), stats.histogram.end(), uint64_t(0)), stats.count);
+    }
+
+    profiler.reset();
+    EXPECT_EQ(profiler.stats(Opcode::LOAD).count, 0u);
+    EXPECT_TRUE(profiler.function_counts().empty());
+}
+
+TEST_F(ProfilerTest, CancelledInstructionsAreNotCharged) {
+    OpcodeProfiler profiler;
+    profiler.step(Opcode::DIV_I32, 0);
+    profiler.cancel();
+    profiler.step(Opcode::PUSH_I32, 0);
+    profiler.stop();
+
+    const auto& histogram = profiler.stats(Opcode::DIV_I32).histogram;
+    EXPECT_EQ(std::accumulate(histogram.begin(), histogram.end(), uint64_t(0)), 0u);
+    EXPECT_EQ(profiler.transition_count(Opcode::DIV_I32, Opcode::PUSH_I32), 0u);
+}
+
+TEST_F(ProfilerTest, WritesJsonAndTable) {
+    OpcodeProfiler profiler;
+    profiler.step(Opcode::PUSH_I32, 1);
+    profiler.step(Opcode::RET_VAL, 1);
+    profiler.stop();
+
+    std::ostringstream json;
+    profiler.write_json(json, compiler.get_function_table());
+    EXPECT_NE(json.str().find("{\"opcode\": \"PUSH_I32\", \"count\": 1"), std::string::npos);
+    EXPECT_NE(json.str().find("{\"from\": \"PUSH_I32\", \"to\": \"RET_VAL\", \"count\": 1}"), std::string::npos);
+    EXPECT_NE(json.str().find("{\"name\": \"helper\", \"instructions\": 2}"), std::string::npos);
+    EXPECT_EQ(json.str().find("ADD_I32"), std::string::npos);
+
+    std::ostringstream table;
+    profiler.write_table(table, compiler.get_function_table());
+    EXPECT_NE(table.str().find("PUSH_I32 -> RET_VAL"), std::string::npos);
+    EXPECT_NE(table.str().find("helper"), std::string::npos);
+}
+
+#if NUST_PROFILE
+TEST_F(ProfilerTest, ProfilesTheInterpreter) {
+    Parser parser(R"(
+        fn sum(n: i32, mut total: i32) -> i32 {
+            let mut i: i32 = 0;
+            while i < n {
+                total = total + i;
+                i = i + 1;
+            }
+            total
+        }
+    )");
+    auto program = parser.parse();
+    ASSERT_TRUE(program != nullptr);
+    Compiler sum_compiler;
+    auto instructions = sum_compiler.compile(*program);
+
+    for (bool verify : {false, true}) {
+        VMOptions options;
+        options.verify = verify;
+        VM vm(instructions, sum_compiler.get_function_table(), {}, options);
+        EXPECT_EQ(vm.call("sum", {Value(10), Value(0)}).as_int(), 45);
+        EXPECT_EQ(vm.get_profiler().stats(Opcode::ADD_I32).count, 20u);
+        EXPECT_EQ(vm.get_profiler().stats(Opcode::RET_VAL).count, 1u);
+    }
+}
+#endif
+
+} // namespace nust
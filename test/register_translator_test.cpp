@@ -0,0 +1,127 @@
+#include "parser/parser.h"
+#include "type_checker.h"
+#include "compiler.h"
+#include "register_translator.h"
+#include <gtest/gtest.h>
+#include <sstream>
+
+namespace nust {
+
+class RegisterTranslatorTest : public ::testing::Test {
+protected:
+    RegisterProgram translate(const std::string& source, CompilerOptions options = CompilerOptions()) {
+        Parser parser(source);
+        auto program = parser.parse();
+        EXPECT_TRUE(program != nullptr);
+        
+        TypeChecker type_checker;
+        EXPECT_TRUE(type_checker.check_program(*program));
+        
+        Compiler compiler(options);
+        auto instructions = compiler.compile(*program);
+        return RegisterTranslator().translate(instructions, compiler.get_function_table(),
+                                              compiler.get_string_constants());
+    }
+    
+    void expect_instruction(const RegisterProgram& program, size_t index, RegOpcode opcode,
+                            uint32_t a, uint32_t b = 0, uint32_t c = 0) {
+        ASSERT_LT(index, program.code.size());
+        const auto& instr = program.code[index];
+        EXPECT_EQ(instr.opcode, opcode) << "at " << index;
+        EXPECT_EQ(instr.a, a) << "at " << index;
+        if (instr.num_operands() > 1) {
+            EXPECT_EQ(instr.b, b) << "at " << index;
+        }
+        if (instr.num_operands() > 2) {
+            EXPECT_EQ(instr.c, c) << "at " << index;
+        }
+    }
+};
+
+TEST_F(RegisterTranslatorTest, OperandsAddressSlots) {
+    std::string source = R"(
+        fn main(x: i32, y: i32, mut z: i32) -> i32 {
+            z = x + y;
+            z = z * 2;
+            z
+        }
+    )";
+    
+    RegisterProgram program = translate(source);
+    
+    // LOAD 0; LOAD 1; ADD_I32; STORE 2 becomes a single instruction
+    //  0: ADD_I32 r2, r0, r1
+    //  1: MUL_I32 r2, r2, #2
+    //  2: RET_VAL r2
+    ASSERT_EQ(program.code.size(), 3);
+    ASSERT_EQ(program.constants.size(), 1);
+    EXPECT_EQ(program.constants[0].as_int(), 2);
+    expect_instruction(program, 0, RegOpcode::ADD_I32, 2, 0, 1);
+    expect_instruction(program, 1, RegOpcode::MUL_I32, 2, 2, REG_CONSTANT | 0);
+    expect_instruction(program, 2, RegOpcode::RET_VAL, 2);
+    EXPECT_EQ(program.functions[0].num_registers, 5);
+}
+
+TEST_F(RegisterTranslatorTest, JumpsAgreeOnRegisters) {
+    std::string source = R"(
+        fn main(a: bool, b: bool) -> bool {
+            a && b
+        }
+    )";
+    
+    RegisterProgram program = translate(source);
+    
+    // a; DUP; JMP_IF_NOT end; POP; b; end: leaves the result in the first
+    // temporary on both paths
+    //  0: MOVE r2, r0
+    //  1: JMP_IF_NOT 3, r0
+    //  2: MOVE r2, r1
+    //  3: RET_VAL r2
+    ASSERT_EQ(program.code.size(), 4);
+    expect_instruction(program, 0, RegOpcode::MOVE, 2, 0);
+    expect_instruction(program, 1, RegOpcode::JMP_IF_NOT, 3, 0);
+    expect_instruction(program, 2, RegOpcode::MOVE, 2, 1);
+    expect_instruction(program, 3, RegOpcode::RET_VAL, 2);
+}
+
+TEST_F(RegisterTranslatorTest, CallsPassArgumentsInTemporaries) {
+    std::string source = R"(
+        fn sub(x: i32, y: i32) -> i32 {
+            x - y
+        }
+        
+        fn main(a: i32) -> i32 {
+            sub(a, 1) + 1
+        }
+    )";
+    
+    RegisterProgram program = translate(source);
+    size_t entry = program.functions[1].entry_point;
+    
+    // Arguments are in stack order, last argument first:
+    //  MOVE r1, #1
+    //  MOVE r2, r0
+    //  CALL 0, r1
+    //  ADD_I32 r1, r1, #1
+    //  RET_VAL r1
+    expect_instruction(program, entry, RegOpcode::MOVE, 1, REG_CONSTANT | 0);
+    expect_instruction(program, entry + 1, RegOpcode::MOVE, 2, 0);
+    expect_instruction(program, entry + 2, RegOpcode::CALL, 0, 1);
+    expect_instruction(program, entry + 3, RegOpcode::ADD_I32, 1, 1, REG_CONSTANT | 0);
+}
+
+TEST_F(RegisterTranslatorTest, WritesRegisterCode) {
+    RegisterProgram program = translate(R"(
+        fn main(x: i32) -> i32 {
+            x + 1
+        }
+    )");
+    
+    std::ostringstream out;
+    write_register_code(out, program);
+    EXPECT_EQ(out.str(), "; main at 0, 3 registers\n"
+                         "ADD_I32 r1, r0, #1\n"
+                         "RET_VAL r1\n");
+}
+
+} // namespace nust
@@ -0,0 +1,113 @@
+#include "parser/parser.h"
+#include "type_checker.h"
+#include "compiler.h"
+#include "sampling_profiler.h"
+#include "vm.h"
+#include <gtest/gtest.h>
+#include <sstream>
+#include <stdexcept>
+
+namespace nust {
+
+class SamplingProfilerTest : public ::testing::Test {
+protected:
+    std::vector<Instruction> compile(const std::string& source) {
+        Parser parser(source);
+        auto program = parser.parse();
+        EXPECT_TRUE(program != nullptr);
+
+        TypeChecker type_checker;
+        EXPECT_TRUE(type_checker.check_program(*program));
+
+        compiler = std::make_unique<Compiler>();
+        return compiler->compile(*program);
+    }
+
+    std::unique_ptr<Compiler> compiler;
+};
+
+TEST_F(SamplingProfilerTest, FoldsIdenticalStacks) {
+    compile(R"(
+        fn main() -> i32 { 1 }
+        fn outer() -> i32 { 2 }
+        fn inner() -> i32 { 3 }
+    )");
+    const auto& table = compiler->get_function_table();
+    uint32_t main = static_cast<uint32_t>(table.get_function_index("main"));
+    uint32_t outer = static_cast<uint32_t>(table.get_function_index("outer"));
+    uint32_t inner = static_cast<uint32_t>(table.get_function_index("inner"));
+
+    // Enough samples to wrap the ring buffer several times
+    SamplingProfiler profiler;
+    uint32_t deep[] = {main, outer, inner};
+    uint32_t shallow[] = {main};
+    for (int i = 0; i < 10000; ++i) {
+        profiler.record(deep, 3, 7);
+    }
+    profiler.record(deep, 3, 9);
+    profiler.record(shallow, 1, 2);
+    EXPECT_EQ(profiler.sample_count(), 10002u);
+
+    std::ostringstream folded;
+    profiler.write_folded(folded, table);
+    EXPECT_EQ(folded.str(), "main 1\nmain;outer;inner 10001\n");
+
+    std::ostringstream with_pcs;
+    profiler.write_folded(with_pcs, table, true);
+    EXPECT_EQ(with_pcs.str(), "main;outer;inner;pc 7 10000\nmain;outer;inner;pc 9 1\nmain;pc 2 1\n");
+}
+
+TEST_F(SamplingProfilerTest, KeepsTheInnermostFramesOfDeepStacks) {
+    compile("fn main() -> i32 { 1 } fn leaf() -> i32 { 2 }");
+    const auto& table = compiler->get_function_table();
+
+    std::vector<uint32_t> stack(SamplingProfiler::MAX_DEPTH + 5, 0);
+    stack.back() = static_cast<uint32_t>(table.get_function_index("leaf"));
+    SamplingProfiler profiler;
+    profiler.record(stack.data(), stack.size(), 0);
+
+    std::ostringstream folded;
+    profiler.write_folded(folded, table);
+    EXPECT_EQ(folded.str().rfind("[truncated];main;", 0), 0u);
+    EXPECT_NE(folded.str().find(";leaf 1\n"), std::string::npos);
+}
+
+TEST_F(SamplingProfilerTest, SamplesRunningPrograms) {
+    if (!SamplingProfiler::supported()) {
+        GTEST_SKIP() << "No sampling on this platform";
+    }
+    auto instructions = compile(R"(
+        fn step(x: i32) -> i32 {
+            x * 3 + 1
+        }
+
+        fn spin(n: i32, mut total: i32) -> i32 {
+            let mut i: i32 = 0;
+            while i < n {
+                total = step(total);
+                i = i + 1;
+            }
+            total
+        }
+    )");
+
+    for (bool verify : {false, true}) {
+        SamplingProfiler profiler(5000);
+        VMOptions options;
+        options.verify = verify;
+        options.sampler = &profiler;
+        VM vm(instructions, compiler->get_function_table(), {}, options);
+
+        profiler.start();
+        EXPECT_THROW(SamplingProfiler(100).start(), std::runtime_error);
+        vm.call("spin", {Value(verify ? 3000000 : 300000), Value(0)});
+        profiler.stop();
+
+        EXPECT_GT(profiler.sample_count(), 0u);
+        std::ostringstream folded;
+        profiler.write_folded(folded, compiler->get_function_table());
+        EXPECT_EQ(folded.str().rfind("spin", 0), 0u);
+    }
+}
+
+} // namespace nust
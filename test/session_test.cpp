@@ -0,0 +1,91 @@
+#include "session.h"
+#include "vm.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+
+namespace nust {
+
+namespace {
+
+int32_t run_main(const Module& module, const std::vector<Value>& args) {
+    VM vm(module.instructions, module.function_table, module.string_constants);
+    return vm.call("main", args).as_int();
+}
+
+const char* const square_source = R"(
+    fn square(x: i32) -> i32 {
+        x * x
+    }
+
+    fn main(x: i32) -> i32 {
+        square(x) + 1
+    }
+)";
+
+} // namespace
+
+TEST(SessionTest, CompilesManySources) {
+    Session session;
+    Module square = session.compile(square_source);
+    Module negate = session.compile(R"(
+        fn main(x: i32) -> i32 {
+            0 - x
+        }
+    )");
+
+    // Each module keeps its own tables after the session moves on
+    EXPECT_EQ(run_main(square, {Value(4)}), 17);
+    EXPECT_EQ(run_main(negate, {Value(4)}), -4);
+    EXPECT_EQ(square.function_table.size(), 2u);
+    EXPECT_EQ(negate.function_table.size(), 1u);
+    EXPECT_FALSE(square.span_table.empty());
+    EXPECT_EQ(session.compiled(), 2u);
+}
+
+TEST(SessionTest, RecoversFromErrors) {
+    Session session;
+    EXPECT_THROW(session.compile("fn main( -> i32 { 1 }"), std::runtime_error);
+    try {
+        session.compile(R"(
+            fn main(x: i32, x: i32) -> i32 {
+                x
+            }
+        )");
+        FAIL() << "Expected a type error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_NE(std::string(e.what()).find("Duplicate parameter name: x"), std::string::npos);
+    }
+
+    // Nothing from the failed compiles leaks into the next one
+    Module module = session.compile(R"(
+        fn main(x: i32) -> i32 {
+            x + 1
+        }
+    )");
+    EXPECT_EQ(run_main(module, {Value(1)}), 2);
+    EXPECT_EQ(session.compiled(), 1u);
+}
+
+TEST(SessionTest, OneSessionPerThread) {
+    std::vector<std::thread> threads;
+    std::vector<int32_t> results(4);
+    for (size_t t = 0; t < results.size(); ++t) {
+        threads.emplace_back([&results, t] {
+            Session session(CompilerOptions::optimized());
+            for (int32_t i = 0; i < 50; ++i) {
+                Module module = session.compile(square_source);
+                results[t] += run_main(module, {Value(i)});
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (int32_t result : results) {
+        // Sum of i * i + 1 for i in 0..49
+        EXPECT_EQ(result, 40425 + 50);
+    }
+}
+
+} // namespace nust
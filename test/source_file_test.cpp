@@ -0,0 +1,61 @@
+#include "source_file.h"
+#include "parser/parser.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace nust {
+
+namespace {
+
+// A file under /tmp, removed when the test is done
+class TempFile {
+public:
+    TempFile(const std::string& name, const std::string& contents)
+        : path("/tmp/nust_" + std::to_string(getpid()) + "_" + name) {
+        std::ofstream(path, std::ios::binary) << contents;
+    }
+    ~TempFile() { std::remove(path.c_str()); }
+
+    const std::string path;
+};
+
+} // namespace
+
+TEST(SourceFileTest, MapsRegularFiles) {
+    TempFile temp("mapped.nust", "fn main() -> i32 { 1 }\n");
+    SourceFile file(temp.path);
+    EXPECT_EQ(file.text(), "fn main() -> i32 { 1 }\n");
+#if defined(__unix__) || defined(__APPLE__)
+    EXPECT_TRUE(file.is_mapped());
+#endif
+    auto program = Parser(file.text()).parse();
+    EXPECT_EQ(program->items.size(), 1u);
+}
+
+TEST(SourceFileTest, ReadsEmptyAndMissingFiles) {
+    TempFile temp("empty.nust", "");
+    SourceFile file(temp.path);
+    EXPECT_TRUE(file.text().empty());
+    EXPECT_FALSE(file.is_mapped());
+    EXPECT_THROW(SourceFile("/tmp/nust_missing_file.nust"), std::runtime_error);
+}
+
+TEST(SourceFileTest, ParserStopsAtTheEndOfTheMapping) {
+    // A whole page ending mid-expression, so reading one byte past the end
+    // would touch the next, unmapped page
+    std::string source = "fn main() -> i32 { 1 + ";
+    std::string padding(4096 - source.size(), ' ');
+    TempFile temp("truncated.nust", source + padding.substr(0, padding.size() - 1) + "x");
+    SourceFile file(temp.path);
+    ASSERT_EQ(file.text().size(), 4096u);
+    EXPECT_THROW(Parser(file.text()).parse(), std::runtime_error);
+
+    TempFile identifier("identifier.nust", std::string(4095, ' ') + "f");
+    SourceFile ends_in_identifier(identifier.path);
+    EXPECT_THROW(Parser(ends_in_identifier.text()).parse(), std::runtime_error);
+}
+
+} // namespace nust
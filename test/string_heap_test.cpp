@@ -0,0 +1,54 @@
+#include "string_heap.h"
+#include "value.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace nust {
+
+TEST(StringHeapTest, InternsEqualStringsOnce) {
+    auto& heap = StringHeap::global();
+    InternedString a = heap.intern("interned");
+    size_t size = heap.size();
+    InternedString b = heap.intern(std::string("intern") + "ed");
+    EXPECT_EQ(heap.size(), size);
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(&a.str(), &b.str());
+    EXPECT_NE(a, heap.intern("other"));
+}
+
+TEST(StringHeapTest, KeepsLengthAndHash) {
+    InternedString s = StringHeap::global().intern("hello");
+    EXPECT_EQ(s.str(), "hello");
+    EXPECT_EQ(s.size(), 5u);
+    EXPECT_EQ(s.hash(), std::hash<std::string_view>()("hello"));
+    EXPECT_EQ(InternedString().str(), "");
+}
+
+TEST(StringHeapTest, ValuesShareTheirBytes) {
+    Value a(std::string("shared"));
+    Value b = a;
+    EXPECT_EQ(&a.as_string(), &b.as_string());
+    EXPECT_EQ(a, Value(std::string("shared")));
+    EXPECT_NE(a, Value(std::string("Shared")));
+}
+
+TEST(StringHeapTest, InternsFromManyThreads) {
+    std::vector<std::thread> threads;
+    std::vector<InternedString> results(8);
+    for (size_t i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&results, i] {
+            for (int n = 0; n < 1000; ++n) {
+                results[i] = StringHeap::global().intern("thread " + std::to_string(n));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& result : results) {
+        EXPECT_EQ(result, results[0]);
+    }
+}
+
+} // namespace nust
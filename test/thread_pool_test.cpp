@@ -0,0 +1,70 @@
+#include "thread_pool.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+namespace nust {
+
+TEST(ThreadPoolTest, RunsEveryTaskOnce) {
+    ThreadPool pool(4);
+    EXPECT_EQ(pool.size(), 4u);
+    std::vector<std::atomic<int>> runs(1000);
+    std::vector<std::atomic<int>> busy(pool.size());
+    std::atomic<bool> overlapped{false};
+    pool.run(runs.size(), [&](size_t index, size_t worker) {
+        // No two tasks share a worker index at once
+        if (busy[worker]++ != 0) {
+            overlapped = true;
+        }
+        ++runs[index];
+        --busy[worker];
+    });
+    for (const auto& count : runs) {
+        EXPECT_EQ(count, 1);
+    }
+    EXPECT_FALSE(overlapped);
+
+    // The pool can be reused, including for empty batches
+    pool.run(0, [](size_t, size_t) { FAIL(); });
+    std::atomic<size_t> total{0};
+    pool.run(10, [&](size_t index, size_t) { total += index; });
+    EXPECT_EQ(total, 45u);
+}
+
+TEST(ThreadPoolTest, IdleWorkersSteal) {
+    ThreadPool pool(2);
+    // Worker 0 is dealt tasks 0-3 and worker 1 tasks 4-7. Task 0 blocks
+    // until another task has run on worker 0's behalf, which only happens
+    // if worker 1 steals from worker 0's queue.
+    std::atomic<int> stolen{0};
+    std::atomic<bool> blocked_done{false};
+    pool.run(8, [&](size_t index, size_t worker) {
+        if (index == 0) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (stolen == 0 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::yield();
+            }
+            blocked_done = true;
+        } else if (index < 4 && worker == 1) {
+            ++stolen;
+        }
+    });
+    EXPECT_TRUE(blocked_done);
+    EXPECT_GT(stolen, 0);
+}
+
+TEST(ThreadPoolTest, RethrowsAfterTheBatch) {
+    ThreadPool pool(3);
+    std::atomic<int> runs{0};
+    EXPECT_THROW(pool.run(20, [&](size_t index, size_t) {
+        ++runs;
+        if (index == 7) {
+            throw std::runtime_error("task failed");
+        }
+    }), std::runtime_error);
+    EXPECT_EQ(runs, 20);
+}
+
+} // namespace nust
@@ -0,0 +1,130 @@
+#include "parser/parser.h"
+#include "type_checker.h"
+#include "compiler.h"
+#include "verifier.h"
+#include "vm.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+namespace nust {
+
+class VerifierTest : public ::testing::Test {
+protected:
+    // Compile the source, keeping the compiler for its function table
+    std::vector<Instruction> compile(const std::string& source,
+                                     CompilerOptions options = CompilerOptions()) {
+        Parser parser(source);
+        auto program = parser.parse();
+        EXPECT_TRUE(program != nullptr);
+
+        TypeChecker type_checker;
+        EXPECT_TRUE(type_checker.check_program(*program));
+
+        compiler = std::make_unique<Compiler>(options);
+        return compiler->compile(*program);
+    }
+
+    std::optional<VerifiedFunction> verify(const std::vector<Instruction>& instructions,
+                                           const std::string& name) {
+        const auto& table = compiler->get_function_table();
+        return BytecodeVerifier(instructions, table).verify_function(table.get_function_index(name));
+    }
+
+    std::unique_ptr<Compiler> compiler;
+};
+
+TEST_F(VerifierTest, AcceptsIntegerAndBooleanFunctions) {
+    std::string source = R"(
+        fn clamp(mut x: i32, low: bool) -> i32 {
+            if low && x < 0 {
+                x = 0;
+            }
+            x * 2 + 1
+        }
+
+        fn positive(x: i32) -> bool {
+            clamp(x, true) > 0
+        }
+    )";
+
+    for (auto options : {CompilerOptions(), CompilerOptions::optimized()}) {
+        auto instructions = compile(source, options);
+        auto clamp = verify(instructions, "clamp");
+        ASSERT_TRUE(clamp.has_value());
+        EXPECT_EQ(clamp->num_locals, 2u);
+        EXPECT_GE(clamp->max_depth, 2u);
+        ASSERT_TRUE(clamp->states[0].has_value());
+        EXPECT_EQ(clamp->states[0]->locals, (std::vector<SlotType>{SlotType::Int, SlotType::Bool}));
+        EXPECT_TRUE(clamp->states[0]->stack.empty());
+        EXPECT_TRUE(verify(instructions, "positive").has_value());
+        EXPECT_TRUE(BytecodeVerifier(instructions, compiler->get_function_table()).verify().has_value());
+    }
+}
+
+TEST_F(VerifierTest, RejectsStringsAndReferences) {
+    std::string source = R"(
+        fn named(x: i32, name: str) -> i32 {
+            x + 1
+        }
+
+        fn borrows(x: i32) -> i32 {
+            let r: &i32 = &x;
+            x + 2
+        }
+
+        fn plain(x: i32) -> i32 {
+            x + 3
+        }
+    )";
+
+    auto instructions = compile(source);
+    EXPECT_FALSE(verify(instructions, "named").has_value());
+    EXPECT_FALSE(verify(instructions, "borrows").has_value());
+    EXPECT_TRUE(verify(instructions, "plain").has_value());
+    EXPECT_FALSE(BytecodeVerifier(instructions, compiler->get_function_table()).verify().has_value());
+}
+
+TEST_F(VerifierTest, RejectsMalformedBytecode) {
+    compile("fn f(x: i32) -> i32 { x }");
+
+    // Popping past the frame, adding a bool, and jumping out of the function
+    std::vector<std::vector<Instruction>> programs = {
+        {Instruction(Opcode::ADD_I32), Instruction(Opcode::RET_VAL)},
+        {Instruction(Opcode::LOAD, 0), Instruction(Opcode::PUSH_BOOL, 1),
+         Instruction(Opcode::ADD_I32), Instruction(Opcode::RET_VAL)},
+        {Instruction(Opcode::JMP, 7)},
+    };
+    for (const auto& program : programs) {
+        EXPECT_FALSE(verify(program, "f").has_value());
+    }
+}
+
+TEST_F(VerifierTest, VerifiedProgramsRunUnchecked) {
+    std::string source = R"(
+        fn depth(mut n: i32, mut total: i32) -> i32 {
+            while n > 0 {
+                total = depth(n - 1, 0) + 1;
+                n = 0;
+            }
+            total
+        }
+    )";
+
+    auto instructions = compile(source);
+    VM vm(instructions, compiler->get_function_table(), compiler->get_string_constants());
+    EXPECT_TRUE(vm.is_verified());
+
+    // Deep enough to grow the raw stack several times
+    EXPECT_EQ(vm.call("depth", {Value(20000), Value(0)}).as_int(), 20000);
+    EXPECT_THROW(vm.call("depth", {Value(true), Value(0)}), std::runtime_error);
+
+    VMOptions options;
+    options.verify = false;
+    options.max_call_depth = 100;
+    VM checked(instructions, compiler->get_function_table(), compiler->get_string_constants(), options);
+    EXPECT_FALSE(checked.is_verified());
+    EXPECT_EQ(checked.call("depth", {Value(50), Value(0)}).as_int(), 50);
+    EXPECT_THROW(checked.call("depth", {Value(200), Value(0)}), std::runtime_error);
+}
+
+} // namespace nust
@@ -0,0 +1,312 @@
+#include "parser/parser.h"
+#include "type_checker.h"
+#include "compiler.h"
+#include "vm.h"
+#include "register_translator.h"
+#include "register_vm.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+namespace nust {
+
+enum class Backend {
+    Stack,      // The stack bytecode interpreter, checking every value's type
+    Verified,   // The stack interpreter on raw slots when the program verifies
+    Registers,  // The register machine translation
+    Jit         // The stack interpreter, compiling every function on its first call
+};
+
+// Parameterized on whether to optimize and which backend runs the code
+class VMTest : public ::testing::TestWithParam<std::tuple<bool, Backend>> {
+protected:
+    // Compile the source and call the given function
+    Value run(const std::string& source, const std::string& name = "main",
+              const std::vector<Value>& args = {}) {
+        Parser parser(source);
+        auto program = parser.parse();
+        EXPECT_TRUE(program != nullptr);
+        
+        TypeChecker type_checker;
+        EXPECT_TRUE(type_checker.check_program(*program));
+        
+        bool optimized = std::get<0>(GetParam());
+        Compiler compiler(optimized ? CompilerOptions::optimized() : CompilerOptions());
+        auto instructions = compiler.compile(*program);
+        
+        Backend backend = std::get<1>(GetParam());
+        if (backend == Backend::Registers) {
+            RegisterVM vm(RegisterTranslator().translate(instructions, compiler.get_function_table(),
+                                                         compiler.get_string_constants()));
+            return vm.call(name, args);
+        }
+        VMOptions options;
+        options.verify = backend != Backend::Stack;
+        options.jit.enabled = backend == Backend::Jit;
+        options.jit.threshold = 0;
+        VM vm(instructions, compiler.get_function_table(), compiler.get_string_constants(), options);
+        return vm.call(name, args);
+    }
+};
+
+TEST_P(VMTest, Arithmetic) {
+    std::string source = R"(
+        fn main() -> i32 {
+            1 + 2 * 3 - 8 / 4
+        }
+    )";
+    
+    EXPECT_EQ(run(source).as_int(), 5);
+}
+
+TEST_P(VMTest, FunctionCalls) {
+    std::string source = R"(
+        fn add(x: i32, y: i32) -> i32 {
+            x + y
+        }
+        
+        fn sub(x: i32, y: i32) -> i32 {
+            x - y
+        }
+        
+        fn main(a: i32) -> i32 {
+            sub(add(a, 10), 2)
+        }
+    )";
+    
+    EXPECT_EQ(run(source, "main", {Value(5)}).as_int(), 13);
+}
+
+TEST_P(VMTest, CallsInsideExpressions) {
+    std::string source = R"(
+        fn square(x: i32) -> i32 {
+            x * x
+        }
+        
+        fn less(a: i32, b: i32) -> bool {
+            a < b
+        }
+        
+        fn main(a: i32, b: i32) -> bool {
+            less(a - square(b) * 2, square(a + b) - square(a) + b) == (a < b)
+        }
+    )";
+    
+    // 3 - 18 = -15 against 36 - 9 + 3 = 30, and 3 < 3 is false
+    EXPECT_EQ(run(source, "main", {Value(3), Value(3)}).as_bool(), false);
+    EXPECT_EQ(run(source, "main", {Value(2), Value(3)}).as_bool(), true);
+}
+
+TEST_P(VMTest, StackOverflow) {
+    if (std::get<1>(GetParam()) == Backend::Registers) {
+        GTEST_SKIP() << "The register machine has no call depth limit";
+    }
+    std::string source = R"(
+        fn forever(n: i32) -> i32 {
+            forever(n + 1) + 1
+        }
+    )";
+    
+    EXPECT_THROW(run(source, "forever", {Value(0)}), std::runtime_error);
+}
+
+TEST_P(VMTest, WhileLoop) {
+    std::string source = R"(
+        fn count(mut n: i32, mut acc: i32) -> i32 {
+            while n > 0 {
+                acc = acc + n;
+                n = n - 1;
+            }
+            acc
+        }
+    )";
+    
+    EXPECT_EQ(run(source, "count", {Value(100), Value(0)}).as_int(), 5050);
+}
+
+TEST_P(VMTest, ShortCircuitSkipsRightOperand) {
+    std::string source = R"(
+        fn crash(x: i32) -> bool {
+            x / 0 == 0
+        }
+        
+        fn main(a: bool) -> bool {
+            a && crash(1) || !a
+        }
+    )";
+    
+    EXPECT_TRUE(run(source, "main", {Value(false)}).as_bool());
+    EXPECT_THROW(run(source, "main", {Value(true)}), std::runtime_error);
+}
+
+TEST_P(VMTest, TailCalls) {
+    std::string source = R"(
+        fn helper(x: i32, y: i32) -> i32 {
+            x * 10 + y
+        }
+        
+        fn main(x: i32) -> i32 {
+            helper(x + 1, x)
+        }
+    )";
+    
+    EXPECT_EQ(run(source, "main", {Value(4)}).as_int(), 54);
+}
+
+TEST_P(VMTest, TailCallsIntoLargerFrames) {
+    // The callees take more parameters than their callers have registers,
+    // so the arguments sit in temporaries overlapping the parameters they
+    // are copied into
+    std::string source = R"(
+        fn f(mut a: i32, mut b: i32, mut r: i32, d: i32) -> i32 {
+            if d > 0 {
+                r = r + f(b, d, 1, d - 1);
+            }
+            (d / 3)
+        }
+
+        fn g(a: i32, b: i32, c: i32, d: i32, e: i32) -> i32 {
+            a * 10000 + b * 1000 + c * 100 + d * 10 + e
+        }
+
+        fn main(a: i32, b: i32) -> i32 {
+            f(a, b, 0, 3)
+        }
+
+        fn shuffle(a: i32, b: i32) -> i32 {
+            g(b, a, a + b, 4, 5)
+        }
+    )";
+
+    EXPECT_EQ(run(source, "main", {Value(1), Value(2)}).as_int(), 1);
+    EXPECT_EQ(run(source, "shuffle", {Value(1), Value(2)}).as_int(), 21345);
+}
+
+TEST_P(VMTest, UnitReturn) {
+    std::string source = R"(
+        fn nothing(x: i32) {
+            let y: i32 = x;
+        }
+        
+        fn main() -> i32 {
+            nothing(1) + 7
+        }
+    )";
+    
+    EXPECT_EQ(run(source).as_int(), 7);
+}
+
+TEST_P(VMTest, LoopOptimizations) {
+    std::string source = R"(
+        fn kernel(n: i32, k: i32) -> i32 {
+            weighted(n, k, 0, 0)
+        }
+        
+        fn weighted(n: i32, k: i32, mut i: i32, mut total: i32) -> i32 {
+            while i <= n - 1 {
+                total = total + i * k + i * k + (k + 1) * 2;
+                if i * k > 10 {
+                    i = i + 2;
+                } else {
+                    i = i + 1;
+                }
+                let mut j: i32 = 10;
+                while j > 0 {
+                    total = total - j * 2 + (n - k);
+                    j = j - 3;
+                }
+            }
+            total
+        }
+    )";
+    
+    // i takes 0, 1, 2, 3, 4, 6, 8: the sum of 2 * i * 3 + 8 is 200, and the
+    // inner loop runs for j = 10, 7, 4, 1 adding -44 + 4 * 7 = -16 each time
+    EXPECT_EQ(run(source, "kernel", {Value(10), Value(3)}).as_int(), 200 - 7 * 16);
+}
+
+TEST_P(VMTest, Superinstructions) {
+    std::string source = R"(
+        fn main(n: i32, mut total: i32) -> i32 {
+            let mut i: i32 = 0;
+            while i < n {
+                total = total + i;
+                i = i + 1;
+            }
+            while total < 100 {
+                total = total + 3;
+            }
+            total + n
+        }
+    )";
+    
+    // -2 + 0 + 1 + ... + 9 = 43, then raised by 3 until it reaches 100
+    EXPECT_EQ(run(source, "main", {Value(10), Value(-2)}).as_int(), 100 + 10);
+    EXPECT_EQ(run(source, "main", {Value(20), Value(0)}).as_int(), 190 + 20);
+}
+
+TEST(VMLoadTest, RejectsCallsToMissingFunctions) {
+    Parser parser("fn main() -> i32 { 1 }");
+    auto program = parser.parse();
+    ASSERT_TRUE(program != nullptr);
+    Compiler compiler;
+    compiler.compile(*program);
+    
+    // Call targets are resolved when the VM is created, not when the call runs
+    std::vector<Instruction> instructions = {
+        Instruction(Opcode::CALL, 1), Instruction(Opcode::RET_VAL)
+    };
+    EXPECT_THROW(VM(instructions, compiler.get_function_table(), {}), std::runtime_error);
+}
+
+TEST(VMReferenceTest, ReferencesAreSlotAddresses) {
+    Parser parser("fn main(x: i32) -> i32 { x }");
+    auto program = parser.parse();
+    ASSERT_TRUE(program != nullptr);
+    Compiler compiler;
+    compiler.compile(*program);
+    
+    // Borrow a temporary into slot 0, store through the reference, then read
+    // it back both through the reference and from the slot itself
+    std::vector<Instruction> instructions = {
+        Instruction(Opcode::PUSH_I32, 5),
+        Instruction(Opcode::BORROW_MUT, 0),
+        Instruction(Opcode::DUP),
+        Instruction(Opcode::PUSH_I32, 9),
+        Instruction(Opcode::STORE_REF),
+        Instruction(Opcode::DEREF),
+        Instruction(Opcode::LOAD, 0),
+        Instruction(Opcode::ADD_I32),
+        Instruction(Opcode::RET_VAL)
+    };
+    const auto& table = compiler.get_function_table();
+    
+    VM vm(instructions, table, {});
+    EXPECT_EQ(vm.call("main", {Value(0)}).as_int(), 18);
+    RegisterVM registers(RegisterTranslator().translate(instructions, table, {}));
+    EXPECT_EQ(registers.call("main", {Value(0)}).as_int(), 18);
+}
+
+TEST(VMCountTest, CountsCheckedInstructions) {
+    Parser parser("fn main(x: i32) -> i32 { x + 1 }");
+    auto program = parser.parse();
+    ASSERT_TRUE(program != nullptr);
+    Compiler compiler;
+    auto instructions = compiler.compile(*program);
+    
+    VMOptions options;
+    options.verify = false;
+    VM vm(instructions, compiler.get_function_table(), compiler.get_string_constants(), options);
+    EXPECT_EQ(vm.instructions_executed(), 0u);
+    vm.call("main", {Value(1)});
+    uint64_t per_call = vm.instructions_executed();
+    EXPECT_GT(per_call, 0u);
+    vm.call("main", {Value(2)});
+    EXPECT_EQ(vm.instructions_executed(), 2 * per_call);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, VMTest,
+                         ::testing::Combine(::testing::Bool(),
+                                            ::testing::Values(Backend::Stack, Backend::Verified,
+                                                              Backend::Registers, Backend::Jit)));
+
+} // namespace nust
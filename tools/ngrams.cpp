@@ -0,0 +1,149 @@
+// Mines opcode n-gram frequencies from compiled Nust sources, to choose which
+// sequences are worth a superinstruction.
+//
+// Usage: nust_ngrams [-n MAX] [--top K] <source_file>...
+//
+// Sources are compiled with every optimization except superinstruction
+// selection, and sequences of 2..MAX opcodes are counted within basic blocks
+// (a sequence never starts before a jump target or runs past a jump).
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "parser/parser.h"
+#include "type_checker.h"
+#include "compiler.h"
+
+namespace {
+
+// A whole argument read as a number in [1, max], or nothing if it isn't one
+std::optional<size_t> parse_count(const char* text, size_t max) {
+    size_t value = 0;
+    const char* end = text + std::char_traits<char>::length(text);
+    auto [stop, error] = std::from_chars(text, end, value);
+    if (error != std::errc() || stop != end || value < 1 || value > max) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+bool ends_block(const nust::Instruction& instr) {
+    switch (instr.opcode) {
+        case nust::Opcode::JMP:
+        case nust::Opcode::JMP_IF:
+        case nust::Opcode::JMP_IF_NOT:
+        case nust::Opcode::CALL:
+        case nust::Opcode::TAIL_CALL:
+        case nust::Opcode::RET:
+        case nust::Opcode::RET_VAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void count_ngrams(const std::vector<nust::Instruction>& instructions, size_t max_length,
+                  std::map<std::vector<nust::Opcode>, size_t>& counts) {
+    std::vector<bool> block_start(instructions.size() + 1, false);
+    for (const auto& instr : instructions) {
+        if (instr.is_jump()) {
+            block_start[instr.operand] = true;
+        }
+    }
+    
+    for (size_t pc = 0; pc < instructions.size(); ++pc) {
+        std::vector<nust::Opcode> ngram{instructions[pc].opcode};
+        for (size_t next = pc + 1; next < instructions.size() && ngram.size() < max_length; ++next) {
+            if (ends_block(instructions[next - 1]) || block_start[next]) {
+                break;
+            }
+            ngram.push_back(instructions[next].opcode);
+            ++counts[ngram];
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t max_length = 4;
+    size_t top = 20;
+    bool valid = true;
+    std::vector<std::string> sources;
+    for (int i = 1; i < argc && valid; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            // A single opcode is no sequence, so MAX is at least 2
+            auto count = parse_count(argv[++i], SIZE_MAX);
+            max_length = std::max<size_t>(2, count.value_or(0));
+            valid = count.has_value();
+        } else if (arg == "--top" && i + 1 < argc) {
+            auto count = parse_count(argv[++i], SIZE_MAX);
+            top = count.value_or(0);
+            valid = count.has_value();
+        } else {
+            sources.push_back(arg);
+        }
+    }
+    if (!valid || sources.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [-n MAX] [--top K] <source_file>...\n";
+        return 1;
+    }
+    
+    nust::CompilerOptions options = nust::CompilerOptions::optimized();
+    options.superinstructions = false;
+    
+    std::map<std::vector<nust::Opcode>, size_t> counts;
+    for (const auto& source_file : sources) {
+        std::ifstream file(source_file);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open file: " << source_file << "\n";
+            return 1;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string source = buffer.str();
+        
+        try {
+            nust::Parser parser(source);
+            auto program = parser.parse();
+            nust::TypeChecker type_checker;
+            if (!type_checker.check_program(*program)) {
+                std::cerr << source_file << ": type checking failed\n";
+                return 1;
+            }
+            nust::Compiler compiler(options);
+            count_ngrams(compiler.compile(*program), max_length, counts);
+        } catch (const std::exception& e) {
+            std::cerr << source_file << ": " << e.what() << "\n";
+            return 1;
+        }
+    }
+    
+    // Longer sequences save more dispatches per occurrence, so rank by the
+    // number of dispatches a fused opcode would remove
+    std::vector<std::pair<std::vector<nust::Opcode>, size_t>> ranked(counts.begin(), counts.end());
+    auto saved = [](const std::pair<std::vector<nust::Opcode>, size_t>& entry) {
+        return entry.second * (entry.first.size() - 1);
+    };
+    std::stable_sort(ranked.begin(), ranked.end(), [&](const auto& a, const auto& b) {
+        return saved(a) > saved(b);
+    });
+    
+    std::cout << "count\tsaved\tsequence\n";
+    for (size_t i = 0; i < ranked.size() && i < top; ++i) {
+        std::cout << ranked[i].second << "\t" << saved(ranked[i]) << "\t";
+        for (size_t j = 0; j < ranked[i].first.size(); ++j) {
+            std::cout << (j > 0 ? "; " : "") << nust::opcode_to_string(ranked[i].first[j]);
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
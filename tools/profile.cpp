@@ -0,0 +1,172 @@
+// Runs a function of a Nust program under the opcode profiler and prints
+// where the interpreter spent its time.
+//
+// Usage: nust_profile [-O] [--checked] [--json] [--top K] [--function NAME]
+//                     [--folded FILE [--hz N] [--pcs]] <source_file> [ARG...]
+//
+// Arguments are passed to the function as i32 values, or as bools when they
+// are `true` or `false`. The opcode profiler only records anything when the
+// tree is built with profiling hooks (make PROFILE=1 tools).
+//
+// With --folded, the run is also sampled N times per second of CPU time
+// (1000 by default) and the call stacks are written to FILE in the folded
+// format flamegraph tools read; --pcs splits each function by the source
+// line and column of the sampled instruction.
+
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "parser/parser.h"
+#include "type_checker.h"
+#include "compiler.h"
+#include "vm.h"
+
+namespace {
+
+// A whole argument read as a number in [1, max], or nothing if it isn't one
+std::optional<size_t> parse_count(const char* text, size_t max) {
+    size_t value = 0;
+    const char* end = text + std::char_traits<char>::length(text);
+    auto [stop, error] = std::from_chars(text, end, value);
+    if (error != std::errc() || stop != end || value < 1 || value > max) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    bool optimize = false;
+    bool json = false;
+    size_t top = 20;
+    std::string function = "main";
+    std::string folded_file;
+    unsigned frequency = 1000;
+    bool pcs = false;
+    nust::VMOptions vm_options;
+    std::vector<std::string> positional;
+    bool valid = true;
+    for (int i = 1; i < argc && valid; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-O") {
+            optimize = true;
+        } else if (arg == "--checked") {
+            vm_options.verify = false;
+        } else if (arg == "--json") {
+            json = true;
+        } else if (arg == "--top" && i + 1 < argc) {
+            auto count = parse_count(argv[++i], SIZE_MAX);
+            top = count.value_or(0);
+            valid = count.has_value();
+        } else if (arg == "--function" && i + 1 < argc) {
+            function = argv[++i];
+        } else if (arg == "--folded" && i + 1 < argc) {
+            folded_file = argv[++i];
+        } else if (arg == "--hz" && i + 1 < argc) {
+            // At most one sample a microsecond
+            auto count = parse_count(argv[++i], 1000000);
+            frequency = static_cast<unsigned>(count.value_or(0));
+            valid = count.has_value();
+        } else if (arg == "--pcs") {
+            pcs = true;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (!valid || positional.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [-O] [--checked] [--json] [--top K] [--function NAME]"
+                  << " [--folded FILE [--hz N] [--pcs]] <source_file> [ARG...]\n";
+        return 1;
+    }
+    if (!NUST_PROFILE && folded_file.empty()) {
+        std::cerr << "Warning: built without profiling hooks, so nothing is recorded; "
+                  << "rebuild with make PROFILE=1\n";
+    }
+
+    std::ifstream file(positional[0]);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file: " << positional[0] << "\n";
+        return 1;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string source = buffer.str();
+
+    try {
+        nust::Parser parser(source);
+        auto program = parser.parse();
+        nust::TypeChecker type_checker;
+        if (!type_checker.check_program(*program)) {
+            std::cerr << positional[0] << ": type checking failed\n";
+            return 1;
+        }
+        nust::Compiler compiler(optimize ? nust::CompilerOptions::optimized() : nust::CompilerOptions());
+        auto instructions = compiler.compile(*program);
+
+        std::vector<nust::Value> args;
+        for (size_t i = 1; i < positional.size(); ++i) {
+            if (positional[i] == "true" || positional[i] == "false") {
+                args.push_back(nust::Value(positional[i] == "true"));
+            } else {
+                args.push_back(nust::Value(static_cast<nust::Value::IntType>(std::stol(positional[i]))));
+            }
+        }
+
+        nust::SamplingProfiler sampler(frequency);
+        if (!folded_file.empty()) {
+            if (!nust::SamplingProfiler::supported()) {
+                std::cerr << "Sampling is not supported on this platform\n";
+                return 1;
+            }
+            vm_options.sampler = &sampler;
+        }
+
+        nust::VM vm(instructions, compiler.get_function_table(), compiler.get_string_constants(), vm_options);
+        if (vm_options.sampler) {
+            sampler.start();
+        }
+        nust::Value result = vm.call(function, args);
+        sampler.stop();
+
+        if (!folded_file.empty()) {
+            std::ofstream folded(folded_file);
+            if (!folded.is_open()) {
+                std::cerr << "Failed to open output file: " << folded_file << "\n";
+                return 1;
+            }
+            nust::SourceMap source_map{compiler.get_span_table(), nust::LineIndex(source)};
+            sampler.write_folded(folded, compiler.get_function_table(), pcs, &source_map);
+            std::cerr << sampler.sample_count() << " samples written to " << folded_file << "\n";
+        }
+        if (!json) {
+            std::cout << function << " returned ";
+            if (result.is_bool()) {
+                std::cout << (result.as_bool() ? "true" : "false");
+            } else if (result.is_int()) {
+                std::cout << result.as_int();
+            }
+            std::cout << (vm.is_verified() ? " (unchecked interpreter)" : " (checked interpreter)") << "\n";
+        }
+#if NUST_PROFILE
+        const auto& profiler = vm.get_profiler();
+        if (json) {
+            profiler.write_json(std::cout, compiler.get_function_table());
+        } else {
+            std::cout << "\n";
+            profiler.write_table(std::cout, compiler.get_function_table(), top);
+        }
+#else
+        (void)top;
+#endif
+    } catch (const std::exception& e) {
+        std::cerr << positional[0] << ": " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}